@@ -1,21 +1,58 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "fib.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "fib_anim.h"
+#include "fib_apng.h"
 #include "fib_image.h"
+#include "fib_live.h"
+#include "fib_memory.h"
+#include "fib_pipeline.h"
+#include "fib_plan.h"
 #include "fib_render.h"
+#include "fib_shard.h"
+
+#define FIB_PREVIEW_PIXELS_PER_CELL 2
 
 void fib_print_usage(const char *program_name) {
-    printf("usage: %s [--ansi|--no-ansi|--color auto|always|never] [--palette classic|smooth|blocks] <input.(png|jpg|jpeg)> [output_width] [output_height] [output.txt]\n",
+    printf("usage: %s [--ansi|--no-ansi|--color auto|always|never] [--palette classic|smooth|blocks] [--quality fast|balanced|best] [--glyphs ramp|shape] [--edges sobel|box] [--format text|grid] [--threads N] [--max-memory BYTES] [--frame-cache BYTES] [--verbose] [--watch] [--fit] [--incremental] [--no-huge-pages] [--no-profile] [--preview] [--poster] [--shard i/N [--tones FILE]] [--write-tones FILE] [--shm /name] [--pipeline [--in-flight N]] <input.(png|jpg|jpeg|pgm|ppm|pam)> [output_width] [output_height] [output.txt]\n",
            program_name);
     printf("  --ansi         : force ANSI color output (compat alias for --color always)\n");
     printf("  --no-ansi      : disable ANSI color output (compat alias for --color never)\n");
     printf("  --color        : color mode (auto, always, never)\n");
     printf("  --palette      : shading profile (classic, smooth, blocks)\n");
-    printf("  input          : input image file (png/jpg/jpeg)\n");
+    printf("  --quality      : analysis tier (fast, balanced, best); fast/balanced analyze a reduced grid for large inputs\n");
+    printf("  --glyphs       : glyph selection (ramp by brightness, shape matches cell structure to glyph outlines)\n");
+    printf("  --edges        : edge gradient (sobel 3x3 at the cell center, box compares half-cell sums)\n");
+    printf("  --format       : output format (text, or grid for binary glyph/shade frames appended to the output)\n");
+    printf("  --threads      : worker threads for image analysis (default: --autotune profile, else online CPUs)\n");
+    printf("  --max-memory   : peak memory budget in bytes (K/M/G suffixes allowed); picks the cheapest viable pipeline\n");
+    printf("  --frame-cache  : rendered-frame cache for looping animated PNGs (default 64M, 0 renders every frame on demand)\n");
+    printf("  --no-huge-pages: keep images and summed-area tables on normal pages (default: 2 MiB transparent huge pages)\n");
+    printf("  --verbose      : report the chosen memory plan on stderr\n");
+    printf("  --watch        : re-render in place whenever the input file is saved (Linux)\n");
+    printf("  --fit          : size output to the terminal and repaint on resize\n");
+    printf("  --incremental  : with --watch/--shm, redraw only output rows whose pixels or dither input changed\n");
+    printf("  --preview      : decode interlaced PNGs only up to the first Adam7 pass that covers the output\n");
+    printf("  --poster       : render large outputs (up to 100000x100000) in parallel row bands written in place to output.txt\n");
+    printf("  --shard        : render only shard i of N of the poster bands to output.txt; join shards with --merge\n");
+    printf("  --tones        : tone histogram from --write-tones shared by every shard (default: each shard computes it)\n");
+    printf("  --write-tones  : compute the whole-image tone histogram for --shard into FILE and exit\n");
+    printf("  --pipeline     : read image paths from stdin, one per line, and write their outputs in order\n");
+    printf("  --in-flight    : images --pipeline keeps between reading and writing (1..%d, default %d)\n", FIB_PIPELINE_MAX_IN_FLIGHT,
+           FIB_PIPELINE_DEFAULT_IN_FLIGHT);
+    printf("  --merge        : %s --merge output.txt shard... concatenates shard outputs in order\n", program_name);
+    printf("  --autotune     : %s --autotune calibrates this machine and saves a profile under $XDG_CACHE_HOME/fib\n", program_name);
+    printf("  --show-profile : %s --show-profile prints the saved profile and whether it applies to this machine\n", program_name);
+    printf("  --shm          : render the newest frame of a shared-memory frame ring instead of <input>\n");
+    printf("  input          : input image file (png/jpg/jpeg/pgm/ppm/pam)\n");
     printf("  output_width   : output width in chars (default: %d)\n", FIB_DEFAULT_OUTPUT_WIDTH);
     printf("  output_height  : output height in lines (default: %d)\n", FIB_DEFAULT_OUTPUT_HEIGHT);
     printf("  output.txt     : output file (default: stdout)\n");
@@ -33,7 +70,7 @@ static int env_truthy(const char *name) {
     return 1;
 }
 
-static int should_enable_color(FibColorMode mode, int has_output_path, FILE *output) {
+int fib_should_enable_color(FibColorMode mode, int has_output_path) {
     if (mode == FIB_COLOR_ALWAYS) {
         return 1;
     }
@@ -55,7 +92,6 @@ static int should_enable_color(FibColorMode mode, int has_output_path, FILE *out
     if (term && strcmp(term, "dumb") == 0) {
         return 0;
     }
-    (void)output;
     if (!isatty(STDOUT_FILENO)) {
         return 0;
     }
@@ -65,32 +101,184 @@ static int should_enable_color(FibColorMode mode, int has_output_path, FILE *out
     return 1;
 }
 
+/* Adam7 preview: the grid of the earliest pass that gives every cell a few pixels. */
+static int choose_preview(const FibImageInfo *info, const FibRenderConfig *config, FibImageInfo *grid_info, int *passes_out) {
+    int step_x = 1;
+    int step_y = 1;
+
+    *grid_info = *info;
+    *passes_out = 7;
+    if (!config->preview || info->format != FIB_IMAGE_FORMAT_PNG || !info->interlaced) {
+        return 0;
+    }
+
+    int passes = fib_image_preview_passes(info->width, info->height, config->output_width * FIB_PREVIEW_PIXELS_PER_CELL,
+                                          config->output_height * FIB_PREVIEW_PIXELS_PER_CELL, &step_x, &step_y);
+    if (passes == 7) {
+        return 0;
+    }
+    grid_info->width = (info->width + step_x - 1) / step_x;
+    grid_info->height = (info->height + step_y - 1) / step_y;
+    grid_info->interlaced = 0;
+    *passes_out = passes;
+    return 1;
+}
+
+/* Text output replaces the file; grid frames are appended so one file can hold a stream. */
+FILE *fib_open_output(const char *output_path, const FibRenderConfig *config) {
+    FILE *output = fopen(output_path, config->format == FIB_FORMAT_GRID ? "ab" : "w");
+    if (!output) {
+        fprintf(stderr, "error: cannot create output file %s\n", output_path);
+    }
+    return output;
+}
+
+int fib_load_planned_image(const char *input_path, const FibRenderConfig *config, FibImage *image, FibRenderConfig *runtime_config,
+                           FibRenderContext *context, FibImageInfo *planned_info, FibPlan *plan_out) {
+    FibImageInfo info;
+    FibImageInfo grid_info;
+    FibPlan plan;
+    int passes = 7;
+
+    if (!fib_image_probe(input_path, &info)) {
+        return 0;
+    }
+    /* live modes keep the image while another process may truncate the file, so they never map it in place */
+    int private_pixels = config->watch || config->fit;
+    if (private_pixels) {
+        info.zero_copy = 0;
+    }
+    int preview = choose_preview(&info, config, &grid_info, &passes);
+    if (!fib_plan_choose(&grid_info, config, &plan)) {
+        fprintf(stderr, "error: no render pipeline for %dx%d input fits in %zu bytes (cheapest needs %zu)\n", info.width,
+                info.height, config->max_memory, plan.peak_bytes);
+        return 0;
+    }
+    int decoded_width = grid_info.width / plan.downscale + (grid_info.width % plan.downscale != 0);
+    int decoded_height = grid_info.height / plan.downscale + (grid_info.height % plan.downscale != 0);
+    if (config->verbose) {
+        fib_plan_report(&info, config, &plan, stderr);
+        if (preview) {
+            fprintf(stderr, "fib: preview from Adam7 passes 1-%d, grid %dx%d\n", passes, grid_info.width, grid_info.height);
+        }
+        int quality_factor = fib_render_quality_factor(decoded_width, decoded_height, config);
+        if (quality_factor > 1) {
+            fprintf(stderr, "fib: quality %s, analysis grid %dx%d (box %d)\n", fib_quality_name(config->quality),
+                    decoded_width / quality_factor + (decoded_width % quality_factor != 0),
+                    decoded_height / quality_factor + (decoded_height % quality_factor != 0), quality_factor);
+        }
+    }
+
+    FibImageLoadOptions load_options = {plan.downscale, 0, 0, NULL, NULL, private_pixels};
+    if (preview) {
+        load_options.preview_width = config->output_width * FIB_PREVIEW_PIXELS_PER_CELL;
+        load_options.preview_height = config->output_height * FIB_PREVIEW_PIXELS_PER_CELL;
+    }
+    runtime_config->sat_layout = plan.sat_layout;
+    int overlap = context && fib_render_context_overlap(context, decoded_width, decoded_height, runtime_config);
+    if (overlap) {
+        load_options.rows_ready = fib_render_context_rows_ready;
+        load_options.rows_user_data = context;
+    }
+    if (!fib_image_load_with_options(input_path, &load_options, image)) {
+        return 0;
+    }
+    if (config->verbose && overlap) {
+        fprintf(stderr, "fib: %s summed-area tables built %s decode\n", fib_sat_layout_name(context->overlap_layout),
+                context->analysis_ready ? "during" : "after");
+    }
+    if (planned_info) {
+        *planned_info = grid_info;
+    }
+    if (plan_out) {
+        *plan_out = plan;
+    }
+    return 1;
+}
+
+static int render_poster(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config, const char *output_path) {
+    int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (fd < 0) {
+        fprintf(stderr, "error: cannot create output file %s: %s\n", output_path, strerror(errno));
+        return 0;
+    }
+    int ok = fib_render_poster(context, image, config, fd);
+    if (close(fd) != 0 && ok) {
+        fprintf(stderr, "error: cannot finish writing %s: %s\n", output_path, strerror(errno));
+        ok = 0;
+    }
+    if (ok) {
+        printf("ascii poster saved to: %s\n", output_path);
+    }
+    return ok;
+}
+
+static int finish_still(FibRenderContext *context, FibImage *image, const FibRenderConfig *config, int ok) {
+    fib_render_context_free(context);
+    fib_image_free(image);
+    if (config->verbose) {
+        fprintf(stderr, "fib: %zu bytes peak in huge-page buffers%s\n", fib_memory_huge_peak(),
+                config->huge_pages ? "" : " (--no-huge-pages)");
+    }
+    return ok ? 0 : 1;
+}
+
+/* Standard output takes rows through a writev sink, a batch of rows per system call. */
+static int render_to_descriptor(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config, int fd) {
+    FibSink sink;
+
+    fib_sink_init_writev(&sink, fd);
+    int ok = fib_render_context_emit(context, image, config, &sink);
+    fib_sink_free(&sink);
+    return ok;
+}
+
 int fib_run(const char *input_path, const FibRenderConfig *config, const char *output_path) {
     FibRenderConfig runtime_config = *config;
+    FibRenderContext context;
     FibImage image = {0};
-    if (!fib_image_load(input_path, &image)) {
-        return 1;
-    }
 
-    FILE *output = stdout;
-    if (output_path) {
-        output = fopen(output_path, "w");
-        if (!output) {
-            fprintf(stderr, "error: cannot create output file %s\n", output_path);
-            fib_image_free(&image);
+    if (config->pipeline) {
+        return fib_pipeline_run(config, stdin, output_path);
+    }
+    if (config->watch || config->fit || config->shm_name) {
+        return fib_live_run(input_path, config, output_path);
+    }
+    if (fib_apng_probe(input_path)) {
+        if (config->poster || config->shard_count > 0 || config->write_tones_path) {
+            fprintf(stderr, "error: --poster and --shard render still images only\n");
             return 1;
         }
+        return fib_anim_run(input_path, config, output_path);
+    }
+    if (config->shard_count > 0 || config->write_tones_path) {
+        return fib_shard_run(input_path, config, output_path);
+    }
+    /* one context from decode to draw, so tables built during the decode are reused */
+    fib_render_context_init(&context);
+    if (!fib_load_planned_image(input_path, config, &image, &runtime_config, &context, NULL, NULL)) {
+        fib_render_context_free(&context);
+        return 1;
+    }
+    if (config->poster) {
+        return finish_still(&context, &image, config, render_poster(&context, &image, &runtime_config, output_path));
     }
 
-    runtime_config.enable_color = should_enable_color(runtime_config.color_mode, output_path != NULL, output);
-
-    fib_render_ascii(&image, &runtime_config, output);
+    runtime_config.enable_color = fib_should_enable_color(runtime_config.color_mode, output_path != NULL);
+    if (!output_path) {
+        return finish_still(&context, &image, config, render_to_descriptor(&context, &image, &runtime_config, STDOUT_FILENO));
+    }
 
-    if (output_path) {
-        fclose(output);
-        printf("ascii art saved to: %s\n", output_path);
+    FILE *output = fib_open_output(output_path, config);
+    if (!output) {
+        return finish_still(&context, &image, config, 0);
     }
 
-    fib_image_free(&image);
-    return 0;
+    fib_render_context_draw(&context, &image, &runtime_config, output);
+
+    fclose(output);
+    printf(config->format == FIB_FORMAT_GRID ? "grid frame appended to: %s\n" : "ascii art saved to: %s\n", output_path);
+
+    return finish_still(&context, &image, config, 1);
 }
@@ -1,8 +1,19 @@
 #ifndef FIB_H
 #define FIB_H
 
+#include "fib_plan.h"
 #include "fib_render.h"
 
+/*
+ * Probes, plans and decodes input_path. With a context, the analysis of the decoded image
+ * is built alongside the decode when fib_render_context_overlap allows it. planned_info
+ * and plan_out, when given, receive the input (or preview grid) the plan was made for and
+ * the plan itself, so a caller whose output size changes can test it with fib_plan_holds.
+ */
+int fib_load_planned_image(const char *input_path, const FibRenderConfig *config, FibImage *image, FibRenderConfig *runtime_config,
+                           FibRenderContext *context, FibImageInfo *planned_info, FibPlan *plan_out);
+int fib_should_enable_color(FibColorMode mode, int has_output_path);
+FILE *fib_open_output(const char *output_path, const FibRenderConfig *config);
 int fib_run(const char *input_path, const FibRenderConfig *config, const char *output_path);
 void fib_print_usage(const char *program_name);
 
@@ -0,0 +1,745 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fib_analysis.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fib_memory.h"
+
+#define FIB_MAX_THREADS 64
+#define FIB_MIN_PIXELS_PER_THREAD (256U * 256U)
+
+/* smallest strip worth its own thread; fib --autotune may replace the default */
+static uint64_t g_strip_pixels = FIB_MIN_PIXELS_PER_THREAD;
+
+/* pixels the decoder finishes before it wakes the stream worker */
+#define FIB_STREAM_BATCH_PIXELS (64U * 1024U)
+
+typedef struct {
+    const FibImage *image;
+    FibAnalysis *analysis;
+    int row_begin;
+    int row_end;
+    uint32_t histogram[256];
+} FibAnalysisStrip;
+
+/*
+ * The decoder is the only writer of rows_published and the worker the only reader, so a
+ * release store and an acquire load hand each batch of finished rows across; ready only
+ * wakes the worker.
+ */
+struct FibAnalysisStream {
+    FibAnalysis *analysis;
+    const FibImage *image;
+    pthread_t thread;
+    sem_t ready;
+    atomic_int rows_published;
+    atomic_int closed;
+    int rows_posted;
+    int batch_rows;
+    int rows_analyzed;
+};
+
+typedef struct {
+    const FibImage *image;
+    FibImage *reduced;
+    int factor;
+    int histogram_stride;
+    int row_begin;
+    int row_end;
+    uint64_t *accumulator;
+    uint32_t histogram[256];
+} FibReduceStrip;
+
+static int safe_multiply_size(size_t a, size_t b, size_t *out) {
+    if (a != 0 && b > SIZE_MAX / a) {
+        return 0;
+    }
+    *out = a * b;
+    return 1;
+}
+
+int fib_resolve_thread_count(int requested) {
+    if (requested > 0) {
+        return requested > FIB_MAX_THREADS ? FIB_MAX_THREADS : requested;
+    }
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online < 1) {
+        return 1;
+    }
+    return online > FIB_MAX_THREADS ? FIB_MAX_THREADS : (int)online;
+}
+
+void fib_analysis_set_strip_pixels(size_t pixels) {
+    g_strip_pixels = pixels > 0 ? (uint64_t)pixels : FIB_MIN_PIXELS_PER_THREAD;
+}
+
+const char *fib_sat_layout_name(FibSatLayout layout) {
+    switch (layout) {
+        case FIB_SAT_WIDE:
+            return "wide";
+        case FIB_SAT_COMPACT:
+            return "compact";
+        case FIB_SAT_BANDED:
+            return "banded";
+        case FIB_SAT_AUTO:
+        default:
+            return "auto";
+    }
+}
+
+static int max_cell_extent(int image_extent, int output_extent) {
+    if (output_extent <= 0) {
+        return image_extent;
+    }
+    /* float cell edges can land one pixel past ceil(scale) */
+    return image_extent / output_extent + 2;
+}
+
+uint64_t fib_analysis_max_box_area(int image_width, int image_height, int output_width, int output_height) {
+    uint64_t box_width = (uint64_t)max_cell_extent(image_width, output_width) * 4U + 1U;
+    uint64_t box_height = (uint64_t)max_cell_extent(image_height, output_height) * 4U + 1U;
+
+    if (box_width > (uint64_t)image_width) {
+        box_width = (uint64_t)image_width;
+    }
+    if (box_height > (uint64_t)image_height) {
+        box_height = (uint64_t)image_height;
+    }
+    return box_width * box_height;
+}
+
+int fib_analysis_compact_fits(int image_width, int image_height, int output_width, int output_height) {
+    uint64_t area = fib_analysis_max_box_area(image_width, image_height, output_width, output_height);
+    return area * 255U * 255U <= (uint64_t)UINT32_MAX;
+}
+
+size_t fib_analysis_band_rows(int image_height, int output_height) {
+    size_t rows = (size_t)max_cell_extent(image_height, output_height) * 6U + 16U;
+    if (rows > (size_t)image_height + 1U) {
+        rows = (size_t)image_height + 1U;
+    }
+    return rows;
+}
+
+size_t fib_analysis_table_bytes(int image_width, int image_height, FibSatLayout layout, size_t ring_rows) {
+    size_t stride = (size_t)image_width + 1U;
+    size_t rows = (layout == FIB_SAT_BANDED) ? ring_rows : (size_t)image_height + 1U;
+    size_t element = (layout == FIB_SAT_COMPACT) ? sizeof(uint32_t) : sizeof(uint64_t);
+    size_t cells = 0;
+
+    if (!safe_multiply_size(stride, rows, &cells) || !safe_multiply_size(cells, element * 2U, &cells)) {
+        return SIZE_MAX;
+    }
+    return cells;
+}
+
+void fib_analysis_free(FibAnalysis *analysis) {
+    fib_memory_free(analysis->sum_area);
+    fib_memory_free(analysis->sum_square);
+    fib_memory_free(analysis->compact_sum);
+    fib_memory_free(analysis->compact_square);
+    analysis->sum_area = NULL;
+    analysis->sum_square = NULL;
+    analysis->compact_sum = NULL;
+    analysis->compact_square = NULL;
+    analysis->layout = FIB_SAT_AUTO;
+    analysis->stride = 0;
+    analysis->table_rows = 0;
+    analysis->ring_rows = 0;
+}
+
+int fib_analysis_has_tables(const FibAnalysis *analysis) {
+    return analysis->sum_area != NULL || analysis->compact_sum != NULL;
+}
+
+static void histogram_row(const unsigned char *source, int width, uint32_t histogram[256]) {
+    for (int x = 0; x < width; x++) {
+        histogram[source[x]]++;
+    }
+}
+
+static void wide_row(const unsigned char *source, int width, const uint64_t *previous_sum, const uint64_t *previous_square,
+                     uint64_t *current_sum, uint64_t *current_square, uint32_t *histogram) {
+    uint64_t row_sum = 0;
+    uint64_t row_square_sum = 0;
+
+    current_sum[0] = 0;
+    current_square[0] = 0;
+    if (!previous_sum) {
+        for (int x = 1; x <= width; x++) {
+            uint64_t value = source[x - 1];
+            histogram[value]++;
+            row_sum += value;
+            row_square_sum += value * value;
+            current_sum[x] = row_sum;
+            current_square[x] = row_square_sum;
+        }
+        return;
+    }
+
+    for (int x = 1; x <= width; x++) {
+        uint64_t value = source[x - 1];
+        histogram[value]++;
+        row_sum += value;
+        row_square_sum += value * value;
+        current_sum[x] = previous_sum[x] + row_sum;
+        current_square[x] = previous_square[x] + row_square_sum;
+    }
+}
+
+static void compact_row(const unsigned char *source, int width, const uint32_t *previous_sum, const uint32_t *previous_square,
+                        uint32_t *current_sum, uint32_t *current_square, uint32_t *histogram) {
+    uint32_t row_sum = 0;
+    uint32_t row_square_sum = 0;
+
+    current_sum[0] = 0;
+    current_square[0] = 0;
+    if (!previous_sum) {
+        for (int x = 1; x <= width; x++) {
+            uint32_t value = source[x - 1];
+            histogram[value]++;
+            row_sum += value;
+            row_square_sum += value * value;
+            current_sum[x] = row_sum;
+            current_square[x] = row_square_sum;
+        }
+        return;
+    }
+
+    for (int x = 1; x <= width; x++) {
+        uint32_t value = source[x - 1];
+        histogram[value]++;
+        row_sum += value;
+        row_square_sum += value * value;
+        current_sum[x] = previous_sum[x] + row_sum;
+        current_square[x] = previous_square[x] + row_square_sum;
+    }
+}
+
+/*
+ * Pass 1 of the fused sweep: every source row is read exactly once and feeds the
+ * strip's sub-histogram plus both summed-area tables. Vertical accumulation starts
+ * from zero at the strip's first row; the carry from earlier strips is added later.
+ */
+static void *analyze_strip_local(void *argument) {
+    FibAnalysisStrip *strip = (FibAnalysisStrip *)argument;
+    const FibImage *image = strip->image;
+    FibAnalysis *analysis = strip->analysis;
+    size_t stride = analysis->stride;
+
+    for (int y = strip->row_begin; y < strip->row_end; y++) {
+        const unsigned char *source = image->pixels + (size_t)y * (size_t)image->width;
+        size_t row = (size_t)(y + 1) * stride;
+        int first_row = (y == strip->row_begin);
+
+        if (analysis->layout == FIB_SAT_BANDED) {
+            histogram_row(source, image->width, strip->histogram);
+        } else if (analysis->sum_area) {
+            wide_row(source, image->width, first_row ? NULL : analysis->sum_area + row - stride,
+                     first_row ? NULL : analysis->sum_square + row - stride, analysis->sum_area + row,
+                     analysis->sum_square + row, strip->histogram);
+        } else if (analysis->compact_sum) {
+            compact_row(source, image->width, first_row ? NULL : analysis->compact_sum + row - stride,
+                        first_row ? NULL : analysis->compact_square + row - stride, analysis->compact_sum + row,
+                        analysis->compact_square + row, strip->histogram);
+        } else {
+            histogram_row(source, image->width, strip->histogram);
+        }
+    }
+    return NULL;
+}
+
+static void add_carry_row(FibAnalysis *analysis, size_t carry_row, size_t target_row) {
+    size_t stride = analysis->stride;
+
+    if (analysis->sum_area) {
+        const uint64_t *carry_sum = analysis->sum_area + carry_row * stride;
+        const uint64_t *carry_square = analysis->sum_square + carry_row * stride;
+        uint64_t *current_sum = analysis->sum_area + target_row * stride;
+        uint64_t *current_square = analysis->sum_square + target_row * stride;
+        for (size_t x = 1; x < stride; x++) {
+            current_sum[x] += carry_sum[x];
+            current_square[x] += carry_square[x];
+        }
+    } else {
+        const uint32_t *carry_sum = analysis->compact_sum + carry_row * stride;
+        const uint32_t *carry_square = analysis->compact_square + carry_row * stride;
+        uint32_t *current_sum = analysis->compact_sum + target_row * stride;
+        uint32_t *current_square = analysis->compact_square + target_row * stride;
+        for (size_t x = 1; x < stride; x++) {
+            current_sum[x] += carry_sum[x];
+            current_square[x] += carry_square[x];
+        }
+    }
+}
+
+/* Pass 2: add the finished last row of the previous strip to every row but our last. */
+static void *apply_strip_carry(void *argument) {
+    FibAnalysisStrip *strip = (FibAnalysisStrip *)argument;
+
+    for (int y = strip->row_begin + 1; y < strip->row_end; y++) {
+        add_carry_row(strip->analysis, (size_t)strip->row_begin, (size_t)y);
+    }
+    return NULL;
+}
+
+/* Runs work over an array of strip_size-byte strips, one thread per strip, strip 0 inline. */
+static void run_strips(void *strips, size_t strip_size, int strip_count, void *(*work)(void *), int skip_first) {
+    pthread_t threads[FIB_MAX_THREADS];
+    int started[FIB_MAX_THREADS] = {0};
+    char *base = (char *)strips;
+
+    for (int i = skip_first ? 2 : 1; i < strip_count; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, work, base + (size_t)i * strip_size) == 0);
+        if (!started[i]) {
+            work(base + (size_t)i * strip_size);
+        }
+    }
+    if (!skip_first) {
+        work(base);
+    } else if (strip_count > 1) {
+        work(base + strip_size);
+    }
+    for (int i = 1; i < strip_count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+static int tables_match(const FibAnalysis *analysis, size_t stride, size_t rows, FibSatLayout layout) {
+    if (!fib_analysis_has_tables(analysis) || analysis->layout != layout || analysis->stride != stride) {
+        return 0;
+    }
+    if (layout == FIB_SAT_BANDED) {
+        return analysis->ring_rows == rows;
+    }
+    return analysis->table_rows == rows;
+}
+
+static int allocate_tables(FibAnalysis *analysis, const FibImage *image, FibSatLayout layout, size_t ring_rows) {
+    size_t stride = (size_t)image->width + 1U;
+    size_t rows = (layout == FIB_SAT_BANDED) ? ring_rows : (size_t)image->height + 1U;
+    size_t cell_count = 0;
+
+    if (tables_match(analysis, stride, rows, layout)) {
+        if (layout == FIB_SAT_BANDED) {
+            memset(analysis->sum_area, 0, stride * sizeof(uint64_t));
+            memset(analysis->sum_square, 0, stride * sizeof(uint64_t));
+        }
+        return 1;
+    }
+    fib_analysis_free(analysis);
+
+    if (rows == 0 || !safe_multiply_size(stride, rows, &cell_count) || cell_count > SIZE_MAX / sizeof(uint64_t)) {
+        return 0;
+    }
+
+    if (layout == FIB_SAT_COMPACT) {
+        analysis->compact_sum = (uint32_t *)fib_memory_alloc(cell_count * sizeof(uint32_t));
+        analysis->compact_square = (uint32_t *)fib_memory_alloc(cell_count * sizeof(uint32_t));
+        if (!analysis->compact_sum || !analysis->compact_square) {
+            fib_analysis_free(analysis);
+            return 0;
+        }
+        memset(analysis->compact_sum, 0, stride * sizeof(uint32_t));
+        memset(analysis->compact_square, 0, stride * sizeof(uint32_t));
+    } else {
+        analysis->sum_area = (uint64_t *)fib_memory_alloc(cell_count * sizeof(uint64_t));
+        analysis->sum_square = (uint64_t *)fib_memory_alloc(cell_count * sizeof(uint64_t));
+        if (!analysis->sum_area || !analysis->sum_square) {
+            fib_analysis_free(analysis);
+            return 0;
+        }
+        memset(analysis->sum_area, 0, stride * sizeof(uint64_t));
+        memset(analysis->sum_square, 0, stride * sizeof(uint64_t));
+    }
+
+    analysis->layout = layout;
+    analysis->stride = stride;
+    analysis->table_rows = rows;
+    analysis->ring_rows = (layout == FIB_SAT_BANDED) ? ring_rows : 0;
+    return 1;
+}
+
+/*
+ * Box-averages factor x factor blocks of reduced output rows [row_begin, row_end), rounding
+ * like the decode-time downscaler, and histograms every histogram_stride-th pixel of every
+ * histogram_stride-th source row on the way through.
+ */
+static void *reduce_strip(void *argument) {
+    FibReduceStrip *strip = (FibReduceStrip *)argument;
+    const FibImage *image = strip->image;
+    FibImage *reduced = strip->reduced;
+    int factor = strip->factor;
+    int stride = strip->histogram_stride;
+
+    for (int output_row = strip->row_begin; output_row < strip->row_end; output_row++) {
+        int source_begin = output_row * factor;
+        int source_end = source_begin + factor < image->height ? source_begin + factor : image->height;
+
+        memset(strip->accumulator, 0, (size_t)reduced->width * sizeof(uint64_t));
+        for (int y = source_begin; y < source_end; y++) {
+            const unsigned char *source = image->pixels + (size_t)y * (size_t)image->width;
+            for (int block = 0, x = 0; x < image->width; block++) {
+                int block_end = x + factor < image->width ? x + factor : image->width;
+                uint32_t sum = 0;
+                for (; x < block_end; x++) {
+                    sum += source[x];
+                }
+                strip->accumulator[block] += sum;
+            }
+            if (stride > 0 && y % stride == 0) {
+                for (int x = 0; x < image->width; x += stride) {
+                    strip->histogram[source[x]]++;
+                }
+            }
+        }
+
+        unsigned char *destination = reduced->pixels + (size_t)output_row * (size_t)reduced->width;
+        uint64_t block_rows = (uint64_t)(source_end - source_begin);
+        for (int block = 0; block < reduced->width; block++) {
+            int block_columns = image->width - block * factor;
+            uint64_t count = block_rows * (uint64_t)(block_columns < factor ? block_columns : factor);
+            destination[block] = (unsigned char)((strip->accumulator[block] + count / 2U) / count);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * One threaded sweep over the full-resolution image that produces the reduced grid used
+ * by the faster quality tiers plus a histogram of a strided sample (histogram_stride 1
+ * samples every pixel). The reduced image keeps its buffer when the size is unchanged.
+ */
+int fib_analysis_reduce(const FibImage *image, int factor, int histogram_stride, int thread_count, FibImage *reduced,
+                        uint32_t histogram[256], uint64_t *sample_count) {
+    FibReduceStrip strips[FIB_MAX_THREADS];
+    int reduced_width = image->width / factor + (image->width % factor != 0);
+    int reduced_height = image->height / factor + (image->height % factor != 0);
+    int strip_count = fib_resolve_thread_count(thread_count);
+
+    if (!fib_image_allocate(reduced, reduced_width, reduced_height)) {
+        return 0;
+    }
+    if ((uint64_t)strip_count * g_strip_pixels > (uint64_t)image->width * (uint64_t)image->height) {
+        strip_count = (int)(((uint64_t)image->width * (uint64_t)image->height) / g_strip_pixels);
+    }
+    if (strip_count > reduced_height) {
+        strip_count = reduced_height;
+    }
+    if (strip_count < 1) {
+        strip_count = 1;
+    }
+
+    /* a block of factor^2 pixels sums past 2^32 once factor exceeds 4104 */
+    uint64_t *accumulators = (uint64_t *)calloc((size_t)strip_count * (size_t)reduced_width, sizeof(uint64_t));
+    if (!accumulators) {
+        return 0;
+    }
+    for (int i = 0; i < strip_count; i++) {
+        strips[i].image = image;
+        strips[i].reduced = reduced;
+        strips[i].factor = factor;
+        strips[i].histogram_stride = histogram_stride;
+        strips[i].row_begin = (int)(((int64_t)reduced_height * i) / strip_count);
+        strips[i].row_end = (int)(((int64_t)reduced_height * (i + 1)) / strip_count);
+        strips[i].accumulator = accumulators + (size_t)i * (size_t)reduced_width;
+        memset(strips[i].histogram, 0, sizeof(strips[i].histogram));
+    }
+
+    run_strips(strips, sizeof(strips[0]), strip_count, reduce_strip, 0);
+    free(accumulators);
+
+    memset(histogram, 0, 256 * sizeof(uint32_t));
+    *sample_count = 0;
+    for (int i = 0; i < strip_count; i++) {
+        for (int value = 0; value < 256; value++) {
+            histogram[value] += strips[i].histogram[value];
+            *sample_count += strips[i].histogram[value];
+        }
+    }
+    return 1;
+}
+
+/*
+ * The histogram fib_analysis_reduce or fib_analysis_refresh would keep for the tone
+ * curve, without building anything: every stride-th pixel of every stride-th row.
+ */
+void fib_analysis_histogram(const FibImage *image, int stride, uint32_t histogram[256], uint64_t *sample_count) {
+    memset(histogram, 0, 256 * sizeof(uint32_t));
+    *sample_count = 0;
+    for (int y = 0; y < image->height; y += stride) {
+        const unsigned char *source = image->pixels + (size_t)y * (size_t)image->width;
+        for (int x = 0; x < image->width; x += stride) {
+            histogram[source[x]]++;
+        }
+        *sample_count += (uint64_t)((image->width + stride - 1) / stride);
+    }
+}
+
+int fib_analysis_build(const FibImage *image, FibSatLayout layout, size_t ring_rows, int thread_count, FibAnalysis *analysis) {
+    memset(analysis, 0, sizeof(*analysis));
+    return fib_analysis_refresh(image, layout, ring_rows, thread_count, analysis);
+}
+
+int fib_analysis_refresh(const FibImage *image, FibSatLayout layout, size_t ring_rows, int thread_count, FibAnalysis *analysis) {
+    FibAnalysisStrip strips[FIB_MAX_THREADS];
+    int strip_count = fib_resolve_thread_count(thread_count);
+
+    analysis->pixel_count = (uint64_t)image->width * (uint64_t)image->height;
+    analysis->rows_ready = 0;
+    memset(analysis->histogram, 0, sizeof(analysis->histogram));
+
+    if (layout == FIB_SAT_AUTO) {
+        layout = FIB_SAT_WIDE;
+    }
+    if (layout == FIB_SAT_BANDED && ring_rows >= (size_t)image->height + 1U) {
+        layout = FIB_SAT_WIDE;
+    }
+    allocate_tables(analysis, image, layout, ring_rows);
+
+    if ((uint64_t)strip_count * g_strip_pixels > analysis->pixel_count) {
+        strip_count = (int)(analysis->pixel_count / g_strip_pixels);
+    }
+    if (strip_count > image->height) {
+        strip_count = image->height;
+    }
+    if (strip_count < 1) {
+        strip_count = 1;
+    }
+
+    for (int i = 0; i < strip_count; i++) {
+        strips[i].image = image;
+        strips[i].analysis = analysis;
+        strips[i].row_begin = (int)(((int64_t)image->height * i) / strip_count);
+        strips[i].row_end = (int)(((int64_t)image->height * (i + 1)) / strip_count);
+        memset(strips[i].histogram, 0, sizeof(strips[i].histogram));
+    }
+
+    run_strips(strips, sizeof(strips[0]), strip_count, analyze_strip_local, 0);
+
+    for (int i = 0; i < strip_count; i++) {
+        for (int value = 0; value < 256; value++) {
+            analysis->histogram[value] += strips[i].histogram[value];
+        }
+    }
+
+    if (!fib_analysis_has_tables(analysis)) {
+        return 0;
+    }
+    /* Banded tables are filled lazily by fib_analysis_advance; only the histogram is needed up front. */
+    if (analysis->layout == FIB_SAT_BANDED) {
+        return 1;
+    }
+
+    /*
+     * Serial carry chain over strip boundaries: finish the last row of each strip so the
+     * next strip can use it as its carry. Only strip_count rows are touched here.
+     */
+    for (int i = 1; i < strip_count; i++) {
+        add_carry_row(analysis, (size_t)strips[i].row_begin, (size_t)strips[i].row_end);
+    }
+
+    /* SAT row r covers source rows [0, r), so strip i owns table rows (row_begin, row_end]. */
+    run_strips(strips, sizeof(strips[0]), strip_count, apply_strip_carry, 1);
+    return 1;
+}
+
+static void *stream_worker(void *argument) {
+    FibAnalysisStream *stream = (FibAnalysisStream *)argument;
+    FibAnalysis *analysis = stream->analysis;
+    const FibImage *image = stream->image;
+    size_t stride = analysis->stride;
+
+    while (stream->rows_analyzed < image->height) {
+        while (sem_wait(&stream->ready) != 0 && errno == EINTR) {
+        }
+        /* closed is stored after the last publish, so reading it first sees every row */
+        int closed = atomic_load_explicit(&stream->closed, memory_order_acquire);
+        int row_end = atomic_load_explicit(&stream->rows_published, memory_order_acquire);
+
+        for (int y = stream->rows_analyzed; y < row_end; y++) {
+            const unsigned char *source = image->pixels + (size_t)y * (size_t)image->width;
+            size_t row = (size_t)(y + 1) * stride;
+            if (analysis->sum_area) {
+                wide_row(source, image->width, y == 0 ? NULL : analysis->sum_area + row - stride,
+                         y == 0 ? NULL : analysis->sum_square + row - stride, analysis->sum_area + row,
+                         analysis->sum_square + row, analysis->histogram);
+            } else {
+                compact_row(source, image->width, y == 0 ? NULL : analysis->compact_sum + row - stride,
+                            y == 0 ? NULL : analysis->compact_square + row - stride, analysis->compact_sum + row,
+                            analysis->compact_square + row, analysis->histogram);
+            }
+        }
+        stream->rows_analyzed = row_end;
+        if (closed) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+FibAnalysisStream *fib_analysis_stream_start(FibAnalysis *analysis, const FibImage *image, FibSatLayout layout) {
+    FibAnalysisStream *stream = NULL;
+
+    if (layout != FIB_SAT_WIDE && layout != FIB_SAT_COMPACT) {
+        return NULL;
+    }
+    analysis->pixel_count = (uint64_t)image->width * (uint64_t)image->height;
+    analysis->rows_ready = 0;
+    memset(analysis->histogram, 0, sizeof(analysis->histogram));
+    if (!allocate_tables(analysis, image, layout, 0)) {
+        return NULL;
+    }
+
+    stream = (FibAnalysisStream *)calloc(1, sizeof(*stream));
+    if (!stream) {
+        return NULL;
+    }
+    stream->analysis = analysis;
+    stream->image = image;
+    stream->batch_rows = (int)(FIB_STREAM_BATCH_PIXELS / (unsigned)image->width);
+    if (stream->batch_rows < 1) {
+        stream->batch_rows = 1;
+    }
+    atomic_init(&stream->rows_published, 0);
+    atomic_init(&stream->closed, 0);
+    if (sem_init(&stream->ready, 0, 0) != 0) {
+        free(stream);
+        return NULL;
+    }
+    if (pthread_create(&stream->thread, NULL, stream_worker, stream) != 0) {
+        sem_destroy(&stream->ready);
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+void fib_analysis_stream_rows(FibAnalysisStream *stream, int row_end) {
+    if (row_end - stream->rows_posted < stream->batch_rows && row_end < stream->image->height) {
+        return;
+    }
+    atomic_store_explicit(&stream->rows_published, row_end, memory_order_release);
+    stream->rows_posted = row_end;
+    sem_post(&stream->ready);
+}
+
+int fib_analysis_stream_finish(FibAnalysisStream *stream) {
+    atomic_store_explicit(&stream->closed, 1, memory_order_release);
+    sem_post(&stream->ready);
+    pthread_join(stream->thread, NULL);
+
+    int complete = stream->rows_analyzed == stream->image->height;
+    sem_destroy(&stream->ready);
+    free(stream);
+    return complete;
+}
+
+void fib_analysis_advance(FibAnalysis *analysis, const FibImage *image, int table_row_end) {
+    if (analysis->layout != FIB_SAT_BANDED || !analysis->sum_area) {
+        return;
+    }
+    if (table_row_end > image->height) {
+        table_row_end = image->height;
+    }
+
+    size_t stride = analysis->stride;
+    uint32_t discarded_histogram[256] = {0};
+    while (analysis->rows_ready < table_row_end) {
+        int row = analysis->rows_ready + 1;
+        size_t previous = ((size_t)(row - 1) % analysis->ring_rows) * stride;
+        size_t current = ((size_t)row % analysis->ring_rows) * stride;
+
+        wide_row(image->pixels + (size_t)(row - 1) * (size_t)image->width, image->width, analysis->sum_area + previous,
+                 analysis->sum_square + previous, analysis->sum_area + current, analysis->sum_square + current, discarded_histogram);
+        analysis->rows_ready = row;
+    }
+}
+
+/*
+ * Re-derives the table entries that depend on pixels at or right of x0 and at or below
+ * y0 after those pixels changed in place: the block [x0, width) x [y0, height) of a wide
+ * or compact table. Entries left of x0 give each row's running sum up to x0. The
+ * histogram is the caller's to update.
+ */
+void fib_analysis_update(FibAnalysis *analysis, const FibImage *image, int x0, int y0) {
+    size_t stride = analysis->stride;
+
+    if (analysis->layout == FIB_SAT_BANDED || !fib_analysis_has_tables(analysis)) {
+        return;
+    }
+    for (int y = y0; y < image->height; y++) {
+        const unsigned char *source = image->pixels + (size_t)y * (size_t)image->width;
+        size_t previous = (size_t)y * stride;
+        size_t current = (size_t)(y + 1) * stride;
+
+        if (analysis->compact_sum) {
+            uint32_t *sum = analysis->compact_sum;
+            uint32_t *square = analysis->compact_square;
+            uint32_t row_sum = sum[current + (size_t)x0] - sum[previous + (size_t)x0];
+            uint32_t row_square_sum = square[current + (size_t)x0] - square[previous + (size_t)x0];
+            for (int x = x0; x < image->width; x++) {
+                uint32_t value = source[x];
+                row_sum += value;
+                row_square_sum += value * value;
+                sum[current + (size_t)x + 1U] = sum[previous + (size_t)x + 1U] + row_sum;
+                square[current + (size_t)x + 1U] = square[previous + (size_t)x + 1U] + row_square_sum;
+            }
+        } else {
+            uint64_t *sum = analysis->sum_area;
+            uint64_t *square = analysis->sum_square;
+            uint64_t row_sum = sum[current + (size_t)x0] - sum[previous + (size_t)x0];
+            uint64_t row_square_sum = square[current + (size_t)x0] - square[previous + (size_t)x0];
+            for (int x = x0; x < image->width; x++) {
+                uint64_t value = source[x];
+                row_sum += value;
+                row_square_sum += value * value;
+                sum[current + (size_t)x + 1U] = sum[previous + (size_t)x + 1U] + row_sum;
+                square[current + (size_t)x + 1U] = square[previous + (size_t)x + 1U] + row_square_sum;
+            }
+        }
+    }
+}
+
+static uint64_t wide_block(const uint64_t *table, size_t stride, size_t row0, size_t row1, size_t x0, size_t x1) {
+    return table[row1 * stride + x1] - table[row0 * stride + x1] - table[row1 * stride + x0] + table[row0 * stride + x0];
+}
+
+static uint64_t compact_block(const uint32_t *table, size_t stride, size_t row0, size_t row1, size_t x0, size_t x1) {
+    uint32_t block = table[row1 * stride + x1] - table[row0 * stride + x1] - table[row1 * stride + x0] + table[row0 * stride + x0];
+    return (uint64_t)block;
+}
+
+static uint64_t analysis_block(const FibAnalysis *analysis, int square, int x0, int y0, int x1, int y1) {
+    size_t row0 = (size_t)y0;
+    size_t row1 = (size_t)y1;
+
+    if (analysis->ring_rows) {
+        row0 %= analysis->ring_rows;
+        row1 %= analysis->ring_rows;
+    }
+    if (analysis->compact_sum) {
+        return compact_block(square ? analysis->compact_square : analysis->compact_sum, analysis->stride, row0, row1,
+                             (size_t)x0, (size_t)x1);
+    }
+    return wide_block(square ? analysis->sum_square : analysis->sum_area, analysis->stride, row0, row1, (size_t)x0,
+                      (size_t)x1);
+}
+
+uint64_t fib_analysis_block_sum(const FibAnalysis *analysis, int x0, int y0, int x1, int y1) {
+    return analysis_block(analysis, 0, x0, y0, x1, y1);
+}
+
+uint64_t fib_analysis_block_square(const FibAnalysis *analysis, int x0, int y0, int x1, int y1) {
+    return analysis_block(analysis, 1, x0, y0, x1, y1);
+}
@@ -0,0 +1,76 @@
+#ifndef FIB_ANALYSIS_H
+#define FIB_ANALYSIS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fib_image.h"
+
+typedef enum {
+    FIB_SAT_AUTO = 0,
+    FIB_SAT_WIDE,
+    FIB_SAT_COMPACT,
+    FIB_SAT_BANDED
+} FibSatLayout;
+
+/*
+ * Summed-area tables over the gray image plus its histogram.
+ *
+ * FIB_SAT_WIDE stores exact 64-bit prefix sums. FIB_SAT_COMPACT stores them modulo 2^32,
+ * which still yields exact box sums as long as every queried box sums to less than 2^32
+ * (see fib_analysis_compact_fits). FIB_SAT_BANDED keeps only a ring of ring_rows wide rows
+ * that the caller advances top to bottom with fib_analysis_advance.
+ *
+ * fib_analysis_refresh rebuilds a previously built analysis in place and keeps the table
+ * allocations when the image shape and layout are unchanged.
+ */
+typedef struct {
+    FibSatLayout layout;
+    size_t stride;
+    size_t table_rows;
+    size_t ring_rows;
+    int rows_ready;
+    uint64_t *sum_area;
+    uint64_t *sum_square;
+    uint32_t *compact_sum;
+    uint32_t *compact_square;
+    uint32_t histogram[256];
+    uint64_t pixel_count;
+} FibAnalysis;
+
+/*
+ * Streaming build of a wide or compact analysis while the image is still being decoded:
+ * fib_analysis_stream_start sets up the tables for image's shape and starts one worker
+ * that runs the same row kernel as fib_analysis_refresh down the image as
+ * fib_analysis_stream_rows reports rows finished. fib_analysis_stream_finish joins the
+ * worker and returns 1 when every row was analyzed; the tables then match a refresh bit
+ * for bit. The caller must not touch the analysis between start and finish.
+ */
+typedef struct FibAnalysisStream FibAnalysisStream;
+
+FibAnalysisStream *fib_analysis_stream_start(FibAnalysis *analysis, const FibImage *image, FibSatLayout layout);
+void fib_analysis_stream_rows(FibAnalysisStream *stream, int row_end);
+int fib_analysis_stream_finish(FibAnalysisStream *stream);
+
+int fib_analysis_build(const FibImage *image, FibSatLayout layout, size_t ring_rows, int thread_count, FibAnalysis *analysis);
+int fib_analysis_refresh(const FibImage *image, FibSatLayout layout, size_t ring_rows, int thread_count, FibAnalysis *analysis);
+void fib_analysis_free(FibAnalysis *analysis);
+int fib_analysis_has_tables(const FibAnalysis *analysis);
+void fib_analysis_advance(FibAnalysis *analysis, const FibImage *image, int table_row_end);
+void fib_analysis_update(FibAnalysis *analysis, const FibImage *image, int x0, int y0);
+uint64_t fib_analysis_block_sum(const FibAnalysis *analysis, int x0, int y0, int x1, int y1);
+uint64_t fib_analysis_block_square(const FibAnalysis *analysis, int x0, int y0, int x1, int y1);
+
+int fib_analysis_reduce(const FibImage *image, int factor, int histogram_stride, int thread_count, FibImage *reduced,
+                        uint32_t histogram[256], uint64_t *sample_count);
+void fib_analysis_histogram(const FibImage *image, int stride, uint32_t histogram[256], uint64_t *sample_count);
+
+uint64_t fib_analysis_max_box_area(int image_width, int image_height, int output_width, int output_height);
+int fib_analysis_compact_fits(int image_width, int image_height, int output_width, int output_height);
+size_t fib_analysis_band_rows(int image_height, int output_height);
+size_t fib_analysis_table_bytes(int image_width, int image_height, FibSatLayout layout, size_t ring_rows);
+const char *fib_sat_layout_name(FibSatLayout layout);
+int fib_resolve_thread_count(int requested);
+void fib_analysis_set_strip_pixels(size_t pixels);
+
+#endif
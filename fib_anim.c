@@ -0,0 +1,427 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fib_anim.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fib.h"
+#include "fib_apng.h"
+#include "fib_plan.h"
+
+#define FIB_ANIM_MAX_WORKERS 64
+#define FIB_ANIM_STREAM_BUFFER_SIZE ((size_t)1 << 20)
+
+static volatile sig_atomic_t g_stop_requested = 0;
+static char g_stream_buffer[FIB_ANIM_STREAM_BUFFER_SIZE];
+
+typedef struct {
+    char *bytes;
+    size_t size;
+} FibAnimFrame;
+
+/* One pre-render slot: a composited gray canvas and the render state that draws it. */
+typedef struct {
+    FibRenderContext context;
+    const FibRenderConfig *config;
+    FibImage image;
+    FibAnimFrame rendered;
+    int ok;
+} FibAnimWorker;
+
+/*
+ * Frames [0, cached_count) of the first cycle stay rendered in cache. resume holds the
+ * compositor right before frame cached_count, so later cycles replay the cache and then
+ * composite and render the remaining frames on demand from there.
+ */
+typedef struct {
+    const FibRenderConfig *config;
+    FibRenderConfig runtime_config;
+    FibRenderConfig worker_config;
+    FibApng apng;
+    FibApngCursor cursor;
+    FibApngCursor batch_start;
+    FibApngCursor resume;
+    FibAnimWorker *workers;
+    int worker_count;
+    FibRenderContext context;
+    FibImage image;
+    FibAnimFrame *cache;
+    int caching;
+    int cache_closed;
+    int cached_count;
+    size_t cached_bytes;
+    FILE *output;
+    int play_in_place;
+    int frames_shown;
+    struct timespec deadline;
+} FibAnimSession;
+
+static void request_stop(int signal_number) {
+    (void)signal_number;
+    g_stop_requested = 1;
+}
+
+static void install_handler(int signal_number, void (*handler)(int)) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(signal_number, &action, NULL);
+}
+
+static void free_frame(FibAnimFrame *frame) {
+    free(frame->bytes);
+    frame->bytes = NULL;
+    frame->size = 0;
+}
+
+/* Rows are drawn straight into a frame buffer sized for the worst case, then trimmed. */
+static int render_to_memory(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config, FibAnimFrame *frame) {
+    size_t capacity = fib_render_frame_bytes(config);
+    FibSink sink;
+
+    frame->bytes = (char *)malloc(capacity);
+    if (!frame->bytes) {
+        fprintf(stderr, "error: out of memory for rendered frame\n");
+        return 0;
+    }
+    fib_sink_init_buffer(&sink, frame->bytes, capacity);
+    fib_render_context_invalidate(context);
+    int ok = fib_render_context_emit(context, image, config, &sink);
+    frame->size = sink.length;
+    fib_sink_free(&sink);
+    if (!ok) {
+        fprintf(stderr, "error: cannot buffer rendered frame\n");
+        free_frame(frame);
+        return 0;
+    }
+
+    char *trimmed = (char *)realloc(frame->bytes, frame->size ? frame->size : 1U);
+    if (trimmed) {
+        frame->bytes = trimmed;
+    }
+    return 1;
+}
+
+static void *render_worker(void *argument) {
+    FibAnimWorker *worker = (FibAnimWorker *)argument;
+    worker->ok = render_to_memory(&worker->context, &worker->image, worker->config, &worker->rendered);
+    return NULL;
+}
+
+/* Renders a batch of composited frames, one per thread; the caller's thread takes slot 0. */
+static void run_workers(FibAnimWorker *workers, int count) {
+    pthread_t threads[FIB_ANIM_MAX_WORKERS];
+    int started[FIB_ANIM_MAX_WORKERS] = {0};
+
+    for (int i = 1; i < count; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, render_worker, &workers[i]) == 0);
+        if (!started[i]) {
+            render_worker(&workers[i]);
+        }
+    }
+    render_worker(&workers[0]);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+static void add_ns(struct timespec *time_point, uint64_t nanoseconds) {
+    uint64_t total = (uint64_t)time_point->tv_nsec + nanoseconds % 1000000000ULL;
+    time_point->tv_sec += (time_t)(nanoseconds / 1000000000ULL + total / 1000000000ULL);
+    time_point->tv_nsec = (long)(total % 1000000000ULL);
+}
+
+static int time_before(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/*
+ * Waits for the frame's absolute deadline so render time never adds to the stored delay.
+ * A frame that is already late resets the schedule instead of bursting to catch up.
+ */
+static void begin_frame(FibAnimSession *session) {
+    struct timespec now;
+
+    if (!session->play_in_place) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (session->frames_shown == 0 || time_before(&session->deadline, &now)) {
+        session->deadline = now;
+    }
+    while (!g_stop_requested &&
+           clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &session->deadline, NULL) == EINTR) {
+    }
+    fputs(session->frames_shown == 0 ? "\x1b[2J\x1b[H" : "\x1b[H", session->output);
+}
+
+static void end_frame(FibAnimSession *session, int frame_index) {
+    if (session->play_in_place) {
+        fputs("\x1b[J", session->output);
+        fflush(session->output);
+        add_ns(&session->deadline, fib_apng_delay_ns(&session->apng, frame_index));
+    }
+    session->frames_shown++;
+}
+
+static void present(FibAnimSession *session, int frame_index, const FibAnimFrame *frame) {
+    begin_frame(session);
+    fwrite(frame->bytes, 1, frame->size, session->output);
+    end_frame(session, frame_index);
+}
+
+/*
+ * Stops caching at frame_index: resume is rebuilt from the batch's starting compositor
+ * by replaying the frames before frame_index (the batch has already moved past it).
+ */
+static int close_cache(FibAnimSession *session, int frame_index) {
+    session->cache_closed = 1;
+    fib_apng_cursor_copy(&session->apng, &session->resume, &session->batch_start);
+    while (session->resume.next_frame < frame_index) {
+        if (!fib_apng_next_frame(&session->apng, &session->resume, &session->image)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int keep_frame(FibAnimSession *session, int frame_index, FibAnimFrame *frame) {
+    if (!session->caching || session->cache_closed) {
+        return 1;
+    }
+    if (frame->size > session->config->frame_cache - session->cached_bytes) {
+        return close_cache(session, frame_index);
+    }
+    session->cache[frame_index] = *frame;
+    session->cached_count++;
+    session->cached_bytes += frame->size;
+    frame->bytes = NULL;
+    frame->size = 0;
+    return 1;
+}
+
+/* First cycle: composite worker_count frames in order, render them in parallel, show them in order. */
+static int play_first_cycle(FibAnimSession *session) {
+    int frame_count = session->apng.frame_count;
+
+    for (int start = 0; start < frame_count && !g_stop_requested; start += session->worker_count) {
+        int batch = frame_count - start < session->worker_count ? frame_count - start : session->worker_count;
+        if (session->caching && !session->cache_closed) {
+            fib_apng_cursor_copy(&session->apng, &session->batch_start, &session->cursor);
+        }
+        for (int i = 0; i < batch; i++) {
+            if (!fib_apng_next_frame(&session->apng, &session->cursor, &session->workers[i].image)) {
+                return 0;
+            }
+        }
+        run_workers(session->workers, batch);
+
+        int ok = 1;
+        for (int i = 0; i < batch; i++) {
+            FibAnimWorker *worker = &session->workers[i];
+            ok = ok && worker->ok;
+            if (ok) {
+                present(session, start + i, &worker->rendered);
+                ok = keep_frame(session, start + i, &worker->rendered);
+            }
+            free_frame(&worker->rendered);
+        }
+        if (!ok) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Later cycles: cached frames cost a write; the rest are composited and rendered on demand. */
+static int play_cycle(FibAnimSession *session) {
+    for (int i = 0; i < session->cached_count && !g_stop_requested; i++) {
+        present(session, i, &session->cache[i]);
+    }
+    if (session->cached_count == session->apng.frame_count) {
+        return 1;
+    }
+
+    fib_apng_cursor_copy(&session->apng, &session->cursor, &session->resume);
+    for (int i = session->cached_count; i < session->apng.frame_count && !g_stop_requested; i++) {
+        if (!fib_apng_next_frame(&session->apng, &session->cursor, &session->image)) {
+            return 0;
+        }
+        fib_render_context_invalidate(&session->context);
+        begin_frame(session);
+        fib_render_context_draw(&session->context, &session->image, &session->runtime_config, session->output);
+        end_frame(session, i);
+    }
+    return 1;
+}
+
+/* Worker count is bounded by --threads, the frame count and, under --max-memory, the budget. */
+static int plan_workers(FibAnimSession *session) {
+    const FibApng *apng = &session->apng;
+    FibImageInfo info = {FIB_IMAGE_FORMAT_PNG, apng->width, apng->height, 0, 0, (size_t)apng->width * 4U};
+    FibPlan plan;
+
+    if (!fib_plan_choose(&info, &session->worker_config, &plan) || plan.downscale != 1) {
+        fprintf(stderr, "error: no render pipeline for %dx%d animation fits in %zu bytes (cheapest needs %zu)\n", apng->width,
+                apng->height, session->config->max_memory, plan.peak_bytes);
+        return 0;
+    }
+    session->runtime_config.sat_layout = plan.sat_layout;
+    session->worker_config.sat_layout = plan.sat_layout;
+
+    int workers = fib_resolve_thread_count(session->config->thread_count);
+    if (workers > apng->frame_count) {
+        workers = apng->frame_count;
+    }
+    if (workers > FIB_ANIM_MAX_WORKERS) {
+        workers = FIB_ANIM_MAX_WORKERS;
+    }
+    size_t canvas_bytes = (size_t)apng->width * (size_t)apng->height * 4U;
+    size_t fixed = canvas_bytes * (apng->uses_previous ? 8U : 5U);
+    if (session->config->max_memory) {
+        size_t affordable = session->config->max_memory > fixed ? (session->config->max_memory - fixed) / plan.peak_bytes : 0;
+        if (affordable == 0) {
+            fprintf(stderr, "error: %dx%d animation does not fit in %zu bytes\n", apng->width, apng->height,
+                    session->config->max_memory);
+            return 0;
+        }
+        if ((size_t)workers > affordable) {
+            workers = (int)affordable;
+        }
+    }
+    session->worker_count = workers;
+    if (session->config->verbose) {
+        fib_plan_report(&info, &session->worker_config, &plan, stderr);
+    }
+    return 1;
+}
+
+static int session_open(FibAnimSession *session) {
+    FibApng *apng = &session->apng;
+
+    if (!plan_workers(session)) {
+        return 0;
+    }
+    session->workers = (FibAnimWorker *)calloc((size_t)session->worker_count, sizeof(FibAnimWorker));
+    if (!session->workers) {
+        fprintf(stderr, "error: not enough memory for render workers\n");
+        return 0;
+    }
+    if (!fib_image_allocate(&session->image, apng->width, apng->height) ||
+        !fib_apng_cursor_init(apng, &session->cursor) || !fib_apng_cursor_init(apng, &session->batch_start) ||
+        !fib_apng_cursor_init(apng, &session->resume)) {
+        return 0;
+    }
+    for (int i = 0; i < session->worker_count; i++) {
+        fib_render_context_init(&session->workers[i].context);
+        session->workers[i].config = &session->worker_config;
+        if (!fib_image_allocate(&session->workers[i].image, apng->width, apng->height)) {
+            return 0;
+        }
+    }
+    if (session->caching) {
+        session->cache = (FibAnimFrame *)calloc((size_t)apng->frame_count, sizeof(FibAnimFrame));
+        if (!session->cache) {
+            fprintf(stderr, "error: not enough memory for frame cache\n");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void session_close(FibAnimSession *session) {
+    if (session->workers) {
+        for (int i = 0; i < session->worker_count; i++) {
+            fib_render_context_free(&session->workers[i].context);
+            fib_image_free(&session->workers[i].image);
+            free_frame(&session->workers[i].rendered);
+        }
+        free(session->workers);
+    }
+    if (session->cache) {
+        for (int i = 0; i < session->apng.frame_count; i++) {
+            free_frame(&session->cache[i]);
+        }
+        free(session->cache);
+    }
+    fib_render_context_free(&session->context);
+    fib_image_free(&session->image);
+    fib_apng_cursor_free(&session->cursor);
+    fib_apng_cursor_free(&session->batch_start);
+    fib_apng_cursor_free(&session->resume);
+    fib_apng_close(&session->apng);
+}
+
+/*
+ * Plays an APNG. On a terminal frames are painted in place with their stored delays and
+ * the animation loops acTL num_plays times (0: until SIGINT), replaying the frame cache
+ * after the first cycle. Other outputs receive every frame once, back to back.
+ */
+int fib_anim_run(const char *input_path, const FibRenderConfig *config, const char *output_path) {
+    FibAnimSession session;
+
+    memset(&session, 0, sizeof(session));
+    session.config = config;
+    session.runtime_config = *config;
+    session.runtime_config.enable_color = fib_should_enable_color(config->color_mode, output_path != NULL);
+    session.worker_config = session.runtime_config;
+    session.worker_config.thread_count = 1;
+    session.play_in_place = (output_path == NULL && config->format == FIB_FORMAT_TEXT && isatty(STDOUT_FILENO));
+    fib_render_context_init(&session.context);
+
+    if (!fib_apng_open(input_path, &session.apng)) {
+        return 1;
+    }
+    session.caching = session.play_in_place && session.apng.play_count != 1;
+    if (!session_open(&session)) {
+        session_close(&session);
+        return 1;
+    }
+
+    session.output = stdout;
+    if (output_path) {
+        session.output = fib_open_output(output_path, config);
+        if (!session.output) {
+            session_close(&session);
+            return 1;
+        }
+    } else {
+        setvbuf(stdout, g_stream_buffer, _IOFBF, sizeof(g_stream_buffer));
+    }
+    if (session.play_in_place) {
+        install_handler(SIGINT, request_stop);
+        install_handler(SIGTERM, request_stop);
+    }
+
+    int ok = play_first_cycle(&session);
+    if (config->verbose) {
+        fprintf(stderr, "fib: apng %dx%d, %d frames, %d render threads, %d cached (%zu bytes), %d on demand\n",
+                session.apng.width, session.apng.height, session.apng.frame_count, session.worker_count, session.cached_count,
+                session.cached_bytes, session.caching ? session.apng.frame_count - session.cached_count : 0);
+    }
+    for (uint32_t play = 1; ok && session.caching && !g_stop_requested && (session.apng.play_count == 0 || play < session.apng.play_count);
+         play++) {
+        ok = play_cycle(&session);
+    }
+
+    if (output_path) {
+        fclose(session.output);
+        if (ok) {
+            printf(config->format == FIB_FORMAT_GRID ? "grid frames appended to: %s\n" : "ascii animation saved to: %s\n", output_path);
+        }
+    } else {
+        fflush(stdout);
+    }
+    session_close(&session);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,10 @@
+#ifndef FIB_ANIM_H
+#define FIB_ANIM_H
+
+#include "fib_render.h"
+
+#define FIB_ANIM_DEFAULT_FRAME_CACHE ((size_t)64 << 20)
+
+int fib_anim_run(const char *input_path, const FibRenderConfig *config, const char *output_path);
+
+#endif
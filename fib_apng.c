@@ -0,0 +1,439 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fib_apng.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FIB_APNG_CHUNK_OVERHEAD 12U
+#define FIB_APNG_MAX_CHUNK_LENGTH 0x7FFFFFFFU
+
+static const unsigned char k_png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+static uint32_t read_be32(const unsigned char *bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+static uint16_t read_be16(const unsigned char *bytes) {
+    return (uint16_t)(((unsigned int)bytes[0] << 8) | (unsigned int)bytes[1]);
+}
+
+static void put_be32(unsigned char *out, uint32_t value) {
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
+}
+
+static int chunk_is(const unsigned char *type, const char *name) {
+    return memcmp(type, name, 4) == 0;
+}
+
+/* Animated means an acTL before the first IDAT announcing more than one frame. */
+int fib_apng_probe(const char *path) {
+    unsigned char header[8];
+    FILE *file = fopen(path, "rb");
+
+    if (!file) {
+        return 0;
+    }
+    int animated = 0;
+    if (fread(header, 1, sizeof(header), file) == sizeof(header) && memcmp(header, k_png_signature, 8) == 0) {
+        while (fread(header, 1, sizeof(header), file) == sizeof(header)) {
+            uint32_t length = read_be32(header);
+            if (chunk_is(header + 4, "IDAT") || chunk_is(header + 4, "IEND") || length > FIB_APNG_MAX_CHUNK_LENGTH) {
+                break;
+            }
+            if (chunk_is(header + 4, "acTL")) {
+                animated = length == 8 && fread(header, 1, 8, file) == 8 && read_be32(header) > 1;
+                break;
+            }
+            if (fseek(file, (long)length + 4L, SEEK_CUR) != 0) {
+                break;
+            }
+        }
+    }
+    fclose(file);
+    return animated;
+}
+
+static int grow(void **items, size_t item_size, size_t count, size_t *capacity) {
+    if (count < *capacity) {
+        return 1;
+    }
+    size_t next = *capacity ? *capacity * 2U : 16U;
+    void *grown = realloc(*items, next * item_size);
+    if (!grown) {
+        fprintf(stderr, "error: not enough memory for apng frame table\n");
+        return 0;
+    }
+    *items = grown;
+    *capacity = next;
+    return 1;
+}
+
+static int parse_frame_control(const FibApng *apng, const unsigned char *data, uint32_t length, size_t span_count, FibApngFrame *frame) {
+    if (length != 26) {
+        return 0;
+    }
+    frame->width = read_be32(data + 4);
+    frame->height = read_be32(data + 8);
+    frame->x = read_be32(data + 12);
+    frame->y = read_be32(data + 16);
+    frame->delay_num = read_be16(data + 20);
+    frame->delay_den = read_be16(data + 22);
+    frame->dispose_op = data[24];
+    frame->blend_op = data[25];
+    frame->first_span = span_count;
+    frame->span_count = 0;
+    return frame->width > 0 && frame->height > 0 && frame->x <= (uint32_t)apng->width &&
+           frame->y <= (uint32_t)apng->height && frame->width <= (uint32_t)apng->width - frame->x &&
+           frame->height <= (uint32_t)apng->height - frame->y && frame->dispose_op <= FIB_APNG_DISPOSE_PREVIOUS &&
+           frame->blend_op <= FIB_APNG_BLEND_OVER;
+}
+
+/*
+ * Walks the chunk list once. Chunks between IHDR and the first IDAT other than acTL/fcTL
+ * (PLTE, tRNS, ...) are shared by every frame. IDAT belongs to frame 0 only when an fcTL
+ * precedes it; otherwise the still is a fallback image outside the animation.
+ */
+static int parse_chunks(FibApng *apng, const char *path) {
+    const unsigned char *bytes = apng->mapping;
+    size_t size = apng->mapping_size;
+    size_t frame_capacity = 0;
+    size_t span_capacity = 0;
+    size_t shared_capacity = 0;
+    size_t position = 8;
+    int seen_actl = 0;
+    int seen_idat = 0;
+    uint32_t announced = 0;
+
+    while (position + FIB_APNG_CHUNK_OVERHEAD <= size) {
+        uint32_t length = read_be32(bytes + position);
+        const unsigned char *type = bytes + position + 4;
+        const unsigned char *data = bytes + position + 8;
+        if (length > FIB_APNG_MAX_CHUNK_LENGTH || length > size - position - FIB_APNG_CHUNK_OVERHEAD) {
+            break;
+        }
+
+        if (position == 8) {
+            if (!chunk_is(type, "IHDR") || length != 13) {
+                break;
+            }
+            uint32_t width = read_be32(data);
+            uint32_t height = read_be32(data + 4);
+            if (width == 0 || height == 0 || width > FIB_MAX_IMAGE_DIMENSION || height > FIB_MAX_IMAGE_DIMENSION) {
+                fprintf(stderr, "error: png dimensions out of range\n");
+                return 0;
+            }
+            apng->width = (int)width;
+            apng->height = (int)height;
+        } else if (chunk_is(type, "acTL") && !seen_idat && length == 8) {
+            seen_actl = 1;
+            announced = read_be32(data);
+            apng->play_count = read_be32(data + 4);
+        } else if (chunk_is(type, "fcTL")) {
+            if (!grow((void **)&apng->frames, sizeof(FibApngFrame), (size_t)apng->frame_count, &frame_capacity)) {
+                return 0;
+            }
+            if (!parse_frame_control(apng, data, length, apng->span_count, &apng->frames[apng->frame_count])) {
+                fprintf(stderr, "error: invalid apng frame control %d: %s\n", apng->frame_count, path);
+                return 0;
+            }
+            if (apng->frames[apng->frame_count].dispose_op == FIB_APNG_DISPOSE_PREVIOUS) {
+                apng->uses_previous = 1;
+            }
+            apng->frame_count++;
+        } else if (chunk_is(type, "IDAT") || chunk_is(type, "fdAT")) {
+            int is_idat = chunk_is(type, "IDAT");
+            seen_idat |= is_idat;
+            if (apng->frame_count > 0 && (is_idat ? apng->frame_count == 1 : length > 4)) {
+                if (!grow((void **)&apng->spans, sizeof(FibApngSpan), apng->span_count, &span_capacity)) {
+                    return 0;
+                }
+                size_t skip = is_idat ? 0U : 4U;
+                apng->spans[apng->span_count].offset = position + 8U + skip;
+                apng->spans[apng->span_count].length = (size_t)length - skip;
+                apng->span_count++;
+                apng->frames[apng->frame_count - 1].span_count++;
+            }
+        } else if (chunk_is(type, "IEND")) {
+            break;
+        } else if (!seen_idat && !chunk_is(type, "acTL")) {
+            if (!grow((void **)&apng->shared_chunks, sizeof(FibApngSpan), apng->shared_chunk_count, &shared_capacity)) {
+                return 0;
+            }
+            apng->shared_chunks[apng->shared_chunk_count].offset = position;
+            apng->shared_chunks[apng->shared_chunk_count].length = (size_t)length + FIB_APNG_CHUNK_OVERHEAD;
+            apng->shared_chunk_count++;
+        }
+        position += (size_t)length + FIB_APNG_CHUNK_OVERHEAD;
+    }
+
+    if (apng->width == 0 || !seen_actl || announced == 0 || apng->frame_count == 0) {
+        fprintf(stderr, "error: not an animated png: %s\n", path);
+        return 0;
+    }
+    if ((uint32_t)apng->frame_count != announced) {
+        fprintf(stderr, "error: apng announces %u frames but has %d: %s\n", announced, apng->frame_count, path);
+        return 0;
+    }
+    for (int i = 0; i < apng->frame_count; i++) {
+        if (apng->frames[i].span_count == 0) {
+            fprintf(stderr, "error: apng frame %d has no image data: %s\n", i, path);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static size_t canvas_bytes(const FibApng *apng) {
+    return (size_t)apng->width * (size_t)apng->height * 4U;
+}
+
+int fib_apng_open(const char *path, FibApng *apng) {
+    struct stat file_status;
+
+    memset(apng, 0, sizeof(*apng));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "error: cannot open file %s\n", path);
+        return 0;
+    }
+    if (fstat(fd, &file_status) != 0 || file_status.st_size < 8) {
+        fprintf(stderr, "error: invalid png signature: %s\n", path);
+        close(fd);
+        return 0;
+    }
+    void *mapping = mmap(NULL, (size_t)file_status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "error: cannot map file %s\n", path);
+        return 0;
+    }
+    apng->mapping = (unsigned char *)mapping;
+    apng->mapping_size = (size_t)file_status.st_size;
+
+    if (memcmp(apng->mapping, k_png_signature, 8) != 0) {
+        fprintf(stderr, "error: invalid png signature: %s\n", path);
+        fib_apng_close(apng);
+        return 0;
+    }
+    if (!parse_chunks(apng, path)) {
+        fib_apng_close(apng);
+        return 0;
+    }
+
+    apng->frame_pixels = (unsigned char *)malloc(canvas_bytes(apng));
+    if (!apng->frame_pixels) {
+        fprintf(stderr, "error: not enough memory for apng frames\n");
+        fib_apng_close(apng);
+        return 0;
+    }
+    return 1;
+}
+
+void fib_apng_close(FibApng *apng) {
+    if (apng->mapping) {
+        munmap(apng->mapping, apng->mapping_size);
+    }
+    free(apng->frames);
+    free(apng->spans);
+    free(apng->shared_chunks);
+    free(apng->stream);
+    free(apng->frame_pixels);
+    memset(apng, 0, sizeof(*apng));
+}
+
+/* delay_num / delay_den seconds; a zero denominator means hundredths. */
+uint64_t fib_apng_delay_ns(const FibApng *apng, int frame_index) {
+    const FibApngFrame *frame = &apng->frames[frame_index];
+    uint64_t denominator = frame->delay_den ? frame->delay_den : 100U;
+    return (uint64_t)frame->delay_num * 1000000000ULL / denominator;
+}
+
+int fib_apng_cursor_init(const FibApng *apng, FibApngCursor *cursor) {
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->canvas = (unsigned char *)calloc(canvas_bytes(apng), 1);
+    if (apng->uses_previous) {
+        cursor->previous = (unsigned char *)calloc(canvas_bytes(apng), 1);
+    }
+    if (!cursor->canvas || (apng->uses_previous && !cursor->previous)) {
+        fprintf(stderr, "error: not enough memory for apng canvas\n");
+        fib_apng_cursor_free(cursor);
+        return 0;
+    }
+    return 1;
+}
+
+void fib_apng_cursor_copy(const FibApng *apng, FibApngCursor *destination, const FibApngCursor *source) {
+    memcpy(destination->canvas, source->canvas, canvas_bytes(apng));
+    if (apng->uses_previous) {
+        memcpy(destination->previous, source->previous, canvas_bytes(apng));
+    }
+    destination->next_frame = source->next_frame;
+}
+
+void fib_apng_cursor_free(FibApngCursor *cursor) {
+    free(cursor->canvas);
+    free(cursor->previous);
+    memset(cursor, 0, sizeof(*cursor));
+}
+
+static int ensure_stream(FibApng *apng, size_t size) {
+    if (size <= apng->stream_capacity) {
+        return 1;
+    }
+    unsigned char *stream = (unsigned char *)realloc(apng->stream, size);
+    if (!stream) {
+        fprintf(stderr, "error: not enough memory for apng frame stream\n");
+        return 0;
+    }
+    apng->stream = stream;
+    apng->stream_capacity = size;
+    return 1;
+}
+
+static unsigned char *put_chunk_header(unsigned char *out, uint32_t length, const char *type) {
+    put_be32(out, length);
+    memcpy(out + 4, type, 4);
+    return out + 8;
+}
+
+/* Rebuilds frame_index as a standalone PNG and decodes it into frame_pixels. */
+static int decode_frame(FibApng *apng, int frame_index) {
+    const FibApngFrame *frame = &apng->frames[frame_index];
+    size_t size = 8U + 13U + FIB_APNG_CHUNK_OVERHEAD * 2U;
+
+    for (size_t i = 0; i < apng->shared_chunk_count; i++) {
+        size += apng->shared_chunks[i].length;
+    }
+    for (size_t i = 0; i < frame->span_count; i++) {
+        size += apng->spans[frame->first_span + i].length + FIB_APNG_CHUNK_OVERHEAD;
+    }
+    if (!ensure_stream(apng, size)) {
+        return 0;
+    }
+
+    unsigned char *out = apng->stream;
+    memcpy(out, apng->mapping, 8U + 8U + 13U + 4U);
+    put_be32(out + 16, frame->width);
+    put_be32(out + 20, frame->height);
+    out += 8U + 8U + 13U + 4U;
+    for (size_t i = 0; i < apng->shared_chunk_count; i++) {
+        memcpy(out, apng->mapping + apng->shared_chunks[i].offset, apng->shared_chunks[i].length);
+        out += apng->shared_chunks[i].length;
+    }
+    for (size_t i = 0; i < frame->span_count; i++) {
+        const FibApngSpan *span = &apng->spans[frame->first_span + i];
+        out = put_chunk_header(out, (uint32_t)span->length, "IDAT");
+        memcpy(out, apng->mapping + span->offset, span->length);
+        put_be32(out + span->length, 0);
+        out += span->length + 4U;
+    }
+    put_be32(put_chunk_header(out, 0, "IEND"), 0xAE426082U);
+
+    return fib_image_decode_png_rgba(apng->stream, size, (int)frame->width, (int)frame->height, apng->frame_pixels);
+}
+
+static void copy_region(unsigned char *destination, const unsigned char *source, const FibApng *apng, const FibApngFrame *frame) {
+    size_t stride = (size_t)apng->width * 4U;
+    size_t offset = (size_t)frame->y * stride + (size_t)frame->x * 4U;
+
+    for (uint32_t y = 0; y < frame->height; y++) {
+        memcpy(destination + offset + (size_t)y * stride, source + offset + (size_t)y * stride, (size_t)frame->width * 4U);
+    }
+}
+
+static void clear_region(unsigned char *canvas, const FibApng *apng, const FibApngFrame *frame) {
+    size_t stride = (size_t)apng->width * 4U;
+    size_t offset = (size_t)frame->y * stride + (size_t)frame->x * 4U;
+
+    for (uint32_t y = 0; y < frame->height; y++) {
+        memset(canvas + offset + (size_t)y * stride, 0, (size_t)frame->width * 4U);
+    }
+}
+
+/* Straight-alpha "over" in 8-bit integers; fully opaque and fully clear sources are exact. */
+static void blend_over(unsigned char *restrict destination, const unsigned char *restrict source, uint32_t width) {
+    for (uint32_t x = 0; x < width; x++, destination += 4, source += 4) {
+        uint32_t source_alpha = source[3];
+        if (source_alpha == 255U) {
+            memcpy(destination, source, 4);
+            continue;
+        }
+        if (source_alpha == 0U) {
+            continue;
+        }
+        uint32_t destination_weight = (uint32_t)destination[3] * (255U - source_alpha);
+        uint32_t alpha = source_alpha * 255U + destination_weight;
+        for (int channel = 0; channel < 3; channel++) {
+            destination[channel] =
+                (unsigned char)((source[channel] * source_alpha * 255U + destination[channel] * destination_weight + alpha / 2U) / alpha);
+        }
+        destination[3] = (unsigned char)((alpha + 127U) / 255U);
+    }
+}
+
+static void composite(unsigned char *canvas, const FibApng *apng, const FibApngFrame *frame) {
+    size_t stride = (size_t)apng->width * 4U;
+    size_t row_bytes = (size_t)frame->width * 4U;
+    unsigned char *target = canvas + (size_t)frame->y * stride + (size_t)frame->x * 4U;
+
+    for (uint32_t y = 0; y < frame->height; y++) {
+        const unsigned char *row = apng->frame_pixels + (size_t)y * row_bytes;
+        if (frame->blend_op == FIB_APNG_BLEND_SOURCE) {
+            memcpy(target + (size_t)y * stride, row, row_bytes);
+        } else {
+            blend_over(target + (size_t)y * stride, row, frame->width);
+        }
+    }
+}
+
+/*
+ * Applies the previous frame's dispose op, composites the next frame and writes the canvas
+ * (alpha over white, as for stills) into gray, which must be width x height. Frame 0
+ * starts from a fully transparent canvas, so a cursor is rewound by setting next_frame = 0.
+ */
+int fib_apng_next_frame(FibApng *apng, FibApngCursor *cursor, FibImage *gray) {
+    int index = cursor->next_frame;
+
+    if (index < 0 || index >= apng->frame_count) {
+        return 0;
+    }
+    if (index == 0) {
+        memset(cursor->canvas, 0, canvas_bytes(apng));
+    } else {
+        const FibApngFrame *last = &apng->frames[index - 1];
+        int dispose = last->dispose_op;
+        if (dispose == FIB_APNG_DISPOSE_PREVIOUS && index == 1) {
+            dispose = FIB_APNG_DISPOSE_BACKGROUND;
+        }
+        if (dispose == FIB_APNG_DISPOSE_BACKGROUND) {
+            clear_region(cursor->canvas, apng, last);
+        } else if (dispose == FIB_APNG_DISPOSE_PREVIOUS) {
+            copy_region(cursor->canvas, cursor->previous, apng, last);
+        }
+    }
+
+    const FibApngFrame *frame = &apng->frames[index];
+    if (!decode_frame(apng, index)) {
+        return 0;
+    }
+    if (frame->dispose_op == FIB_APNG_DISPOSE_PREVIOUS && index > 0) {
+        copy_region(cursor->previous, cursor->canvas, apng, frame);
+    }
+    composite(cursor->canvas, apng, frame);
+
+    for (int y = 0; y < apng->height; y++) {
+        fib_image_rgba_to_gray(cursor->canvas + (size_t)y * (size_t)apng->width * 4U, apng->width,
+                               gray->pixels + (size_t)y * (size_t)apng->width);
+    }
+    cursor->next_frame = index + 1;
+    return 1;
+}
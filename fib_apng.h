@@ -0,0 +1,78 @@
+#ifndef FIB_APNG_H
+#define FIB_APNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fib_image.h"
+
+#define FIB_APNG_DISPOSE_NONE 0
+#define FIB_APNG_DISPOSE_BACKGROUND 1
+#define FIB_APNG_DISPOSE_PREVIOUS 2
+#define FIB_APNG_BLEND_SOURCE 0
+#define FIB_APNG_BLEND_OVER 1
+
+/* Byte range of one frame's image data inside the mapped file (fdAT sequence numbers skipped). */
+typedef struct {
+    size_t offset;
+    size_t length;
+} FibApngSpan;
+
+/* One fcTL: the frame region on the canvas, its delay and ops, and its data spans. */
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint16_t delay_num;
+    uint16_t delay_den;
+    uint8_t dispose_op;
+    uint8_t blend_op;
+    size_t first_span;
+    size_t span_count;
+} FibApngFrame;
+
+/*
+ * Parsed animation. The file stays mapped; each frame is decoded by rebuilding a standalone
+ * PNG stream (IHDR with the frame size, the still's palette/transparency chunks and the
+ * frame data as IDAT) and handing it to libpng.
+ */
+typedef struct {
+    unsigned char *mapping;
+    size_t mapping_size;
+    int width;
+    int height;
+    uint32_t play_count;
+    int frame_count;
+    FibApngFrame *frames;
+    FibApngSpan *spans;
+    size_t span_count;
+    FibApngSpan *shared_chunks;
+    size_t shared_chunk_count;
+    int uses_previous;
+    unsigned char *stream;
+    size_t stream_capacity;
+    unsigned char *frame_pixels;
+} FibApng;
+
+/*
+ * Compositor position: the RGBA canvas after frame next_frame - 1 and, when the animation
+ * disposes to PREVIOUS, the canvas saved before that frame. Copying a cursor snapshots the
+ * animation so playback can resume there without compositing the earlier frames again.
+ */
+typedef struct {
+    unsigned char *canvas;
+    unsigned char *previous;
+    int next_frame;
+} FibApngCursor;
+
+int fib_apng_probe(const char *path);
+int fib_apng_open(const char *path, FibApng *apng);
+void fib_apng_close(FibApng *apng);
+uint64_t fib_apng_delay_ns(const FibApng *apng, int frame_index);
+int fib_apng_cursor_init(const FibApng *apng, FibApngCursor *cursor);
+void fib_apng_cursor_copy(const FibApng *apng, FibApngCursor *destination, const FibApngCursor *source);
+void fib_apng_cursor_free(FibApngCursor *cursor);
+int fib_apng_next_frame(FibApng *apng, FibApngCursor *cursor, FibImage *gray);
+
+#endif
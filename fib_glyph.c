@@ -0,0 +1,160 @@
+#include "fib_glyph.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Source Code Pro Regular at 64 px over the rows printable ASCII inks, box-averaged coverage
+ * >= 6% per sub-block (or half the densest one), mirror pairs averaged; regenerate with
+ * scripts/glyph_signatures.py --font SourceCodePro-Regular.ttf.
+ */
+static const uint16_t k_glyph_signatures[] = {
+    0x0000, /* ' ' */
+    0x6660, /* '!' */
+    0xF600, /* '"' */
+    0x6FF0, /* '#' */
+    0x6EF6, /* '$' */
+    0xDFF0, /* '%' */
+    0x6FF0, /* '&' */
+    0x6600, /* '\'' */
+    0x6462, /* '(' */
+    0x6264, /* ')' */
+    0x0F60, /* '*' */
+    0x0F60, /* '+' */
+    0x0066, /* ',' */
+    0x0F00, /* '-' */
+    0x0060, /* '.' */
+    0x364C, /* '/' */
+    0x6FF0, /* '0' */
+    0x66F0, /* '1' */
+    0xE3F0, /* '2' */
+    0xE7F0, /* '3' */
+    0x2EF0, /* '4' */
+    0xEFF0, /* '5' */
+    0x7FF0, /* '6' */
+    0xF260, /* '7' */
+    0xFFF0, /* '8' */
+    0xEFF0, /* '9' */
+    0x0660, /* ':' */
+    0x0666, /* ';' */
+    0x3E70, /* '<' */
+    0x0FF0, /* '=' */
+    0xC7E0, /* '>' */
+    0x6660, /* '?' */
+    0x7FF7, /* '@' */
+    0x66F0, /* 'A' */
+    0xFFF0, /* 'B' */
+    0x78F0, /* 'C' */
+    0xFDF0, /* 'D' */
+    0xFEF0, /* 'E' */
+    0x7FC0, /* 'F' */
+    0x7BF0, /* 'G' */
+    0x9FB0, /* 'H' */
+    0xF6F0, /* 'I' */
+    0x73F0, /* 'J' */
+    0xBEF0, /* 'K' */
+    0x4CF0, /* 'L' */
+    0xFFF0, /* 'M' */
+    0xDFB0, /* 'N' */
+    0xF9F0, /* 'O' */
+    0xFFC0, /* 'P' */
+    0xF9F3, /* 'Q' */
+    0xFFF0, /* 'R' */
+    0xFEF0, /* 'S' */
+    0xF660, /* 'T' */
+    0x9BF0, /* 'U' */
+    0x9F60, /* 'V' */
+    0x9FF0, /* 'W' */
+    0xF6F0, /* 'X' */
+    0x9660, /* 'Y' */
+    0xF6F0, /* 'Z' */
+    0x7447, /* '[' */
+    0xC623, /* '\\' */
+    0xE22E, /* ']' */
+    0x6E00, /* '^' */
+    0x000F, /* '_' */
+    0x6000, /* '`' */
+    0x0FF0, /* 'a' */
+    0xCFF0, /* 'b' */
+    0x0FF0, /* 'c' */
+    0x3FF0, /* 'd' */
+    0x0FF0, /* 'e' */
+    0x7F60, /* 'f' */
+    0x0FFF, /* 'g' */
+    0xCFF0, /* 'h' */
+    0x2E20, /* 'i' */
+    0x2E2E, /* 'j' */
+    0xCFF0, /* 'k' */
+    0xE670, /* 'l' */
+    0x0FF0, /* 'm' */
+    0x0FF0, /* 'n' */
+    0x0FF0, /* 'o' */
+    0x0FFC, /* 'p' */
+    0x0FF3, /* 'q' */
+    0x0FC0, /* 'r' */
+    0x0EF0, /* 's' */
+    0x4F70, /* 't' */
+    0x0BF0, /* 'u' */
+    0x0F60, /* 'v' */
+    0x0FF0, /* 'w' */
+    0x0FF0, /* 'x' */
+    0x0F6E, /* 'y' */
+    0x0FF0, /* 'z' */
+    0x7667, /* '{' */
+    0x6666, /* '|' */
+    0xE66E, /* '}' */
+    0x0F00, /* '~' */
+};
+
+uint16_t fib_glyph_signature(char glyph) {
+    unsigned char code = (unsigned char)glyph;
+
+    if (code < 0x20U || code >= 0x20U + sizeof(k_glyph_signatures) / sizeof(k_glyph_signatures[0])) {
+        return 0;
+    }
+    return k_glyph_signatures[code - 0x20U];
+}
+
+/*
+ * Fills table[FIB_GLYPH_SHAPE_COUNT] with a multi-source breadth-first search over the
+ * 16-bit hypercube: each candidate glyph seeds its own signature (earlier glyphs win
+ * duplicates), and every signature takes the glyph of the first seed to reach it, which
+ * is a nearest one in Hamming distance. Glyphs without ink are not candidates.
+ */
+int fib_glyph_shape_table_build(const char *glyphs, char *table) {
+    uint16_t *queue = (uint16_t *)malloc(FIB_GLYPH_SHAPE_COUNT * sizeof(uint16_t));
+    size_t head = 0;
+    size_t tail = 0;
+
+    if (!queue) {
+        fprintf(stderr, "error: out of memory for glyph shape table\n");
+        return 0;
+    }
+    memset(table, 0, FIB_GLYPH_SHAPE_COUNT);
+    for (const char *glyph = glyphs; *glyph; glyph++) {
+        uint16_t signature = fib_glyph_signature(*glyph);
+        if (signature != 0 && table[signature] == 0) {
+            table[signature] = *glyph;
+            queue[tail++] = signature;
+        }
+    }
+    if (tail == 0) {
+        free(queue);
+        fprintf(stderr, "error: no glyph with ink for shape matching\n");
+        return 0;
+    }
+
+    while (head < tail) {
+        uint16_t signature = queue[head++];
+        for (int bit = 0; bit < FIB_GLYPH_GRID * FIB_GLYPH_GRID; bit++) {
+            uint16_t neighbor = (uint16_t)(signature ^ (1U << bit));
+            if (table[neighbor] == 0) {
+                table[neighbor] = table[signature];
+                queue[tail++] = neighbor;
+            }
+        }
+    }
+    free(queue);
+    return 1;
+}
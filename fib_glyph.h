@@ -0,0 +1,18 @@
+#ifndef FIB_GLYPH_H
+#define FIB_GLYPH_H
+
+#include <stdint.h>
+
+#define FIB_GLYPH_GRID 4
+#define FIB_GLYPH_SHAPE_COUNT 65536U
+
+/*
+ * Shape matching works on 4x4 coverage signatures: one bit per sub-block of a terminal
+ * cell, row-major from the top-left in bit 15, set where the glyph has ink (or, for an
+ * image cell, where the sub-block is darker than the cell). A shape table maps every
+ * possible signature to the candidate glyph with the nearest signature in Hamming distance.
+ */
+uint16_t fib_glyph_signature(char glyph);
+int fib_glyph_shape_table_build(const char *glyphs, char *table);
+
+#endif
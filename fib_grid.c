@@ -0,0 +1,74 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fib_grid.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+static void put_u16(unsigned char *out, uint32_t value) {
+    out[0] = (unsigned char)(value & 0xFFU);
+    out[1] = (unsigned char)((value >> 8) & 0xFFU);
+}
+
+static void put_u32(unsigned char *out, uint32_t value) {
+    put_u16(out, value & 0xFFFFU);
+    put_u16(out + 2, value >> 16);
+}
+
+size_t fib_grid_frame_size(int width, int height) {
+    size_t cells = (size_t)width * (size_t)height;
+    size_t size = FIB_GRID_HEADER_SIZE + cells * 2U;
+    return (size + FIB_GRID_ALIGNMENT - 1U) / FIB_GRID_ALIGNMENT * FIB_GRID_ALIGNMENT;
+}
+
+/* Writes the header and zeroes the padding; the caller fills the glyph and shade arrays. */
+void fib_grid_write_header(unsigned char *frame, int width, int height, int palette, int glyph_mode) {
+    size_t frame_size = fib_grid_frame_size(width, height);
+    size_t used = FIB_GRID_HEADER_SIZE + (size_t)width * (size_t)height * 2U;
+
+    memcpy(frame, FIB_GRID_MAGIC, 4);
+    put_u16(frame + 4, FIB_GRID_VERSION);
+    put_u16(frame + 6, FIB_GRID_HEADER_SIZE);
+    put_u32(frame + 8, (uint32_t)width);
+    put_u32(frame + 12, (uint32_t)height);
+    put_u32(frame + 16, (uint32_t)frame_size);
+    frame[20] = (unsigned char)palette;
+    frame[21] = (unsigned char)glyph_mode;
+    put_u16(frame + 22, 0);
+    memset(frame + used, 0, frame_size - used);
+}
+
+/*
+ * Emits a whole frame with one write(2) on the stream's descriptor (more only if the
+ * kernel accepts it partially, e.g. on a full pipe), after flushing anything buffered.
+ * Memory streams have no descriptor and take the frame through stdio.
+ */
+int fib_grid_emit(FILE *output, const unsigned char *frame, size_t frame_size) {
+    int fd = fileno(output);
+
+    if (fd < 0) {
+        if (fwrite(frame, 1, frame_size, output) != frame_size) {
+            fprintf(stderr, "error: cannot write grid frame\n");
+            return 0;
+        }
+        return 1;
+    }
+    if (fflush(output) != 0) {
+        fprintf(stderr, "error: cannot write grid frame\n");
+        return 0;
+    }
+    while (frame_size > 0) {
+        ssize_t written = write(fd, frame, frame_size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "error: cannot write grid frame: %s\n", strerror(errno));
+            return 0;
+        }
+        frame += written;
+        frame_size -= (size_t)written;
+    }
+    return 1;
+}
@@ -0,0 +1,36 @@
+#ifndef FIB_GRID_H
+#define FIB_GRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define FIB_GRID_MAGIC "FIBG"
+#define FIB_GRID_VERSION 1U
+#define FIB_GRID_HEADER_SIZE 24U
+#define FIB_GRID_ALIGNMENT 8U
+
+/*
+ * One `--format grid` frame, all integers little-endian:
+ *
+ *   0  char[4]  magic "FIBG"
+ *   4  uint16   version
+ *   6  uint16   header_size (offset of the glyph array)
+ *   8  uint32   width in cells
+ *  12  uint32   height in cells
+ *  16  uint32   frame_size (header, both arrays and padding; the next frame starts here)
+ *  20  uint8    palette (FibPalette)
+ *  21  uint8    glyph mode (FibGlyphMode)
+ *  22  uint16   reserved, zero
+ *  24  glyphs[width * height], row-major ASCII
+ *      shades[width * height], row-major gray 0..255
+ *      zero padding up to a multiple of FIB_GRID_ALIGNMENT
+ *
+ * Frames are self-delimiting, so a stream or file of appended frames can be mapped and
+ * walked by frame_size without parsing the arrays.
+ */
+size_t fib_grid_frame_size(int width, int height);
+void fib_grid_write_header(unsigned char *frame, int width, int height, int palette, int glyph_mode);
+int fib_grid_emit(FILE *output, const unsigned char *frame, size_t frame_size);
+
+#endif
@@ -1,21 +1,75 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "fib_image.h"
 
+#include <fcntl.h>
 #include <limits.h>
 #include <setjmp.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <jpeglib.h>
 #include <png.h>
 
-#define FIB_MAX_IMAGE_DIMENSION 16384
+#include "fib_memory.h"
 
 typedef struct {
     struct jpeg_error_mgr jpeg_error;
     jmp_buf jump_buffer;
 } FibJpegError;
 
+/*
+ * Receives decoded gray rows top to bottom. With factor 1 rows are written straight into
+ * the image; otherwise each factor x factor block is box-averaged while decoding so the
+ * full-resolution gray image never exists.
+ */
+typedef struct {
+    FibImage *image;
+    int source_width;
+    int source_height;
+    int factor;
+    int source_row;
+    unsigned char *scratch;
+    uint64_t *accumulator;
+    FibImageRowsFn rows_ready;
+    void *rows_user_data;
+} FibGrayWriter;
+
+typedef struct {
+    int kind;
+    int width;
+    int height;
+    int depth;
+    int maxval;
+    size_t data_offset;
+} FibNetpbmHeader;
+
+typedef struct {
+    unsigned char *row;
+    unsigned char *pass_gray;
+    unsigned char *decode_buffer;
+    png_bytep *rows;
+    FibGrayWriter writer;
+} FibPngDecode;
+
+/* Lives in the caller of the function that calls setjmp, like FibPngDecode. */
+typedef struct {
+    struct jpeg_decompress_struct decoder;
+    FibJpegError error;
+    FibGrayWriter writer;
+} FibJpegDecode;
+
+typedef struct {
+    const unsigned char *bytes;
+    size_t size;
+    size_t position;
+} FibPngMemory;
+
 static int safe_multiply_size(size_t a, size_t b, size_t *out) {
     if (a != 0 && b > SIZE_MAX / a) {
         return 0;
@@ -25,13 +79,19 @@ static int safe_multiply_size(size_t a, size_t b, size_t *out) {
 }
 
 void fib_image_free(FibImage *image) {
-    free(image->pixels);
+    if (image->mapping) {
+        munmap(image->mapping, image->mapping_size);
+    } else {
+        fib_memory_free(image->pixels);
+    }
+    image->mapping = NULL;
+    image->mapping_size = 0;
     image->pixels = NULL;
     image->width = 0;
     image->height = 0;
 }
 
-static int fib_image_allocate(FibImage *image, int width, int height) {
+int fib_image_allocate(FibImage *image, int width, int height) {
     size_t pixel_count = 0;
 
     if (width <= 0 || height <= 0) {
@@ -47,7 +107,13 @@ static int fib_image_allocate(FibImage *image, int width, int height) {
         return 0;
     }
 
-    image->pixels = (unsigned char *)malloc(pixel_count);
+    /* Callers that load repeatedly into one FibImage keep its buffer while the size holds. */
+    if (image->pixels && !image->mapping && image->width == width && image->height == height) {
+        return 1;
+    }
+    fib_image_free(image);
+
+    image->pixels = (unsigned char *)fib_memory_alloc(pixel_count);
     if (!image->pixels) {
         fprintf(stderr, "error: not enough memory for image (%dx%d)\n", width, height);
         return 0;
@@ -62,7 +128,264 @@ static unsigned char alpha_to_white(unsigned char channel, unsigned char alpha)
     return (unsigned char)(((unsigned int)channel * alpha + 255U * (255U - alpha)) / 255U);
 }
 
-static int read_png_image(const char *path, FibImage *image) {
+/*
+ * (299 r + 587 g + 114 b) / 1000, computed as ((sum >> 3) * 33555) >> 22. Both forms agree
+ * for every 8-bit input and the second stays in 32-bit lanes, so the row loops below
+ * auto-vectorize.
+ */
+static unsigned char rgb_to_luma(uint32_t red, uint32_t green, uint32_t blue) {
+    uint32_t weighted = 299U * red + 587U * green + 114U * blue;
+    return (unsigned char)(((weighted >> 3) * 33555U) >> 22);
+}
+
+static void rgb_row_to_gray(const unsigned char *restrict rgb, int width, unsigned char *restrict gray) {
+    for (int x = 0; x < width; x++) {
+        gray[x] = rgb_to_luma(rgb[x * 3 + 0], rgb[x * 3 + 1], rgb[x * 3 + 2]);
+    }
+}
+
+void fib_image_rgba_to_gray(const unsigned char *row, int width, unsigned char *gray) {
+    for (int x = 0; x < width; x++) {
+        unsigned char alpha = row[x * 4 + 3];
+        gray[x] = rgb_to_luma(alpha_to_white(row[x * 4 + 0], alpha), alpha_to_white(row[x * 4 + 1], alpha),
+                              alpha_to_white(row[x * 4 + 2], alpha));
+    }
+}
+
+static void samples_row_to_gray(const unsigned char *source, int width, int channel_count, unsigned char *gray) {
+    if (channel_count == 3) {
+        rgb_row_to_gray(source, width, gray);
+        return;
+    }
+    if (channel_count < 3) {
+        for (int x = 0; x < width; x++) {
+            gray[x] = source[(size_t)x * (size_t)channel_count];
+        }
+        return;
+    }
+    for (int x = 0; x < width; x++) {
+        const unsigned char *pixel = source + (size_t)x * (size_t)channel_count;
+        gray[x] = rgb_to_luma(pixel[0], pixel[1], pixel[2]);
+    }
+}
+
+static int gray_writer_begin(FibGrayWriter *writer, FibImage *image, int width, int height, const FibImageLoadOptions *options) {
+    int factor = options->downscale;
+
+    memset(writer, 0, sizeof(*writer));
+    if (factor < 1) {
+        factor = 1;
+    }
+    if (width <= 0 || height <= 0) {
+        fprintf(stderr, "error: invalid image dimensions\n");
+        return 0;
+    }
+
+    int output_width = width / factor + (width % factor != 0);
+    int output_height = height / factor + (height % factor != 0);
+    if (!fib_image_allocate(image, output_width, output_height)) {
+        return 0;
+    }
+
+    if (factor > 1) {
+        writer->scratch = (unsigned char *)malloc((size_t)width);
+        /* a block of factor^2 pixels sums past 2^32 once factor exceeds 4104 */
+        writer->accumulator = (uint64_t *)calloc((size_t)output_width, sizeof(uint64_t));
+        if (!writer->scratch || !writer->accumulator) {
+            fprintf(stderr, "error: not enough memory for decode-time downscale\n");
+            free(writer->scratch);
+            free(writer->accumulator);
+            writer->scratch = NULL;
+            writer->accumulator = NULL;
+            fib_image_free(image);
+            return 0;
+        }
+    }
+
+    writer->image = image;
+    writer->source_width = width;
+    writer->source_height = height;
+    writer->factor = factor;
+    writer->rows_ready = options->rows_ready;
+    writer->rows_user_data = options->rows_user_data;
+    if (writer->rows_ready) {
+        writer->rows_ready(writer->rows_user_data, image, 0);
+    }
+    return 1;
+}
+
+static unsigned char *gray_writer_row(FibGrayWriter *writer) {
+    if (writer->factor == 1) {
+        return writer->image->pixels + (size_t)writer->source_row * (size_t)writer->source_width;
+    }
+    return writer->scratch;
+}
+
+static void gray_writer_commit(FibGrayWriter *writer) {
+    int factor = writer->factor;
+
+    writer->source_row++;
+    if (factor == 1) {
+        if (writer->rows_ready) {
+            writer->rows_ready(writer->rows_user_data, writer->image, writer->source_row);
+        }
+        return;
+    }
+
+    for (int block = 0, x = 0; x < writer->source_width; block++) {
+        int block_end = x + factor < writer->source_width ? x + factor : writer->source_width;
+        uint32_t sum = 0;
+        for (; x < block_end; x++) {
+            sum += writer->scratch[x];
+        }
+        writer->accumulator[block] += sum;
+    }
+
+    if (writer->source_row % factor != 0 && writer->source_row != writer->source_height) {
+        return;
+    }
+
+    int output_row = (writer->source_row - 1) / factor;
+    uint64_t block_rows = (uint64_t)(writer->source_row - output_row * factor);
+    unsigned char *destination = writer->image->pixels + (size_t)output_row * (size_t)writer->image->width;
+    for (int block = 0; block < writer->image->width; block++) {
+        int block_columns = writer->source_width - block * factor;
+        uint64_t count = block_rows * (uint64_t)(block_columns < factor ? block_columns : factor);
+        destination[block] = (unsigned char)((writer->accumulator[block] + count / 2U) / count);
+        writer->accumulator[block] = 0;
+    }
+    if (writer->rows_ready) {
+        writer->rows_ready(writer->rows_user_data, writer->image, output_row + 1);
+    }
+}
+
+/* Every path that began a writer ends it before the image can be freed. */
+static void gray_writer_end(FibGrayWriter *writer) {
+    if (writer->rows_ready && writer->image) {
+        writer->rows_ready(writer->rows_user_data, writer->image, -1);
+    }
+    writer->rows_ready = NULL;
+    free(writer->scratch);
+    free(writer->accumulator);
+    writer->scratch = NULL;
+    writer->accumulator = NULL;
+}
+
+static void png_decode_release(FibPngDecode *decode) {
+    free(decode->row);
+    free(decode->decode_buffer);
+    free(decode->rows);
+    free(decode->pass_gray);
+    decode->pass_gray = NULL;
+    decode->row = NULL;
+    decode->decode_buffer = NULL;
+    decode->rows = NULL;
+    gray_writer_end(&decode->writer);
+}
+
+/* Grid covered by Adam7 passes 1..n: {step_x, step_y} for n = 1..7. */
+static const int adam7_grid_steps[7][2] = {{8, 8}, {4, 8}, {4, 4}, {2, 4}, {2, 2}, {1, 2}, {1, 1}};
+
+int fib_image_preview_passes(int width, int height, int min_width, int min_height, int *step_x_out, int *step_y_out) {
+    int passes = 7;
+
+    for (int pass = 0; pass < 7; pass++) {
+        int step_x = adam7_grid_steps[pass][0];
+        int step_y = adam7_grid_steps[pass][1];
+        if ((width + step_x - 1) / step_x >= min_width && (height + step_y - 1) / step_y >= min_height) {
+            passes = pass + 1;
+            break;
+        }
+    }
+    *step_x_out = adam7_grid_steps[passes - 1][0];
+    *step_y_out = adam7_grid_steps[passes - 1][1];
+    return passes;
+}
+
+/*
+ * Decodes only the first pass_count Adam7 passes. Together they cover exactly the pixels on
+ * a step_x by step_y grid, which becomes the gray image (box-downscaled afterwards when the
+ * writer asks for it). The later passes, and their share of the zlib stream, are skipped.
+ */
+static int read_adam7_preview(png_structp png_state, int width, int height, int pass_count, int step_x, int step_y,
+                              png_size_t row_bytes, FibPngDecode *decode) {
+    FibGrayWriter *writer = &decode->writer;
+    int grid_width = writer->source_width;
+    int grid_height = writer->source_height;
+    unsigned char *grid = writer->image->pixels;
+
+    decode->row = (unsigned char *)malloc((size_t)row_bytes);
+    decode->pass_gray = (unsigned char *)malloc((size_t)width);
+    if (writer->factor > 1) {
+        decode->decode_buffer = (unsigned char *)malloc((size_t)grid_width * (size_t)grid_height);
+        grid = decode->decode_buffer;
+    }
+    if (!decode->row || !decode->pass_gray || !grid) {
+        fprintf(stderr, "error: not enough memory for png preview decode\n");
+        return 0;
+    }
+
+    for (int pass = 0; pass < pass_count; pass++) {
+        png_uint_32 pass_columns = PNG_PASS_COLS((png_uint_32)width, pass);
+        png_uint_32 pass_rows = PNG_PASS_ROWS((png_uint_32)height, pass);
+        if (pass_columns == 0 || pass_rows == 0) {
+            continue;
+        }
+
+        size_t column_start = (size_t)PNG_PASS_START_COL(pass) / (size_t)step_x;
+        size_t column_step = ((size_t)1 << PNG_PASS_COL_SHIFT(pass)) / (size_t)step_x;
+        size_t row_start = (size_t)PNG_PASS_START_ROW(pass) / (size_t)step_y;
+        size_t row_step = ((size_t)1 << PNG_PASS_ROW_SHIFT(pass)) / (size_t)step_y;
+
+        for (png_uint_32 row = 0; row < pass_rows; row++) {
+            png_read_row(png_state, decode->row, NULL);
+            fib_image_rgba_to_gray(decode->row, (int)pass_columns, decode->pass_gray);
+
+            unsigned char *destination = grid + (row_start + (size_t)row * row_step) * (size_t)grid_width + column_start;
+            for (png_uint_32 column = 0; column < pass_columns; column++) {
+                destination[(size_t)column * column_step] = decode->pass_gray[column];
+            }
+        }
+    }
+
+    if (writer->factor > 1) {
+        for (int y = 0; y < grid_height; y++) {
+            memcpy(gray_writer_row(writer), grid + (size_t)y * (size_t)grid_width, (size_t)grid_width);
+            gray_writer_commit(writer);
+        }
+    } else {
+        /* the passes interleave, so no grid row is final before the last one lands */
+        writer->source_row = grid_height;
+        if (writer->rows_ready) {
+            writer->rows_ready(writer->rows_user_data, writer->image, grid_height);
+        }
+    }
+    return 1;
+}
+
+/* Every PNG color type is expanded to 8-bit RGBA so one row converter handles them all. */
+static void set_rgba_transforms(png_structp png_state, png_infop png_info, int bit_depth, int color_type) {
+    if (bit_depth == 16) {
+        png_set_strip_16(png_state);
+    }
+    if (color_type == PNG_COLOR_TYPE_PALETTE) {
+        png_set_palette_to_rgb(png_state);
+    }
+    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
+        png_set_expand_gray_1_2_4_to_8(png_state);
+    }
+    if (png_get_valid(png_state, png_info, PNG_INFO_tRNS)) {
+        png_set_tRNS_to_alpha(png_state);
+    }
+    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+        png_set_gray_to_rgb(png_state);
+    }
+    if ((color_type & PNG_COLOR_MASK_ALPHA) == 0 && !png_get_valid(png_state, png_info, PNG_INFO_tRNS)) {
+        png_set_filler(png_state, 0xFF, PNG_FILLER_AFTER);
+    }
+}
+
+static int decode_png_file(const char *path, const FibImageLoadOptions *options, FibImage *image, FibPngDecode *decode) {
     FILE *file = fopen(path, "rb");
     if (!file) {
         fprintf(stderr, "error: cannot open file %s\n", path);
@@ -94,6 +417,7 @@ static int read_png_image(const char *path, FibImage *image) {
     if (setjmp(png_jmpbuf(png_state))) {
         fprintf(stderr, "error: png decode failed\n");
         png_destroy_read_struct(&png_state, &png_info, NULL);
+        png_decode_release(decode);
         fib_image_free(image);
         fclose(file);
         return 0;
@@ -107,8 +431,9 @@ static int read_png_image(const char *path, FibImage *image) {
     png_uint_32 height = 0;
     int bit_depth = 0;
     int color_type = 0;
+    int interlace_type = 0;
 
-    png_get_IHDR(png_state, png_info, &width, &height, &bit_depth, &color_type, NULL, NULL, NULL);
+    png_get_IHDR(png_state, png_info, &width, &height, &bit_depth, &color_type, &interlace_type, NULL, NULL);
     if (width == 0 || height == 0 || width > FIB_MAX_IMAGE_DIMENSION || height > FIB_MAX_IMAGE_DIMENSION) {
         fprintf(stderr, "error: png dimensions out of range\n");
         png_destroy_read_struct(&png_state, &png_info, NULL);
@@ -116,23 +441,18 @@ static int read_png_image(const char *path, FibImage *image) {
         return 0;
     }
 
-    if (bit_depth == 16) {
-        png_set_strip_16(png_state);
-    }
-    if (color_type == PNG_COLOR_TYPE_PALETTE) {
-        png_set_palette_to_rgb(png_state);
-    }
-    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
-        png_set_expand_gray_1_2_4_to_8(png_state);
-    }
-    if (png_get_valid(png_state, png_info, PNG_INFO_tRNS)) {
-        png_set_tRNS_to_alpha(png_state);
-    }
-    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
-        png_set_gray_to_rgb(png_state);
+    set_rgba_transforms(png_state, png_info, bit_depth, color_type);
+
+    /* Preview decodes stop after the first Adam7 pass whose grid meets the requested size. */
+    int pass_count = 7;
+    int step_x = 1;
+    int step_y = 1;
+    if (interlace_type != PNG_INTERLACE_NONE && (options->preview_width > 0 || options->preview_height > 0)) {
+        pass_count = fib_image_preview_passes((int)width, (int)height, options->preview_width, options->preview_height, &step_x,
+                                              &step_y);
     }
-    if ((color_type & PNG_COLOR_MASK_ALPHA) == 0 && !png_get_valid(png_state, png_info, PNG_INFO_tRNS)) {
-        png_set_filler(png_state, 0xFF, PNG_FILLER_AFTER);
+    if (interlace_type != PNG_INTERLACE_NONE && pass_count == 7) {
+        png_set_interlace_handling(png_state);
     }
 
     png_read_update_info(png_state, png_info);
@@ -143,64 +463,169 @@ static int read_png_image(const char *path, FibImage *image) {
         return 0;
     }
 
-    png_size_t row_bytes = png_get_rowbytes(png_state, png_info);
-    size_t decode_buffer_size = 0;
-    size_t row_pointer_size = 0;
-    if (!safe_multiply_size((size_t)row_bytes, (size_t)height, &decode_buffer_size) ||
-        !safe_multiply_size(sizeof(png_bytep), (size_t)height, &row_pointer_size)) {
-        fprintf(stderr, "error: png buffer size overflow\n");
+    int grid_width = ((int)width + step_x - 1) / step_x;
+    int grid_height = ((int)height + step_y - 1) / step_y;
+    if (!gray_writer_begin(&decode->writer, image, grid_width, grid_height, options)) {
         png_destroy_read_struct(&png_state, &png_info, NULL);
         fclose(file);
         return 0;
     }
 
-    unsigned char *decode_buffer = (unsigned char *)malloc(decode_buffer_size);
-    png_bytep *rows = (png_bytep *)malloc(row_pointer_size);
-    if (!decode_buffer || !rows) {
-        fprintf(stderr, "error: not enough memory for png decode\n");
-        free(decode_buffer);
-        free(rows);
-        png_destroy_read_struct(&png_state, &png_info, NULL);
-        fclose(file);
-        return 0;
+    /* Non-interlaced images stream one RGBA row at a time; full Adam7 needs the whole frame. */
+    png_size_t row_bytes = png_get_rowbytes(png_state, png_info);
+    if (pass_count < 7) {
+        if (!read_adam7_preview(png_state, (int)width, (int)height, pass_count, step_x, step_y, row_bytes, decode)) {
+            png_decode_release(decode);
+            fib_image_free(image);
+            png_destroy_read_struct(&png_state, &png_info, NULL);
+            fclose(file);
+            return 0;
+        }
+    } else if (interlace_type == PNG_INTERLACE_NONE) {
+        decode->row = (unsigned char *)malloc((size_t)row_bytes);
+        if (!decode->row) {
+            fprintf(stderr, "error: not enough memory for png decode\n");
+            png_decode_release(decode);
+            fib_image_free(image);
+            png_destroy_read_struct(&png_state, &png_info, NULL);
+            fclose(file);
+            return 0;
+        }
+
+        for (png_uint_32 y = 0; y < height; y++) {
+            png_read_row(png_state, decode->row, NULL);
+            fib_image_rgba_to_gray(decode->row, (int)width, gray_writer_row(&decode->writer));
+            gray_writer_commit(&decode->writer);
+        }
+    } else {
+        size_t decode_buffer_size = 0;
+        size_t row_pointer_size = 0;
+        if (!safe_multiply_size((size_t)row_bytes, (size_t)height, &decode_buffer_size) ||
+            !safe_multiply_size(sizeof(png_bytep), (size_t)height, &row_pointer_size)) {
+            fprintf(stderr, "error: png buffer size overflow\n");
+            png_decode_release(decode);
+            fib_image_free(image);
+            png_destroy_read_struct(&png_state, &png_info, NULL);
+            fclose(file);
+            return 0;
+        }
+
+        decode->decode_buffer = (unsigned char *)malloc(decode_buffer_size);
+        decode->rows = (png_bytep *)malloc(row_pointer_size);
+        if (!decode->decode_buffer || !decode->rows) {
+            fprintf(stderr, "error: not enough memory for png decode\n");
+            png_decode_release(decode);
+            fib_image_free(image);
+            png_destroy_read_struct(&png_state, &png_info, NULL);
+            fclose(file);
+            return 0;
+        }
+
+        for (png_uint_32 y = 0; y < height; y++) {
+            decode->rows[y] = decode->decode_buffer + (size_t)y * (size_t)row_bytes;
+        }
+
+        png_read_image(png_state, decode->rows);
+        for (png_uint_32 y = 0; y < height; y++) {
+            fib_image_rgba_to_gray(decode->rows[y], (int)width, gray_writer_row(&decode->writer));
+            gray_writer_commit(&decode->writer);
+        }
     }
 
-    for (png_uint_32 y = 0; y < height; y++) {
-        rows[y] = decode_buffer + (size_t)y * (size_t)row_bytes;
+    if (pass_count == 7) {
+        png_read_end(png_state, NULL);
     }
 
-    png_read_image(png_state, rows);
-    png_read_end(png_state, NULL);
+    png_decode_release(decode);
+    png_destroy_read_struct(&png_state, &png_info, NULL);
+    fclose(file);
+    return 1;
+}
+
+/*
+ * decode outlives decode_png_file's setjmp frame, so the libpng error handler sees the
+ * buffers and row writer as they were at the longjmp rather than indeterminate copies.
+ */
+static int read_png_image(const char *path, const FibImageLoadOptions *options, FibImage *image) {
+    FibPngDecode decode;
+
+    memset(&decode, 0, sizeof(decode));
+    return decode_png_file(path, options, image, &decode);
+}
+
+static void read_png_memory(png_structp png_state, png_bytep data, png_size_t length) {
+    FibPngMemory *source = (FibPngMemory *)png_get_io_ptr(png_state);
+
+    if (length > source->size - source->position) {
+        png_error(png_state, "unexpected end of png stream");
+    }
+    memcpy(data, source->bytes + source->position, length);
+    source->position += length;
+}
 
-    if (!fib_image_allocate(image, (int)width, (int)height)) {
+/*
+ * Decodes an in-memory PNG of exactly width x height into 8-bit RGBA rows (APNG frames are
+ * rebuilt as standalone streams by fib_apng.c). Chunk CRCs are not verified: the caller
+ * synthesizes the IHDR and the IDATs it rewrote from fdAT chunks.
+ */
+int fib_image_decode_png_rgba(const unsigned char *bytes, size_t size, int width, int height, unsigned char *rgba) {
+    FibPngMemory source = {bytes, size, 8};
+
+    if (size < 8 || png_sig_cmp(bytes, 0, 8) != 0) {
+        fprintf(stderr, "error: invalid png signature in frame stream\n");
+        return 0;
+    }
+    png_bytep *rows = (png_bytep *)malloc((size_t)height * sizeof(png_bytep));
+    if (!rows) {
+        fprintf(stderr, "error: not enough memory for png decode\n");
+        return 0;
+    }
+    for (int y = 0; y < height; y++) {
+        rows[y] = rgba + (size_t)y * (size_t)width * 4U;
+    }
+
+    png_structp png_state = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop png_info = png_state ? png_create_info_struct(png_state) : NULL;
+    if (!png_info) {
+        fprintf(stderr, "error: cannot initialize png reader\n");
+        png_destroy_read_struct(&png_state, NULL, NULL);
         free(rows);
-        free(decode_buffer);
+        return 0;
+    }
+    if (setjmp(png_jmpbuf(png_state))) {
+        fprintf(stderr, "error: png frame decode failed\n");
         png_destroy_read_struct(&png_state, &png_info, NULL);
-        fclose(file);
+        free(rows);
         return 0;
     }
 
-    for (png_uint_32 y = 0; y < height; y++) {
-        unsigned char *row = rows[y];
-        for (png_uint_32 x = 0; x < width; x++) {
-            unsigned char red = row[x * 4 + 0];
-            unsigned char green = row[x * 4 + 1];
-            unsigned char blue = row[x * 4 + 2];
-            unsigned char alpha = row[x * 4 + 3];
-
-            red = alpha_to_white(red, alpha);
-            green = alpha_to_white(green, alpha);
-            blue = alpha_to_white(blue, alpha);
+    png_set_read_fn(png_state, &source, read_png_memory);
+    png_set_sig_bytes(png_state, 8);
+    png_set_crc_action(png_state, PNG_CRC_QUIET_USE, PNG_CRC_QUIET_USE);
+    png_read_info(png_state, png_info);
 
-            image->pixels[(size_t)y * (size_t)width + (size_t)x] =
-                (unsigned char)((299U * red + 587U * green + 114U * blue) / 1000U);
-        }
+    png_uint_32 frame_width = 0;
+    png_uint_32 frame_height = 0;
+    int bit_depth = 0;
+    int color_type = 0;
+    int interlace_type = 0;
+    png_get_IHDR(png_state, png_info, &frame_width, &frame_height, &bit_depth, &color_type, &interlace_type, NULL, NULL);
+    set_rgba_transforms(png_state, png_info, bit_depth, color_type);
+    if (interlace_type != PNG_INTERLACE_NONE) {
+        png_set_interlace_handling(png_state);
+    }
+    png_read_update_info(png_state, png_info);
+    if (frame_width != (png_uint_32)width || frame_height != (png_uint_32)height || png_get_channels(png_state, png_info) != 4) {
+        fprintf(stderr, "error: png frame layout mismatch\n");
+        png_destroy_read_struct(&png_state, &png_info, NULL);
+        free(rows);
+        return 0;
     }
+    png_read_image(png_state, rows);
+    png_read_end(png_state, NULL);
 
     free(rows);
-    free(decode_buffer);
     png_destroy_read_struct(&png_state, &png_info, NULL);
-    fclose(file);
     return 1;
 }
 
@@ -209,106 +634,508 @@ static void jpeg_fatal_exit(j_common_ptr jpeg_common) {
     longjmp(error->jump_buffer, 1);
 }
 
-static int read_jpeg_image(const char *path, FibImage *image) {
+static int decode_jpeg_file(const char *path, const FibImageLoadOptions *options, FibImage *image, FibJpegDecode *decode) {
     FILE *file = fopen(path, "rb");
     if (!file) {
         fprintf(stderr, "error: cannot open file %s\n", path);
         return 0;
     }
 
-    struct jpeg_decompress_struct jpeg_decoder;
-    FibJpegError error_state;
-    jpeg_decoder.err = jpeg_std_error(&error_state.jpeg_error);
-    error_state.jpeg_error.error_exit = jpeg_fatal_exit;
+    struct jpeg_decompress_struct *jpeg_decoder = &decode->decoder;
+    FibGrayWriter *writer = &decode->writer;
+    jpeg_decoder->err = jpeg_std_error(&decode->error.jpeg_error);
+    decode->error.jpeg_error.error_exit = jpeg_fatal_exit;
 
-    if (setjmp(error_state.jump_buffer)) {
-        jpeg_destroy_decompress(&jpeg_decoder);
+    if (setjmp(decode->error.jump_buffer)) {
+        jpeg_destroy_decompress(jpeg_decoder);
+        gray_writer_end(writer);
         fib_image_free(image);
         fclose(file);
         fprintf(stderr, "error: jpeg decode failed\n");
         return 0;
     }
 
-    jpeg_create_decompress(&jpeg_decoder);
-    jpeg_stdio_src(&jpeg_decoder, file);
-    jpeg_read_header(&jpeg_decoder, TRUE);
-    jpeg_start_decompress(&jpeg_decoder);
+    jpeg_create_decompress(jpeg_decoder);
+    jpeg_stdio_src(jpeg_decoder, file);
+    jpeg_read_header(jpeg_decoder, TRUE);
+    jpeg_start_decompress(jpeg_decoder);
 
-    if (jpeg_decoder.output_width == 0 || jpeg_decoder.output_height == 0 ||
-        jpeg_decoder.output_width > FIB_MAX_IMAGE_DIMENSION || jpeg_decoder.output_height > FIB_MAX_IMAGE_DIMENSION) {
-        jpeg_finish_decompress(&jpeg_decoder);
-        jpeg_destroy_decompress(&jpeg_decoder);
+    if (jpeg_decoder->output_width == 0 || jpeg_decoder->output_height == 0 ||
+        jpeg_decoder->output_width > FIB_MAX_IMAGE_DIMENSION || jpeg_decoder->output_height > FIB_MAX_IMAGE_DIMENSION) {
+        jpeg_finish_decompress(jpeg_decoder);
+        jpeg_destroy_decompress(jpeg_decoder);
         fclose(file);
         fprintf(stderr, "error: jpeg dimensions out of range\n");
         return 0;
     }
 
-    if (!fib_image_allocate(image, (int)jpeg_decoder.output_width, (int)jpeg_decoder.output_height)) {
-        jpeg_finish_decompress(&jpeg_decoder);
-        jpeg_destroy_decompress(&jpeg_decoder);
+    if (!gray_writer_begin(writer, image, (int)jpeg_decoder->output_width, (int)jpeg_decoder->output_height, options)) {
+        jpeg_finish_decompress(jpeg_decoder);
+        jpeg_destroy_decompress(jpeg_decoder);
         fclose(file);
         return 0;
     }
 
-    int channel_count = jpeg_decoder.output_components;
+    int channel_count = jpeg_decoder->output_components;
     size_t row_bytes = 0;
-    if (channel_count <= 0 || !safe_multiply_size((size_t)jpeg_decoder.output_width, (size_t)channel_count, &row_bytes) ||
+    if (channel_count <= 0 || !safe_multiply_size((size_t)jpeg_decoder->output_width, (size_t)channel_count, &row_bytes) ||
         row_bytes > (size_t)UINT_MAX) {
-        jpeg_finish_decompress(&jpeg_decoder);
-        jpeg_destroy_decompress(&jpeg_decoder);
+        jpeg_finish_decompress(jpeg_decoder);
+        jpeg_destroy_decompress(jpeg_decoder);
+        gray_writer_end(writer);
         fib_image_free(image);
         fclose(file);
         fprintf(stderr, "error: jpeg row size overflow\n");
         return 0;
     }
 
-    JSAMPARRAY row = (*jpeg_decoder.mem->alloc_sarray)((j_common_ptr)&jpeg_decoder, JPOOL_IMAGE, (JDIMENSION)row_bytes, 1);
+    JSAMPARRAY row = (*jpeg_decoder->mem->alloc_sarray)((j_common_ptr)jpeg_decoder, JPOOL_IMAGE, (JDIMENSION)row_bytes, 1);
+
+    while (jpeg_decoder->output_scanline < jpeg_decoder->output_height) {
+        jpeg_read_scanlines(jpeg_decoder, row, 1);
+        samples_row_to_gray(row[0], (int)jpeg_decoder->output_width, channel_count, gray_writer_row(writer));
+        gray_writer_commit(writer);
+    }
+
+    jpeg_finish_decompress(jpeg_decoder);
+    jpeg_destroy_decompress(jpeg_decoder);
+    gray_writer_end(writer);
+    fclose(file);
+    return 1;
+}
 
-    size_t y = 0;
-    while (jpeg_decoder.output_scanline < jpeg_decoder.output_height) {
-        jpeg_read_scanlines(&jpeg_decoder, row, 1);
-        unsigned char *source = row[0];
+static int read_jpeg_image(const char *path, const FibImageLoadOptions *options, FibImage *image) {
+    FibJpegDecode decode;
 
-        for (size_t x = 0; x < jpeg_decoder.output_width; x++) {
-            unsigned int luminance = 0;
-            if (channel_count >= 3) {
-                unsigned char red = source[x * (size_t)channel_count + 0];
-                unsigned char green = source[x * (size_t)channel_count + 1];
-                unsigned char blue = source[x * (size_t)channel_count + 2];
-                luminance = (299U * red + 587U * green + 114U * blue) / 1000U;
-            } else {
-                luminance = source[x * (size_t)channel_count + 0];
+    memset(&decode, 0, sizeof(decode));
+    return decode_jpeg_file(path, options, image, &decode);
+}
+
+static int netpbm_skip_space(const unsigned char *bytes, size_t size, size_t *position) {
+    while (*position < size) {
+        unsigned char c = bytes[*position];
+        if (c == '#') {
+            while (*position < size && bytes[*position] != '\n') {
+                (*position)++;
             }
+        } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') {
+            (*position)++;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
 
-            image->pixels[y * jpeg_decoder.output_width + x] = (unsigned char)luminance;
+static int netpbm_read_number(const unsigned char *bytes, size_t size, size_t *position, int *value) {
+    long number = 0;
+    size_t start = *position;
+
+    while (*position < size && bytes[*position] >= '0' && bytes[*position] <= '9') {
+        number = number * 10 + (bytes[*position] - '0');
+        if (number > 1000000L) {
+            return 0;
         }
-        y++;
+        (*position)++;
     }
+    *value = (int)number;
+    return *position > start;
+}
 
-    jpeg_finish_decompress(&jpeg_decoder);
-    jpeg_destroy_decompress(&jpeg_decoder);
-    fclose(file);
+/* PAM header: "KEY value" lines up to ENDHDR, with # comment lines. */
+static int parse_pam_header(const unsigned char *bytes, size_t size, FibNetpbmHeader *header) {
+    size_t position = 3;
+
+    header->depth = 0;
+    while (position < size) {
+        size_t line_end = position;
+        while (line_end < size && bytes[line_end] != '\n') {
+            line_end++;
+        }
+        if (line_end == size) {
+            return 0;
+        }
+
+        size_t key_end = position;
+        while (key_end < line_end && bytes[key_end] != ' ' && bytes[key_end] != '\t') {
+            key_end++;
+        }
+        size_t key_length = key_end - position;
+        size_t value = key_end;
+        while (value < line_end && (bytes[value] == ' ' || bytes[value] == '\t')) {
+            value++;
+        }
+
+        int *field = NULL;
+        if (key_length == 6 && memcmp(bytes + position, "ENDHDR", 6) == 0) {
+            header->data_offset = line_end + 1;
+            return 1;
+        } else if (key_length == 5 && memcmp(bytes + position, "WIDTH", 5) == 0) {
+            field = &header->width;
+        } else if (key_length == 6 && memcmp(bytes + position, "HEIGHT", 6) == 0) {
+            field = &header->height;
+        } else if (key_length == 5 && memcmp(bytes + position, "DEPTH", 5) == 0) {
+            field = &header->depth;
+        } else if (key_length == 6 && memcmp(bytes + position, "MAXVAL", 6) == 0) {
+            field = &header->maxval;
+        }
+        if (field && !netpbm_read_number(bytes, line_end, &value, field)) {
+            return 0;
+        }
+        position = line_end + 1;
+    }
+    return 0;
+}
+
+static int parse_netpbm_header(const unsigned char *bytes, size_t size, FibNetpbmHeader *header) {
+    memset(header, 0, sizeof(*header));
+    if (size < 3 || bytes[0] != 'P' || (bytes[1] != '5' && bytes[1] != '6' && bytes[1] != '7')) {
+        return 0;
+    }
+    header->kind = bytes[1];
+
+    if (header->kind == '7') {
+        if (!parse_pam_header(bytes, size, header)) {
+            return 0;
+        }
+    } else {
+        size_t position = 2;
+        header->depth = header->kind == '5' ? 1 : 3;
+        if (!netpbm_skip_space(bytes, size, &position) || !netpbm_read_number(bytes, size, &position, &header->width) ||
+            !netpbm_skip_space(bytes, size, &position) || !netpbm_read_number(bytes, size, &position, &header->height) ||
+            !netpbm_skip_space(bytes, size, &position) || !netpbm_read_number(bytes, size, &position, &header->maxval) ||
+            position >= size) {
+            return 0;
+        }
+        /* Exactly one whitespace byte separates maxval from the raster. */
+        header->data_offset = position + 1;
+    }
+
+    return header->depth >= 1 && header->depth <= 4 && header->maxval >= 1 && header->maxval <= 65535;
+}
+
+static size_t netpbm_row_bytes(const FibNetpbmHeader *header) {
+    size_t sample_bytes = header->maxval > 255 ? 2U : 1U;
+    return (size_t)header->width * (size_t)header->depth * sample_bytes;
+}
+
+/* Maps the whole file read-only and validates the header against the mapped size. */
+static int map_netpbm(const char *path, FibNetpbmHeader *header, unsigned char **mapping_out, size_t *size_out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "error: cannot open file %s\n", path);
+        return 0;
+    }
+
+    struct stat file_status;
+    if (fstat(fd, &file_status) != 0 || file_status.st_size <= 0) {
+        fprintf(stderr, "error: cannot stat file %s\n", path);
+        close(fd);
+        return 0;
+    }
+
+    size_t size = (size_t)file_status.st_size;
+    /* writable but private: a caller writing to zero-copy pixels gets its own copy of the page */
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "error: cannot map file %s\n", path);
+        return 0;
+    }
+
+    const unsigned char *bytes = (const unsigned char *)mapping;
+    size_t raster_bytes = 0;
+    if (!parse_netpbm_header(bytes, size, header)) {
+        fprintf(stderr, "error: malformed netpbm header: %s\n", path);
+        munmap(mapping, size);
+        return 0;
+    }
+    if (header->width <= 0 || header->height <= 0 || header->width > FIB_MAX_IMAGE_DIMENSION ||
+        header->height > FIB_MAX_IMAGE_DIMENSION) {
+        fprintf(stderr, "error: netpbm dimensions out of range\n");
+        munmap(mapping, size);
+        return 0;
+    }
+    if (!safe_multiply_size(netpbm_row_bytes(header), (size_t)header->height, &raster_bytes) ||
+        header->data_offset > size || size - header->data_offset < raster_bytes) {
+        fprintf(stderr, "error: truncated netpbm raster: %s\n", path);
+        munmap(mapping, size);
+        return 0;
+    }
+
+    *mapping_out = (unsigned char *)mapping;
+    *size_out = size;
     return 1;
 }
 
-int fib_image_load(const char *path, FibImage *image) {
+static int netpbm_is_zero_copy(const FibNetpbmHeader *header, int downscale) {
+    return header->depth == 1 && header->maxval == 255 && downscale == 1;
+}
+
+/* Scales one row of samples to 8 bits; 16-bit samples are big-endian. */
+static void netpbm_scale_row(const unsigned char *source, size_t sample_count, int maxval, unsigned char *destination) {
+    uint32_t half = (uint32_t)maxval / 2U;
+
+    if (maxval > 255) {
+        for (size_t i = 0; i < sample_count; i++) {
+            uint32_t sample = ((uint32_t)source[i * 2] << 8) | source[i * 2 + 1];
+            destination[i] = (unsigned char)((sample * 255U + half) / (uint32_t)maxval);
+        }
+        return;
+    }
+    for (size_t i = 0; i < sample_count; i++) {
+        destination[i] = (unsigned char)(((uint32_t)source[i] * 255U + half) / (uint32_t)maxval);
+    }
+}
+
+static void netpbm_row_to_gray(const unsigned char *samples, int width, int depth, unsigned char *gray) {
+    switch (depth) {
+        case 1:
+            memcpy(gray, samples, (size_t)width);
+            break;
+        case 2:
+            for (int x = 0; x < width; x++) {
+                gray[x] = alpha_to_white(samples[x * 2], samples[x * 2 + 1]);
+            }
+            break;
+        case 3:
+            rgb_row_to_gray(samples, width, gray);
+            break;
+        default:
+            fib_image_rgba_to_gray(samples, width, gray);
+            break;
+    }
+}
+
+/*
+ * Binary PGM/PPM/PAM. An 8-bit single-channel raster at full resolution is used in place:
+ * the image keeps the file mapping and pixels points at the raster. Everything else is
+ * converted row by row straight out of the mapping.
+ */
+static int read_netpbm_image(const char *path, const FibImageLoadOptions *options, FibImage *image) {
+    FibNetpbmHeader header;
+    unsigned char *mapping = NULL;
+    size_t mapping_size = 0;
+
+    if (!map_netpbm(path, &header, &mapping, &mapping_size)) {
+        return 0;
+    }
+
+    if (netpbm_is_zero_copy(&header, options->downscale) && !options->private_pixels) {
+        fib_image_free(image);
+        image->mapping = mapping;
+        image->mapping_size = mapping_size;
+        image->pixels = mapping + header.data_offset;
+        image->width = header.width;
+        image->height = header.height;
+        return 1;
+    }
+
+    posix_madvise(mapping, mapping_size, POSIX_MADV_SEQUENTIAL);
+
+    FibGrayWriter writer;
+    unsigned char *samples = NULL;
+    size_t row_bytes = netpbm_row_bytes(&header);
+    size_t sample_count = (size_t)header.width * (size_t)header.depth;
+    int direct = header.maxval == 255;
+
+    if (!direct) {
+        samples = (unsigned char *)malloc(sample_count);
+        if (!samples) {
+            fprintf(stderr, "error: not enough memory for netpbm row\n");
+            munmap(mapping, mapping_size);
+            return 0;
+        }
+    }
+    if (!gray_writer_begin(&writer, image, header.width, header.height, options)) {
+        free(samples);
+        munmap(mapping, mapping_size);
+        return 0;
+    }
+
+    const unsigned char *row = mapping + header.data_offset;
+    for (int y = 0; y < header.height; y++, row += row_bytes) {
+        const unsigned char *row_samples = row;
+        if (!direct) {
+            netpbm_scale_row(row, sample_count, header.maxval, samples);
+            row_samples = samples;
+        }
+        netpbm_row_to_gray(row_samples, header.width, header.depth, gray_writer_row(&writer));
+        gray_writer_commit(&writer);
+    }
+
+    gray_writer_end(&writer);
+    free(samples);
+    munmap(mapping, mapping_size);
+    return 1;
+}
+
+static int sniff_format(const char *path, unsigned char *header, size_t header_size, FibImageFormat *format_out) {
     FILE *file = fopen(path, "rb");
     if (!file) {
         fprintf(stderr, "error: cannot open file %s\n", path);
         return 0;
     }
 
-    unsigned char header[8] = {0};
-    size_t bytes_read = fread(header, 1, sizeof(header), file);
+    memset(header, 0, header_size);
+    size_t bytes_read = fread(header, 1, header_size, file);
     fclose(file);
 
     if (bytes_read >= 8 && png_sig_cmp(header, 0, 8) == 0) {
-        return read_png_image(path, image);
+        *format_out = FIB_IMAGE_FORMAT_PNG;
+        return 1;
     }
     if (bytes_read >= 3 && header[0] == 0xFF && header[1] == 0xD8 && header[2] == 0xFF) {
-        return read_jpeg_image(path, image);
+        *format_out = FIB_IMAGE_FORMAT_JPEG;
+        return 1;
+    }
+
+    if (bytes_read >= 3 && header[0] == 'P' && (header[1] == '5' || header[1] == '6' || header[1] == '7') &&
+        (header[2] == ' ' || header[2] == '\t' || header[2] == '\n' || header[2] == '\r')) {
+        *format_out = FIB_IMAGE_FORMAT_NETPBM;
+        return 1;
     }
 
-    fprintf(stderr, "error: unsupported format, use png/jpg/jpeg\n");
+    fprintf(stderr, "error: unsupported format, use png/jpg/jpeg/pgm/ppm/pam\n");
     return 0;
 }
+
+static uint32_t read_be32(const unsigned char *bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+static int probe_jpeg_file(const char *path, FibImageInfo *info, FibJpegDecode *decode) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "error: cannot open file %s\n", path);
+        return 0;
+    }
+
+    struct jpeg_decompress_struct *jpeg_decoder = &decode->decoder;
+    jpeg_decoder->err = jpeg_std_error(&decode->error.jpeg_error);
+    decode->error.jpeg_error.error_exit = jpeg_fatal_exit;
+
+    if (setjmp(decode->error.jump_buffer)) {
+        jpeg_destroy_decompress(jpeg_decoder);
+        fclose(file);
+        fprintf(stderr, "error: jpeg header read failed\n");
+        return 0;
+    }
+
+    jpeg_create_decompress(jpeg_decoder);
+    jpeg_stdio_src(jpeg_decoder, file);
+    jpeg_read_header(jpeg_decoder, TRUE);
+    jpeg_calc_output_dimensions(jpeg_decoder);
+
+    info->width = (int)jpeg_decoder->output_width;
+    info->height = (int)jpeg_decoder->output_height;
+    info->interlaced = jpeg_decoder->progressive_mode ? 1 : 0;
+    info->decode_row_bytes = (size_t)jpeg_decoder->output_width * (size_t)jpeg_decoder->output_components;
+
+    jpeg_destroy_decompress(jpeg_decoder);
+    fclose(file);
+    return 1;
+}
+
+static int probe_jpeg(const char *path, FibImageInfo *info) {
+    FibJpegDecode decode;
+
+    memset(&decode, 0, sizeof(decode));
+    return probe_jpeg_file(path, info, &decode);
+}
+
+int fib_image_probe(const char *path, FibImageInfo *info) {
+    unsigned char header[33];
+
+    memset(info, 0, sizeof(*info));
+    if (!sniff_format(path, header, sizeof(header), &info->format)) {
+        return 0;
+    }
+
+    if (info->format == FIB_IMAGE_FORMAT_JPEG) {
+        if (!probe_jpeg(path, info)) {
+            return 0;
+        }
+    } else if (info->format == FIB_IMAGE_FORMAT_NETPBM) {
+        FibNetpbmHeader netpbm;
+        unsigned char *mapping = NULL;
+        size_t mapping_size = 0;
+        if (!map_netpbm(path, &netpbm, &mapping, &mapping_size)) {
+            return 0;
+        }
+        munmap(mapping, mapping_size);
+        info->width = netpbm.width;
+        info->height = netpbm.height;
+        info->zero_copy = netpbm_is_zero_copy(&netpbm, 1);
+        info->decode_row_bytes = netpbm.maxval == 255 ? 0 : (size_t)netpbm.width * (size_t)netpbm.depth;
+    } else {
+        if (memcmp(header + 12, "IHDR", 4) != 0) {
+            fprintf(stderr, "error: png header missing IHDR: %s\n", path);
+            return 0;
+        }
+        uint32_t width = read_be32(header + 16);
+        uint32_t height = read_be32(header + 20);
+        info->width = width > FIB_MAX_IMAGE_DIMENSION ? FIB_MAX_IMAGE_DIMENSION + 1 : (int)width;
+        info->height = height > FIB_MAX_IMAGE_DIMENSION ? FIB_MAX_IMAGE_DIMENSION + 1 : (int)height;
+        info->interlaced = header[28] != 0;
+        info->decode_row_bytes = (size_t)info->width * 4U;
+    }
+
+    if (info->width <= 0 || info->height <= 0 || info->width > FIB_MAX_IMAGE_DIMENSION || info->height > FIB_MAX_IMAGE_DIMENSION) {
+        fprintf(stderr, "error: image dimensions out of range\n");
+        return 0;
+    }
+    return 1;
+}
+
+size_t fib_image_decode_bytes(const FibImageInfo *info) {
+    size_t frame_bytes = 0;
+
+    if (info->format == FIB_IMAGE_FORMAT_PNG && info->interlaced) {
+        if (!safe_multiply_size(info->decode_row_bytes + sizeof(void *), (size_t)info->height, &frame_bytes)) {
+            return SIZE_MAX;
+        }
+        return frame_bytes;
+    }
+    return info->decode_row_bytes;
+}
+
+const char *fib_image_format_name(FibImageFormat format) {
+    switch (format) {
+        case FIB_IMAGE_FORMAT_JPEG:
+            return "jpeg";
+        case FIB_IMAGE_FORMAT_NETPBM:
+            return "netpbm";
+        case FIB_IMAGE_FORMAT_PNG:
+        default:
+            return "png";
+    }
+}
+
+int fib_image_load_with_options(const char *path, const FibImageLoadOptions *options, FibImage *image) {
+    unsigned char header[8];
+    FibImageFormat format = FIB_IMAGE_FORMAT_PNG;
+    FibImageLoadOptions resolved = {1, 0, 0, NULL, NULL, 0};
+
+    if (options) {
+        resolved = *options;
+    }
+    if (resolved.downscale < 1) {
+        resolved.downscale = 1;
+    }
+
+    if (!sniff_format(path, header, sizeof(header), &format)) {
+        return 0;
+    }
+    if (format == FIB_IMAGE_FORMAT_PNG) {
+        return read_png_image(path, &resolved, image);
+    }
+    if (format == FIB_IMAGE_FORMAT_NETPBM) {
+        return read_netpbm_image(path, &resolved, image);
+    }
+    return read_jpeg_image(path, &resolved, image);
+}
+
+int fib_image_load(const char *path, FibImage *image) {
+    return fib_image_load_with_options(path, NULL, image);
+}
@@ -1,13 +1,72 @@
 #ifndef FIB_IMAGE_H
 #define FIB_IMAGE_H
 
+#include <stddef.h>
+
+#define FIB_MAX_IMAGE_DIMENSION 16384
+
+/*
+ * 8-bit gray image. When mapping is set, pixels points into a private file mapping
+ * (zero-copy netpbm input) and fib_image_free unmaps it instead of calling free. Writes
+ * to such pixels are copy-on-write and never reach the file, but the pages still read
+ * from it: truncating the file while it is mapped makes reads past the new end raise
+ * SIGBUS, so callers that keep an image while its file may change load with
+ * private_pixels.
+ */
 typedef struct {
     int width;
     int height;
     unsigned char *pixels;
+    void *mapping;
+    size_t mapping_size;
 } FibImage;
 
+typedef enum {
+    FIB_IMAGE_FORMAT_PNG = 0,
+    FIB_IMAGE_FORMAT_JPEG,
+    FIB_IMAGE_FORMAT_NETPBM
+} FibImageFormat;
+
+typedef struct {
+    FibImageFormat format;
+    int width;
+    int height;
+    int interlaced;
+    int zero_copy;
+    size_t decode_row_bytes;
+} FibImageInfo;
+
+/*
+ * Decode progress: called with row_end 0 once the image is allocated, with the number of
+ * finished rows at the top of image->pixels as they land, and with -1 once the decoder is
+ * done with the image, whether it succeeded or not and before a failed load frees it.
+ */
+typedef void (*FibImageRowsFn)(void *user_data, const FibImage *image, int row_end);
+
+/*
+ * downscale box-averages factor x factor blocks while decoding. A non-zero preview size lets
+ * an Adam7 PNG stop after the earliest pass whose pixel grid is at least that large.
+ * rows_ready, when set, follows the decode row by row (zero-copy netpbm input never calls it).
+ * private_pixels copies a raster that would be used in place into private memory.
+ */
+typedef struct {
+    int downscale;
+    int preview_width;
+    int preview_height;
+    FibImageRowsFn rows_ready;
+    void *rows_user_data;
+    int private_pixels;
+} FibImageLoadOptions;
+
 void fib_image_free(FibImage *image);
+int fib_image_allocate(FibImage *image, int width, int height);
 int fib_image_load(const char *path, FibImage *image);
+int fib_image_load_with_options(const char *path, const FibImageLoadOptions *options, FibImage *image);
+int fib_image_probe(const char *path, FibImageInfo *info);
+size_t fib_image_decode_bytes(const FibImageInfo *info);
+const char *fib_image_format_name(FibImageFormat format);
+void fib_image_rgba_to_gray(const unsigned char *row, int width, unsigned char *gray);
+int fib_image_decode_png_rgba(const unsigned char *bytes, size_t size, int width, int height, unsigned char *rgba);
+int fib_image_preview_passes(int width, int height, int min_width, int min_height, int *step_x_out, int *step_y_out);
 
 #endif
@@ -0,0 +1,493 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fib_live.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "fib.h"
+#include "fib_image.h"
+#include "fib_plan.h"
+#include "fib_shm.h"
+
+#define FIB_WATCH_DEBOUNCE_MS 8
+#define FIB_RESIZE_COALESCE_MS 4
+#define FIB_RESIZE_COALESCE_LIMIT_MS 12
+#define FIB_SHM_POLL_MS 2 /* only when the ring has no frame_ready semaphore */
+#define FIB_LIVE_STREAM_BUFFER_SIZE ((size_t)1 << 20)
+
+static volatile sig_atomic_t g_stop_requested = 0;
+static int g_resize_pipe[2] = {-1, -1};
+static FibShmRing *volatile g_waiting_ring = NULL;
+static char g_stream_buffer[FIB_LIVE_STREAM_BUFFER_SIZE];
+
+typedef struct {
+    const char *input_path;
+    const char *output_path;
+    const FibRenderConfig *config;
+    FibRenderConfig runtime_config;
+    FibRenderContext context;
+    FibImage image;
+    FibImageInfo planned_info;
+    FibPlan plan;
+    FibShmRing ring;
+    int use_shm;
+    int has_image;
+    int frame_count;
+    int overwrite_in_place;
+    int repaint_all;
+} FibLiveSession;
+
+/* Ends a consumer wait on the frame ring, including one that has not started yet. */
+static void interrupt_ring_wait(void) {
+    FibShmRing *ring = g_waiting_ring;
+    if (ring) {
+        fib_shm_interrupt(ring);
+    }
+}
+
+static void request_stop(int signal_number) {
+    int saved_errno = errno;
+
+    (void)signal_number;
+    g_stop_requested = 1;
+    interrupt_ring_wait();
+    errno = saved_errno;
+}
+
+static void notify_resize(int signal_number) {
+    int saved_errno = errno;
+    char token = 1;
+
+    (void)signal_number;
+    if (write(g_resize_pipe[1], &token, 1) < 0) {
+        /* pipe full: a wakeup is already pending */
+    }
+    interrupt_ring_wait();
+    errno = saved_errno;
+}
+
+static void install_handler(int signal_number, void (*handler)(int)) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(signal_number, &action, NULL);
+}
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1000.0 + (double)(now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/* Terminal size in cells, keeping the last row free so the frame never scrolls. */
+static int query_terminal_size(int *width_out, int *height_out) {
+    struct winsize size;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0 || size.ws_col == 0 || size.ws_row < 2) {
+        return 0;
+    }
+    *width_out = (int)size.ws_col;
+    *height_out = (int)size.ws_row - 1;
+    return 1;
+}
+
+/*
+ * Points the session image at the newest frame in the ring; the pixels stay in shared
+ * memory. Returns 1 only when there is a newer frame than the one on display.
+ */
+static int load_shm_frame(FibLiveSession *session) {
+    uint64_t skipped = 0;
+    int acquired = fib_shm_acquire_latest(&session->ring, &session->image, &skipped);
+
+    if (acquired < 0) {
+        memset(&session->image, 0, sizeof(session->image));
+        session->has_image = 0;
+        return 0;
+    }
+    if (acquired == 0) {
+        return 0;
+    }
+    if (session->config->verbose) {
+        fprintf(stderr, "fib: shm frame %llu (%dx%d), %llu stale skipped\n", (unsigned long long)session->ring.sequence,
+                session->image.width, session->image.height, (unsigned long long)skipped);
+    }
+    session->has_image = 1;
+    fib_render_context_invalidate(&session->context);
+    return 1;
+}
+
+/* Decodes the input with a plan made for the current output size, which --fit sets from the terminal. */
+static int load_frame(FibLiveSession *session) {
+    FibRenderConfig plan_config = *session->config;
+    FibRenderConfig runtime_config;
+
+    if (session->use_shm) {
+        return load_shm_frame(session);
+    }
+
+    plan_config.output_width = session->runtime_config.output_width;
+    plan_config.output_height = session->runtime_config.output_height;
+    runtime_config = plan_config;
+    if (!fib_load_planned_image(session->input_path, &plan_config, &session->image, &runtime_config, NULL, &session->planned_info,
+                                &session->plan)) {
+        /* a failed decode may already have released the previous frame */
+        session->has_image = session->image.pixels != NULL;
+        return 0;
+    }
+    session->runtime_config = runtime_config;
+    session->has_image = 1;
+    fib_render_context_invalidate(&session->context);
+    return 1;
+}
+
+/* Runs only the render loop; decode and analysis stay cached in the session. */
+static void paint_frame(FibLiveSession *session, const struct timespec *start) {
+    FibRenderConfig *runtime_config = &session->runtime_config;
+    FILE *output = stdout;
+
+    if (!session->has_image) {
+        return;
+    }
+    if (session->output_path) {
+        output = fib_open_output(session->output_path, session->config);
+        if (!output) {
+            return;
+        }
+    }
+    runtime_config->enable_color = fib_should_enable_color(runtime_config->color_mode, session->output_path != NULL);
+
+    /* Incremental frames on a terminal rewrite only their changed rows, in place. */
+    int changed_rows_only = session->config->incremental && session->overwrite_in_place && session->frame_count > 0 &&
+                            !session->repaint_all;
+    if (session->overwrite_in_place && !changed_rows_only) {
+        fputs(session->frame_count == 0 ? "\x1b[2J\x1b[H" : "\x1b[H", output);
+    }
+    if (session->config->incremental) {
+        fib_render_context_update(&session->context, &session->image, runtime_config, NULL, 0, changed_rows_only,
+                                  fib_render_context_stream_sink(&session->context, output));
+    } else {
+        fib_render_context_draw(&session->context, &session->image, runtime_config, output);
+    }
+    if (changed_rows_only) {
+        fprintf(output, "\x1b[%d;1H", runtime_config->output_height + 1);
+    } else if (session->overwrite_in_place) {
+        fputs("\x1b[J", output);
+    }
+    session->repaint_all = 0;
+
+    if (session->output_path) {
+        fclose(output);
+    } else {
+        fflush(output);
+    }
+    session->frame_count++;
+
+    if (session->config->verbose && session->config->incremental) {
+        fprintf(stderr, "fib: frame %d (%dx%d) rendered in %.2f ms, %d rows redrawn, %d changed\n", session->frame_count,
+                runtime_config->output_width, runtime_config->output_height, elapsed_ms(start),
+                session->context.history.rows_drawn, session->context.history.rows_changed);
+    } else if (session->config->verbose) {
+        fprintf(stderr, "fib: frame %d (%dx%d) rendered in %.2f ms\n", session->frame_count, runtime_config->output_width,
+                runtime_config->output_height, elapsed_ms(start));
+    }
+}
+
+static void reload_and_paint(FibLiveSession *session) {
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (load_frame(session)) {
+        paint_frame(session, &start);
+    }
+}
+
+static int drain_resize_pipe(void) {
+    char tokens[64];
+    int drained = 0;
+
+    while (read(g_resize_pipe[0], tokens, sizeof(tokens)) > 0) {
+        drained = 1;
+    }
+    return drained;
+}
+
+/*
+ * A window drag delivers a storm of SIGWINCH. Absorb signals until the terminal has been
+ * quiet for FIB_RESIZE_COALESCE_MS, but never longer than one frame, then repaint once at
+ * the final size.
+ */
+static void handle_resize(FibLiveSession *session) {
+    struct timespec start;
+    int width = 0;
+    int height = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    drain_resize_pipe();
+    while (!g_stop_requested && elapsed_ms(&start) < FIB_RESIZE_COALESCE_LIMIT_MS) {
+        struct pollfd resize_poll = {g_resize_pipe[0], POLLIN, 0};
+        if (poll(&resize_poll, 1, FIB_RESIZE_COALESCE_MS) <= 0 || !drain_resize_pipe()) {
+            break;
+        }
+    }
+
+    if (!query_terminal_size(&width, &height)) {
+        return;
+    }
+    if (width == session->runtime_config.output_width && height == session->runtime_config.output_height) {
+        return;
+    }
+    session->runtime_config.output_width = width;
+    session->runtime_config.output_height = height;
+    session->repaint_all = 1;
+
+    /* the cached image was decoded for the old size; decode again when its plan no longer holds */
+    if (!session->use_shm && session->has_image &&
+        !fib_plan_holds(&session->planned_info, &session->runtime_config, &session->plan)) {
+        if (session->config->verbose) {
+            fprintf(stderr, "fib: plan does not hold at %dx%d, planning again\n", width, height);
+        }
+        if (load_frame(session)) {
+            paint_frame(session, &start);
+        }
+        return;
+    }
+    paint_frame(session, &start);
+}
+
+#ifdef __linux__
+static int split_watch_path(const char *path, char *directory, size_t directory_size, const char **name_out) {
+    const char *slash = strrchr(path, '/');
+
+    if (!slash) {
+        snprintf(directory, directory_size, ".");
+        *name_out = path;
+        return 1;
+    }
+
+    size_t length = (size_t)(slash - path);
+    if (length == 0) {
+        length = 1;
+    }
+    if (length >= directory_size) {
+        return 0;
+    }
+    memcpy(directory, path, length);
+    directory[length] = '\0';
+    *name_out = slash + 1;
+    return 1;
+}
+
+static int open_watch(const char *input_path, const char **name_out) {
+    char directory[PATH_MAX];
+
+    if (!split_watch_path(input_path, directory, sizeof(directory), name_out) || (*name_out)[0] == '\0') {
+        fprintf(stderr, "error: cannot watch path %s\n", input_path);
+        return -1;
+    }
+
+    int watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd < 0 || inotify_add_watch(watch_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "error: cannot watch %s: %s\n", directory, strerror(errno));
+        if (watch_fd >= 0) {
+            close(watch_fd);
+        }
+        return -1;
+    }
+    return watch_fd;
+}
+
+/* Returns 1 when an event in the batch names the watched file. */
+static int drain_watch_events(int watch_fd, const char *name) {
+    _Alignas(struct inotify_event) char buffer[4096];
+    int matched = 0;
+
+    for (;;) {
+        ssize_t length = read(watch_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return matched;
+        }
+        for (char *cursor = buffer; cursor < buffer + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)cursor;
+            if (event->len > 0 && strcmp(event->name, name) == 0) {
+                matched = 1;
+            }
+            cursor += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+#else
+static int open_watch(const char *input_path, const char **name_out) {
+    (void)input_path;
+    (void)name_out;
+    fprintf(stderr, "error: --watch requires inotify (Linux)\n");
+    return -1;
+}
+
+static int drain_watch_events(int watch_fd, const char *name) {
+    (void)watch_fd;
+    (void)name;
+    return 0;
+}
+#endif
+
+static int open_resize_pipe(void) {
+    if (pipe(g_resize_pipe) != 0) {
+        fprintf(stderr, "error: cannot create resize pipe: %s\n", strerror(errno));
+        return 0;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(g_resize_pipe[i], F_SETFL, fcntl(g_resize_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(g_resize_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    install_handler(SIGWINCH, notify_resize);
+    return 1;
+}
+
+/*
+ * Event loop shared by --watch, --fit and --shm. File events are debounced for
+ * FIB_WATCH_DEBOUNCE_MS and trigger a decode plus render; resize events only re-run the
+ * render loop against the cached image, tables and tone curve. With --shm the loop sleeps
+ * on the ring's frame_ready semaphore, which the producer posts after publishing and the
+ * signal handlers post to deliver stop and resize; the resize pipe is then only drained.
+ * Without the semaphore the ring is polled every FIB_SHM_POLL_MS.
+ * Only the newest frame is ever rendered.
+ */
+static void run_event_loop(FibLiveSession *session, int watch_fd, const char *watch_name, int track_resize) {
+    int watch_pending = 0;
+
+    while (!g_stop_requested) {
+        struct pollfd polls[2];
+        int poll_count = 0;
+        int watch_index = -1;
+        int resize_index = -1;
+
+        if (watch_fd >= 0) {
+            watch_index = poll_count;
+            polls[poll_count++] = (struct pollfd){watch_fd, POLLIN, 0};
+        }
+        if (track_resize) {
+            resize_index = poll_count;
+            polls[poll_count++] = (struct pollfd){g_resize_pipe[0], POLLIN, 0};
+        }
+
+        int timeout = -1;
+        if (watch_pending) {
+            timeout = FIB_WATCH_DEBOUNCE_MS;
+        } else if (session->use_shm) {
+            timeout = fib_shm_wait(&session->ring) ? 0 : FIB_SHM_POLL_MS;
+        }
+
+        int ready = poll(polls, (nfds_t)poll_count, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (ready == 0 && watch_pending) {
+            watch_pending = 0;
+            reload_and_paint(session);
+            continue;
+        }
+        if (watch_index >= 0 && (polls[watch_index].revents & POLLIN) && drain_watch_events(watch_fd, watch_name)) {
+            watch_pending = 1;
+        }
+        if (resize_index >= 0 && (polls[resize_index].revents & POLLIN)) {
+            handle_resize(session);
+        }
+        if (session->use_shm) {
+            reload_and_paint(session);
+        }
+    }
+}
+
+int fib_live_run(const char *input_path, const FibRenderConfig *config, const char *output_path) {
+    FibLiveSession session;
+    const char *watch_name = NULL;
+    int watch_fd = -1;
+    int track_resize = 0;
+
+    memset(&session, 0, sizeof(session));
+    session.input_path = input_path;
+    session.output_path = output_path;
+    session.config = config;
+    session.runtime_config = *config;
+    session.overwrite_in_place = (output_path == NULL && config->format == FIB_FORMAT_TEXT && isatty(STDOUT_FILENO));
+    fib_render_context_init(&session.context);
+
+    if (config->fit && output_path == NULL) {
+        track_resize = query_terminal_size(&session.runtime_config.output_width, &session.runtime_config.output_height);
+    }
+    if (config->shm_name) {
+        if (!fib_shm_attach(config->shm_name, &session.ring)) {
+            return 1;
+        }
+        session.use_shm = 1;
+        g_waiting_ring = &session.ring;
+    }
+    if (config->watch) {
+        watch_fd = open_watch(input_path, &watch_name);
+        if (watch_fd < 0) {
+            return 1;
+        }
+    }
+    if (track_resize && !open_resize_pipe()) {
+        if (watch_fd >= 0) {
+            close(watch_fd);
+        }
+        if (session.use_shm) {
+            g_waiting_ring = NULL;
+            fib_shm_detach(&session.ring);
+        }
+        return 1;
+    }
+
+    /* One large stdio buffer for the whole session keeps each frame to a few writes. */
+    if (!output_path) {
+        setvbuf(stdout, g_stream_buffer, _IOFBF, sizeof(g_stream_buffer));
+    }
+
+    install_handler(SIGINT, request_stop);
+    install_handler(SIGTERM, request_stop);
+
+    reload_and_paint(&session);
+    int status = session.has_image ? 0 : 1;
+    if (watch_fd >= 0 || track_resize || session.use_shm) {
+        status = 0;
+        run_event_loop(&session, watch_fd, watch_name, track_resize);
+    }
+
+    fflush(stdout);
+    if (track_resize) {
+        signal(SIGWINCH, SIG_DFL);
+        close(g_resize_pipe[0]);
+        close(g_resize_pipe[1]);
+    }
+    if (watch_fd >= 0) {
+        close(watch_fd);
+    }
+    fib_render_context_free(&session.context);
+    if (session.use_shm) {
+        g_waiting_ring = NULL;
+        fib_shm_release(&session.ring);
+        fib_shm_detach(&session.ring);
+    } else {
+        fib_image_free(&session.image);
+    }
+    return status;
+}
@@ -0,0 +1,8 @@
+#ifndef FIB_LIVE_H
+#define FIB_LIVE_H
+
+#include "fib_render.h"
+
+int fib_live_run(const char *input_path, const FibRenderConfig *config, const char *output_path);
+
+#endif
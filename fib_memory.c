@@ -0,0 +1,138 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include "fib_memory.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* keeps the data 64-byte aligned behind the header */
+#define FIB_MEMORY_HEADER_BYTES 64U
+
+typedef struct {
+    void *base;
+    size_t length;
+    size_t huge_length;
+    int advised;
+} FibMemoryHeader;
+
+static atomic_int g_huge_pages = 1;
+static atomic_size_t g_huge_bytes;
+static atomic_size_t g_huge_peak;
+
+void fib_memory_set_huge_pages(int enabled) {
+    atomic_store(&g_huge_pages, enabled != 0);
+}
+
+/* Most bytes held at once in mappings the kernel accepted MADV_HUGEPAGE for. */
+size_t fib_memory_huge_peak(void) {
+    return atomic_load(&g_huge_peak);
+}
+
+static size_t header_page_bytes(void) {
+    long page = sysconf(_SC_PAGESIZE);
+    return page >= (long)FIB_MEMORY_HEADER_BYTES ? (size_t)page : 4096U;
+}
+
+/*
+ * Over-reserves by one huge page and one normal page, then unmaps the slack before the
+ * normal page that ends at the first 2 MiB boundary and after the last whole huge page.
+ * The data starts on the boundary, so the kernel can back it with huge pages; the normal
+ * page in front holds the header, so writing the header touches none of the data's pages.
+ */
+static void *map_huge(size_t length, size_t page, int *advised) {
+    if (length > SIZE_MAX - FIB_HUGE_PAGE_BYTES - page) {
+        return NULL;
+    }
+    size_t reserved = length + FIB_HUGE_PAGE_BYTES + page;
+    char *mapping = (char *)mmap(NULL, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    char *aligned =
+        (char *)(((uintptr_t)mapping + page + FIB_HUGE_PAGE_BYTES - 1U) & ~(uintptr_t)(FIB_HUGE_PAGE_BYTES - 1U));
+    size_t head = (size_t)(aligned - page - mapping);
+    if (head > 0) {
+        munmap(mapping, head);
+    }
+    if (reserved - head - page > length) {
+        munmap(aligned + length, reserved - head - page - length);
+    }
+#ifdef MADV_HUGEPAGE
+    /* without transparent huge pages this fails and the region keeps normal pages */
+    *advised = madvise(aligned, length, MADV_HUGEPAGE) == 0;
+#else
+    *advised = 0;
+#endif
+    return aligned;
+}
+
+/* Bytes a fib_memory_alloc of size may keep resident once every page is touched. */
+size_t fib_memory_footprint(size_t size) {
+    if (size > SIZE_MAX - FIB_HUGE_PAGE_BYTES) {
+        return SIZE_MAX;
+    }
+    size_t length = size + FIB_MEMORY_HEADER_BYTES;
+    if (atomic_load(&g_huge_pages) && size >= FIB_HUGE_PAGE_BYTES) {
+        length = ((size + FIB_HUGE_PAGE_BYTES - 1U) & ~(size_t)(FIB_HUGE_PAGE_BYTES - 1U)) + header_page_bytes();
+    }
+    return length;
+}
+
+void *fib_memory_alloc(size_t size) {
+    FibMemoryHeader *header = NULL;
+
+    if (size > SIZE_MAX - FIB_HUGE_PAGE_BYTES) {
+        return NULL;
+    }
+    size_t length = size + FIB_MEMORY_HEADER_BYTES;
+    if (atomic_load(&g_huge_pages) && size >= FIB_HUGE_PAGE_BYTES) {
+        size_t page = header_page_bytes();
+        size_t huge_length = (size + FIB_HUGE_PAGE_BYTES - 1U) & ~(size_t)(FIB_HUGE_PAGE_BYTES - 1U);
+        int advised = 0;
+        char *data = (char *)map_huge(huge_length, page, &advised);
+        if (data) {
+            header = (FibMemoryHeader *)(data - FIB_MEMORY_HEADER_BYTES);
+            header->base = data - page;
+            header->length = huge_length + page;
+            header->huge_length = huge_length;
+            header->advised = advised;
+            if (advised) {
+                size_t held = atomic_fetch_add(&g_huge_bytes, huge_length) + huge_length;
+                size_t peak = atomic_load(&g_huge_peak);
+                while (held > peak && !atomic_compare_exchange_weak(&g_huge_peak, &peak, held)) {
+                }
+            }
+            return data;
+        }
+    }
+
+    header = (FibMemoryHeader *)malloc(length);
+    if (!header) {
+        return NULL;
+    }
+    header->base = NULL;
+    header->length = 0;
+    header->huge_length = 0;
+    header->advised = 0;
+    return (char *)header + FIB_MEMORY_HEADER_BYTES;
+}
+
+void fib_memory_free(void *pointer) {
+    if (!pointer) {
+        return;
+    }
+    FibMemoryHeader *header = (FibMemoryHeader *)((char *)pointer - FIB_MEMORY_HEADER_BYTES);
+    if (!header->base) {
+        free(header);
+        return;
+    }
+    if (header->advised) {
+        atomic_fetch_sub(&g_huge_bytes, header->huge_length);
+    }
+    munmap(header->base, header->length);
+}
@@ -0,0 +1,28 @@
+#ifndef FIB_MEMORY_H
+#define FIB_MEMORY_H
+
+#include <stddef.h>
+
+#define FIB_HUGE_PAGE_BYTES (2U * 1024U * 1024U)
+
+/*
+ * Allocator for the big, randomly addressed buffers: decoded gray images and summed-area
+ * tables. A buffer of at least FIB_HUGE_PAGE_BYTES gets its own anonymous mapping,
+ * aligned and sized to whole 2 MiB pages and advised MADV_HUGEPAGE, so the draw loop's
+ * scattered corner reads hit far fewer TLB entries. Smaller buffers, a failed mapping and
+ * fib_memory_set_huge_pages(0) fall back to malloc; a kernel that refuses the advice
+ * leaves the mapping on normal pages.
+ *
+ * The header sits in a normal page just below the 2 MiB-aligned data, so allocating
+ * touches none of the data's pages and each is placed on the NUMA node of the thread that
+ * writes it first: the analysis strips fill their own rows of the tables. Strips are not
+ * cut at 2 MiB boundaries, so a huge page spanning two strips lands on the node of the
+ * one that reaches it first. Release with fib_memory_free only.
+ */
+void *fib_memory_alloc(size_t size);
+void fib_memory_free(void *pointer);
+size_t fib_memory_footprint(size_t size);
+void fib_memory_set_huge_pages(int enabled);
+size_t fib_memory_huge_peak(void);
+
+#endif
@@ -0,0 +1,457 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fib_pipeline.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fib.h"
+#include "fib_analysis.h"
+#include "fib_sink.h"
+
+#define FIB_PIPELINE_END (-1)
+
+/*
+ * Bounded lock-free ring of slot indices for one producer and one consumer. The producer
+ * publishes an item with a release store of tail and the consumer retires it with a
+ * release store of head. The capacity covers every in-flight slot plus the end markers,
+ * so a push never finds the ring full. A consumer sleeps on a semaphore that the producer
+ * posts after each push; the queue itself takes no lock.
+ */
+typedef struct {
+    int *items;
+    size_t mask;
+    atomic_size_t head;
+    atomic_size_t tail;
+} SpscQueue;
+
+/* One image on its way through the stages; slot sequence % in_flight holds image sequence. */
+typedef struct {
+    char *path;
+    FibImage image;
+    FibRenderConfig config;
+    int ok;
+    char *output;
+    size_t output_size;
+    size_t output_capacity;
+} PipelineSlot;
+
+struct Pipeline;
+
+typedef struct {
+    struct Pipeline *pipeline;
+    SpscQueue input;
+    SpscQueue output;
+    sem_t ready;
+    double busy_ms;
+} DecodeLane;
+
+typedef struct Pipeline {
+    FibRenderConfig config;
+    FILE *paths;
+    int in_flight;
+    int lane_count;
+    int render_threads;
+    PipelineSlot *slots;
+    DecodeLane lanes[FIB_PIPELINE_MAX_LANES];
+    SpscQueue rendered;
+    sem_t free_slots;
+    sem_t decoded_ready;
+    sem_t rendered_ready;
+    sem_t start_gate;
+    atomic_int aborted;
+    size_t image_count;
+    double read_ms;
+    double render_ms;
+} Pipeline;
+
+static int queue_init(SpscQueue *queue, size_t min_capacity) {
+    size_t capacity = 1;
+
+    while (capacity < min_capacity) {
+        capacity <<= 1;
+    }
+    queue->items = (int *)calloc(capacity, sizeof(int));
+    queue->mask = capacity - 1U;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return queue->items != NULL;
+}
+
+static void queue_push(SpscQueue *queue, int item) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    queue->items[tail & queue->mask] = item;
+    atomic_store_explicit(&queue->tail, tail + 1U, memory_order_release);
+}
+
+static int queue_pop(SpscQueue *queue, int *item) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) {
+        return 0;
+    }
+    *item = queue->items[head & queue->mask];
+    atomic_store_explicit(&queue->head, head + 1U, memory_order_release);
+    return 1;
+}
+
+static void wait_semaphore(sem_t *semaphore) {
+    while (sem_wait(semaphore) != 0 && errno == EINTR) {
+    }
+}
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1000.0 + (double)(now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/* Stage threads hold here until every stage has started, or leave if one could not. */
+static int wait_start(Pipeline *pipeline) {
+    wait_semaphore(&pipeline->start_gate);
+    return !atomic_load(&pipeline->aborted);
+}
+
+/* Starts reading the file into the page cache while earlier images are still decoding. */
+static void prefetch(const char *path) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+}
+
+/* Read stage: one path per line, handed to the decode lanes round-robin. */
+static void *read_stage(void *argument) {
+    Pipeline *pipeline = (Pipeline *)argument;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length = 0;
+    size_t sequence = 0;
+
+    if (!wait_start(pipeline)) {
+        return NULL;
+    }
+    while ((length = getline(&line, &line_capacity, pipeline->paths)) >= 0) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length == 0) {
+            continue;
+        }
+
+        wait_semaphore(&pipeline->free_slots);
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int index = (int)(sequence % (size_t)pipeline->in_flight);
+        PipelineSlot *slot = &pipeline->slots[index];
+        slot->path = strdup(line);
+        if (slot->path) {
+            prefetch(slot->path);
+        }
+        pipeline->read_ms += elapsed_ms(&start);
+
+        DecodeLane *lane = &pipeline->lanes[sequence % (size_t)pipeline->lane_count];
+        queue_push(&lane->input, index);
+        sem_post(&lane->ready);
+        sequence++;
+    }
+    free(line);
+
+    pipeline->image_count = sequence;
+    for (int i = 0; i < pipeline->lane_count; i++) {
+        queue_push(&pipeline->lanes[i].input, FIB_PIPELINE_END);
+        sem_post(&pipeline->lanes[i].ready);
+    }
+    return NULL;
+}
+
+/* Decode stage: probe, plan and decode into the slot's gray image. */
+static void *decode_stage(void *argument) {
+    DecodeLane *lane = (DecodeLane *)argument;
+    Pipeline *pipeline = lane->pipeline;
+    int index = 0;
+
+    if (!wait_start(pipeline)) {
+        return NULL;
+    }
+    for (;;) {
+        wait_semaphore(&lane->ready);
+        queue_pop(&lane->input, &index);
+        if (index != FIB_PIPELINE_END) {
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            PipelineSlot *slot = &pipeline->slots[index];
+            slot->config = pipeline->config;
+            slot->ok = slot->path && fib_load_planned_image(slot->path, &pipeline->config, &slot->image, &slot->config, NULL, NULL, NULL);
+            if (!slot->path) {
+                fprintf(stderr, "error: out of memory for input path\n");
+            }
+            lane->busy_ms += elapsed_ms(&start);
+        }
+        queue_push(&lane->output, index);
+        sem_post(&pipeline->decoded_ready);
+        if (index == FIB_PIPELINE_END) {
+            return NULL;
+        }
+    }
+}
+
+static int render_slot(FibRenderContext *context, PipelineSlot *slot) {
+    FibSink sink;
+    size_t size = fib_render_frame_bytes(&slot->config);
+
+    if (slot->output_capacity < size) {
+        char *output = (char *)realloc(slot->output, size);
+        if (!output) {
+            fprintf(stderr, "error: out of memory for output of %s\n", slot->path);
+            return 0;
+        }
+        slot->output = output;
+        slot->output_capacity = size;
+    }
+    /* the cached tables describe the previous image, even when this one has its size */
+    fib_render_context_invalidate(context);
+    fib_sink_init_buffer(&sink, slot->output, slot->output_capacity);
+    int ok = fib_render_context_emit(context, &slot->image, &slot->config, &sink);
+    slot->output_size = sink.length;
+    fib_sink_free(&sink);
+    return ok;
+}
+
+/*
+ * Render stage: takes decoded images from whichever lane has one, so a slow decode does
+ * not hold up the others, and renders them with one reusable context.
+ */
+static void *render_stage(void *argument) {
+    Pipeline *pipeline = (Pipeline *)argument;
+    FibRenderContext context;
+    int finished_lanes = 0;
+    int lane = 0;
+    int index = 0;
+
+    if (!wait_start(pipeline)) {
+        return NULL;
+    }
+    fib_render_context_init(&context);
+    while (finished_lanes < pipeline->lane_count) {
+        wait_semaphore(&pipeline->decoded_ready);
+        while (!queue_pop(&pipeline->lanes[lane].output, &index)) {
+            lane = (lane + 1) % pipeline->lane_count;
+        }
+        lane = (lane + 1) % pipeline->lane_count;
+        if (index == FIB_PIPELINE_END) {
+            finished_lanes++;
+            continue;
+        }
+
+        PipelineSlot *slot = &pipeline->slots[index];
+        if (slot->ok) {
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            slot->ok = render_slot(&context, slot);
+            fib_image_free(&slot->image);
+            pipeline->render_ms += elapsed_ms(&start);
+        }
+        queue_push(&pipeline->rendered, index);
+        sem_post(&pipeline->rendered_ready);
+    }
+    fib_render_context_free(&context);
+
+    queue_push(&pipeline->rendered, FIB_PIPELINE_END);
+    sem_post(&pipeline->rendered_ready);
+    return NULL;
+}
+
+/*
+ * Write stage, on the calling thread. Images finish rendering out of order when lanes
+ * run at different speeds; done[] is the reorder buffer, and each write in input order
+ * frees a slot for the reader.
+ */
+static int write_stage(Pipeline *pipeline, unsigned char *done, FILE *output, double *write_ms) {
+    size_t next = 0;
+    int index = 0;
+    int status = 0;
+    int write_failed = 0;
+
+    for (;;) {
+        wait_semaphore(&pipeline->rendered_ready);
+        queue_pop(&pipeline->rendered, &index);
+        if (index == FIB_PIPELINE_END) {
+            break;
+        }
+        done[index] = 1;
+
+        int slot_index = (int)(next % (size_t)pipeline->in_flight);
+        while (done[slot_index]) {
+            PipelineSlot *slot = &pipeline->slots[slot_index];
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (!slot->ok) {
+                status = 1;
+            } else if (!write_failed && fwrite(slot->output, 1, slot->output_size, output) != slot->output_size) {
+                fprintf(stderr, "error: cannot write output\n");
+                write_failed = 1;
+                status = 1;
+            }
+            *write_ms += elapsed_ms(&start);
+
+            free(slot->path);
+            slot->path = NULL;
+            done[slot_index] = 0;
+            next++;
+            slot_index = (int)(next % (size_t)pipeline->in_flight);
+            sem_post(&pipeline->free_slots);
+        }
+    }
+    return status;
+}
+
+static void free_pipeline(Pipeline *pipeline) {
+    for (int i = 0; i < pipeline->lane_count; i++) {
+        free(pipeline->lanes[i].input.items);
+        free(pipeline->lanes[i].output.items);
+        sem_destroy(&pipeline->lanes[i].ready);
+    }
+    free(pipeline->rendered.items);
+    if (pipeline->slots) {
+        for (int i = 0; i < pipeline->in_flight; i++) {
+            free(pipeline->slots[i].path);
+            free(pipeline->slots[i].output);
+            fib_image_free(&pipeline->slots[i].image);
+        }
+        free(pipeline->slots);
+    }
+    sem_destroy(&pipeline->free_slots);
+    sem_destroy(&pipeline->decoded_ready);
+    sem_destroy(&pipeline->rendered_ready);
+    sem_destroy(&pipeline->start_gate);
+}
+
+static int init_pipeline(Pipeline *pipeline, const FibRenderConfig *config, FILE *paths, int has_output_path) {
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->config = *config;
+    pipeline->config.enable_color = fib_should_enable_color(config->color_mode, has_output_path);
+    pipeline->paths = paths;
+    pipeline->in_flight = config->in_flight > 0 ? config->in_flight : FIB_PIPELINE_DEFAULT_IN_FLIGHT;
+    pipeline->lane_count = fib_resolve_thread_count(config->thread_count);
+    if (pipeline->lane_count > FIB_PIPELINE_MAX_LANES) {
+        pipeline->lane_count = FIB_PIPELINE_MAX_LANES;
+    }
+    if (pipeline->lane_count > pipeline->in_flight) {
+        pipeline->lane_count = pipeline->in_flight;
+    }
+    /* the decode lanes take their share of --threads; the render stage's analysis gets the rest */
+    pipeline->render_threads = fib_resolve_thread_count(config->thread_count) - pipeline->lane_count;
+    if (pipeline->render_threads < 1) {
+        pipeline->render_threads = 1;
+    }
+    pipeline->config.thread_count = pipeline->render_threads;
+    /* every in-flight slot can hold an image at its planned peak, so each plans for an equal share */
+    if (config->max_memory) {
+        pipeline->config.max_memory = config->max_memory / (size_t)pipeline->in_flight;
+        if (pipeline->config.max_memory == 0) {
+            pipeline->config.max_memory = 1;
+        }
+    }
+    atomic_init(&pipeline->aborted, 0);
+
+    /* every in-flight slot plus one end marker per lane can be queued at once */
+    size_t capacity = (size_t)pipeline->in_flight + FIB_PIPELINE_MAX_LANES + 1U;
+    int ok = sem_init(&pipeline->free_slots, 0, (unsigned)pipeline->in_flight) == 0 &&
+             sem_init(&pipeline->decoded_ready, 0, 0) == 0 && sem_init(&pipeline->rendered_ready, 0, 0) == 0 &&
+             sem_init(&pipeline->start_gate, 0, 0) == 0;
+    pipeline->slots = (PipelineSlot *)calloc((size_t)pipeline->in_flight, sizeof(PipelineSlot));
+    ok = ok && pipeline->slots && queue_init(&pipeline->rendered, capacity);
+    for (int i = 0; i < pipeline->lane_count; i++) {
+        DecodeLane *lane = &pipeline->lanes[i];
+        lane->pipeline = pipeline;
+        ok = ok && sem_init(&lane->ready, 0, 0) == 0 && queue_init(&lane->input, capacity) &&
+             queue_init(&lane->output, capacity);
+    }
+    if (!ok) {
+        fprintf(stderr, "error: cannot set up the pipeline\n");
+    }
+    return ok;
+}
+
+int fib_pipeline_run(const FibRenderConfig *config, FILE *paths, const char *output_path) {
+    Pipeline pipeline;
+    pthread_t threads[FIB_PIPELINE_MAX_LANES + 2];
+    int thread_count = 0;
+    double write_ms = 0.0;
+    int status = 1;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned char *done = NULL;
+    FILE *output = NULL;
+    if (!init_pipeline(&pipeline, config, paths, output_path != NULL) ||
+        !(done = (unsigned char *)calloc((size_t)pipeline.in_flight, 1U)) ||
+        !(output = output_path ? fib_open_output(output_path, config) : stdout)) {
+        free(done);
+        free_pipeline(&pipeline);
+        return 1;
+    }
+
+    /* every stage waits at the start gate, so a failed start can still unwind cleanly */
+    int started = pthread_create(&threads[thread_count], NULL, render_stage, &pipeline) == 0;
+    thread_count += started;
+    for (int i = 0; started && i < pipeline.lane_count; i++) {
+        started = pthread_create(&threads[thread_count], NULL, decode_stage, &pipeline.lanes[i]) == 0;
+        thread_count += started;
+    }
+    if (started) {
+        started = pthread_create(&threads[thread_count], NULL, read_stage, &pipeline) == 0;
+        thread_count += started;
+    }
+    if (!started) {
+        fprintf(stderr, "error: cannot start pipeline threads\n");
+        atomic_store(&pipeline.aborted, 1);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        sem_post(&pipeline.start_gate);
+    }
+
+    if (started) {
+        status = write_stage(&pipeline, done, output, &write_ms);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (output_path) {
+        if (fclose(output) != 0) {
+            fprintf(stderr, "error: cannot finish writing %s\n", output_path);
+            status = 1;
+        } else if (started) {
+            printf("ascii art saved to: %s\n", output_path);
+        }
+    } else if (fflush(stdout) != 0) {
+        status = 1;
+    }
+
+    if (config->verbose && started) {
+        double decode_ms = 0.0;
+        for (int i = 0; i < pipeline.lane_count; i++) {
+            decode_ms += pipeline.lanes[i].busy_ms;
+        }
+        fprintf(stderr,
+                "fib: pipeline %zu images, %d decode lanes, %d render threads, %d in flight, %.1f ms; busy ms: read %.1f, "
+                "decode %.1f, render %.1f, write %.1f\n",
+                pipeline.image_count, pipeline.lane_count, pipeline.render_threads, pipeline.in_flight, elapsed_ms(&start),
+                pipeline.read_ms, decode_ms, pipeline.render_ms, write_ms);
+    }
+    free(done);
+    free_pipeline(&pipeline);
+    return status;
+}
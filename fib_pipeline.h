@@ -0,0 +1,23 @@
+#ifndef FIB_PIPELINE_H
+#define FIB_PIPELINE_H
+
+#include <stdio.h>
+
+#include "fib_render.h"
+
+#define FIB_PIPELINE_DEFAULT_IN_FLIGHT 8
+#define FIB_PIPELINE_MAX_IN_FLIGHT 256
+#define FIB_PIPELINE_MAX_LANES 16
+
+/*
+ * --pipeline: renders every image path read from paths (one per line) and writes the
+ * outputs to output_path, or standard output, in input order. Reading, decoding,
+ * rendering and writing run as concurrent stages joined by single-producer,
+ * single-consumer queues; at most config->in_flight images are between the reader and
+ * the writer at any time, and each plans against config->max_memory / in_flight. The
+ * decode lanes and the render stage's analysis threads share config->thread_count.
+ * Returns the process exit status: 1 when any image failed.
+ */
+int fib_pipeline_run(const FibRenderConfig *config, FILE *paths, const char *output_path);
+
+#endif
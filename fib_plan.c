@@ -0,0 +1,197 @@
+#include "fib_plan.h"
+
+#include <stdint.h>
+
+#include "fib_analysis.h"
+#include "fib_memory.h"
+
+#define FIB_PLAN_FIXED_OVERHEAD ((size_t)1 << 20)
+#define FIB_PLAN_MIN_PIXELS_PER_CELL 2
+
+static size_t saturating_add(size_t a, size_t b) {
+    return (a > SIZE_MAX - b) ? SIZE_MAX : a + b;
+}
+
+static int reduced_extent(int extent, int factor) {
+    return extent / factor + (extent % factor != 0);
+}
+
+const char *fib_plan_strategy_name(FibPlanStrategy strategy) {
+    switch (strategy) {
+        case FIB_PLAN_WIDE_SAT:
+            return "wide-sat";
+        case FIB_PLAN_BANDED_SAT:
+            return "banded-sat";
+        case FIB_PLAN_DOWNSCALED:
+            return "downscaled";
+        case FIB_PLAN_COMPACT_SAT:
+        default:
+            return "compact-sat";
+    }
+}
+
+/*
+ * Peak resident estimate for one pipeline. The decoder's scratch and the gray image are
+ * alive together while decoding; the decoder is gone before the tables are allocated.
+ * Faster quality tiers build the tables over a reduced copy of the gray image instead,
+ * and poster mode (with shards and their tones pre-pass, which must pick the same plan)
+ * holds one band buffer per render thread. --incremental keeps a copy of the gray frame
+ * and the previous frame's cells and dither rows. The gray image, reduced grid and each
+ * table are counted in whole huge pages when fib_memory would map them that way.
+ */
+size_t fib_plan_estimate(const FibImageInfo *info, const FibRenderConfig *config, FibSatLayout layout, int downscale) {
+    int width = reduced_extent(info->width, downscale);
+    int height = reduced_extent(info->height, downscale);
+    size_t gray_bytes = fib_memory_footprint((size_t)width * (size_t)height);
+    size_t decode_bytes = fib_image_decode_bytes(info);
+    size_t render_bytes = (size_t)config->output_width * 16U;
+    if (config->poster || config->shard_count > 0 || config->write_tones_path) {
+        render_bytes = fib_render_poster_band_bytes(config->output_width) * (size_t)fib_resolve_thread_count(config->thread_count);
+    }
+
+    /* A zero-copy raster lives in the page cache, not in private memory. */
+    if (info->zero_copy && downscale == 1) {
+        gray_bytes = 0;
+    }
+    if (downscale > 1) {
+        decode_bytes = saturating_add(decode_bytes, (size_t)info->width + (size_t)width * sizeof(uint32_t));
+    }
+
+    if (config->incremental) {
+        size_t cells = (size_t)config->output_width * (size_t)config->output_height;
+        size_t errors = ((size_t)config->output_width + 2U) * ((size_t)config->output_height + 1U) * sizeof(float);
+        render_bytes = saturating_add(render_bytes, saturating_add((size_t)width * (size_t)height, cells * 2U + errors));
+    }
+
+    int quality_factor = fib_render_quality_factor(width, height, config);
+    if (quality_factor > 1) {
+        width = reduced_extent(width, quality_factor);
+        height = reduced_extent(height, quality_factor);
+        size_t accumulator_bytes = (size_t)width * sizeof(uint32_t) * (size_t)fib_resolve_thread_count(config->thread_count);
+        render_bytes =
+            saturating_add(render_bytes, saturating_add(fib_memory_footprint((size_t)width * (size_t)height), accumulator_bytes));
+    }
+
+    /* two equal tables, sum and sum of squares */
+    size_t table_bytes = fib_analysis_table_bytes(width, height, layout, fib_analysis_band_rows(height, config->output_height));
+    table_bytes = saturating_add(fib_memory_footprint(table_bytes / 2U), fib_memory_footprint(table_bytes / 2U));
+    size_t decode_peak = saturating_add(decode_bytes, gray_bytes);
+    size_t render_peak = saturating_add(saturating_add(gray_bytes, table_bytes), render_bytes);
+    size_t peak = decode_peak > render_peak ? decode_peak : render_peak;
+    return saturating_add(peak, FIB_PLAN_FIXED_OVERHEAD);
+}
+
+static int plan_fits(const FibRenderConfig *config, size_t peak) {
+    return config->max_memory == 0 || peak <= config->max_memory;
+}
+
+static int try_full_resolution(const FibImageInfo *info, const FibRenderConfig *config, FibPlan *plan) {
+    static const FibSatLayout compact_first[] = {FIB_SAT_COMPACT, FIB_SAT_WIDE, FIB_SAT_BANDED};
+    static const FibSatLayout wide_first[] = {FIB_SAT_WIDE, FIB_SAT_COMPACT, FIB_SAT_BANDED};
+    const FibSatLayout *layouts = config->prefer_wide_sat ? wide_first : compact_first;
+
+    for (size_t i = 0; i < sizeof(compact_first) / sizeof(compact_first[0]); i++) {
+        if (layouts[i] == FIB_SAT_COMPACT &&
+            !fib_analysis_compact_fits(info->width, info->height, config->output_width, config->output_height)) {
+            continue;
+        }
+        if (config->sat_layout != FIB_SAT_AUTO && config->sat_layout != layouts[i]) {
+            continue;
+        }
+
+        size_t peak = fib_plan_estimate(info, config, layouts[i], 1);
+        if (plan->peak_bytes == 0 || peak < plan->peak_bytes) {
+            plan->peak_bytes = peak;
+        }
+        if (plan_fits(config, peak)) {
+            plan->strategy = layouts[i] == FIB_SAT_COMPACT ? FIB_PLAN_COMPACT_SAT
+                             : layouts[i] == FIB_SAT_WIDE  ? FIB_PLAN_WIDE_SAT
+                                                           : FIB_PLAN_BANDED_SAT;
+            plan->sat_layout = layouts[i];
+            plan->downscale = 1;
+            plan->peak_bytes = peak;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Strategies in order of preference: exact results first (compact tables are the
+ * fastest, then wide tables, then a rolling band of wide rows), then decode-time box
+ * downscaling by the smallest factor that fits while keeping a few pixels per cell.
+ * A machine profile that measured wide tables faster puts them ahead of compact ones.
+ */
+int fib_plan_choose(const FibImageInfo *info, const FibRenderConfig *config, FibPlan *plan) {
+    plan->strategy = FIB_PLAN_WIDE_SAT;
+    plan->sat_layout = FIB_SAT_WIDE;
+    plan->downscale = 1;
+    plan->peak_bytes = 0;
+
+    if (try_full_resolution(info, config, plan)) {
+        return 1;
+    }
+
+    int max_factor_x = info->width / (config->output_width * FIB_PLAN_MIN_PIXELS_PER_CELL);
+    int max_factor_y = info->height / (config->output_height * FIB_PLAN_MIN_PIXELS_PER_CELL);
+    int max_factor = max_factor_x < max_factor_y ? max_factor_x : max_factor_y;
+
+    for (int factor = 2; factor <= max_factor; factor++) {
+        int width = reduced_extent(info->width, factor);
+        int height = reduced_extent(info->height, factor);
+        FibSatLayout layout = !config->prefer_wide_sat &&
+                                      fib_analysis_compact_fits(width, height, config->output_width, config->output_height)
+                                  ? FIB_SAT_COMPACT
+                                  : FIB_SAT_WIDE;
+        size_t peak = fib_plan_estimate(info, config, layout, factor);
+
+        if (!plan_fits(config, peak)) {
+            peak = fib_plan_estimate(info, config, FIB_SAT_BANDED, factor);
+            layout = FIB_SAT_BANDED;
+        }
+        if (peak < plan->peak_bytes) {
+            plan->peak_bytes = peak;
+        }
+        if (plan_fits(config, peak)) {
+            plan->strategy = FIB_PLAN_DOWNSCALED;
+            plan->sat_layout = layout;
+            plan->downscale = factor;
+            plan->peak_bytes = peak;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Whether a plan chosen for one output size still holds at config's size: a downscaled
+ * grid must keep FIB_PLAN_MIN_PIXELS_PER_CELL per cell, and the peak must stay within the
+ * budget with the tables the renderer would now pick (compact ones widen once a larger
+ * cell box could overflow them).
+ */
+int fib_plan_holds(const FibImageInfo *info, const FibRenderConfig *config, const FibPlan *plan) {
+    int width = reduced_extent(info->width, plan->downscale);
+    int height = reduced_extent(info->height, plan->downscale);
+    FibSatLayout layout = plan->sat_layout;
+
+    if (plan->downscale > 1 && (info->width / (config->output_width * FIB_PLAN_MIN_PIXELS_PER_CELL) < plan->downscale ||
+                                info->height / (config->output_height * FIB_PLAN_MIN_PIXELS_PER_CELL) < plan->downscale)) {
+        return 0;
+    }
+    if (layout == FIB_SAT_COMPACT && !fib_analysis_compact_fits(width, height, config->output_width, config->output_height)) {
+        layout = FIB_SAT_WIDE;
+    }
+    return plan_fits(config, fib_plan_estimate(info, config, layout, plan->downscale));
+}
+
+void fib_plan_report(const FibImageInfo *info, const FibRenderConfig *config, const FibPlan *plan, FILE *stream) {
+    fprintf(stream, "fib: input %dx%d %s%s\n", info->width, info->height,
+            fib_image_format_name(info->format), info->interlaced ? " (interlaced)" : info->zero_copy ? " (zero-copy)" : "");
+    fprintf(stream, "fib: plan %s, tables %s, downscale %d, estimated peak %zu bytes", fib_plan_strategy_name(plan->strategy),
+            fib_sat_layout_name(plan->sat_layout), plan->downscale, plan->peak_bytes);
+    if (config->max_memory) {
+        fprintf(stream, " (budget %zu bytes)\n", config->max_memory);
+    } else {
+        fprintf(stream, " (no budget)\n");
+    }
+}
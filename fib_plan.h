@@ -0,0 +1,30 @@
+#ifndef FIB_PLAN_H
+#define FIB_PLAN_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "fib_image.h"
+#include "fib_render.h"
+
+typedef enum {
+    FIB_PLAN_COMPACT_SAT = 0,
+    FIB_PLAN_WIDE_SAT,
+    FIB_PLAN_BANDED_SAT,
+    FIB_PLAN_DOWNSCALED
+} FibPlanStrategy;
+
+typedef struct {
+    FibPlanStrategy strategy;
+    FibSatLayout sat_layout;
+    int downscale;
+    size_t peak_bytes;
+} FibPlan;
+
+size_t fib_plan_estimate(const FibImageInfo *info, const FibRenderConfig *config, FibSatLayout layout, int downscale);
+int fib_plan_choose(const FibImageInfo *info, const FibRenderConfig *config, FibPlan *plan);
+int fib_plan_holds(const FibImageInfo *info, const FibRenderConfig *config, const FibPlan *plan);
+const char *fib_plan_strategy_name(FibPlanStrategy strategy);
+void fib_plan_report(const FibImageInfo *info, const FibRenderConfig *config, const FibPlan *plan, FILE *stream);
+
+#endif
@@ -1,9 +1,28 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "fib_render.h"
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "fib_analysis.h"
+#include "fib_glyph.h"
+#include "fib_grid.h"
+
+#define FIB_QUALITY_FAST_PIXELS_PER_CELL 3
+#define FIB_QUALITY_BALANCED_PIXELS_PER_CELL 8
+#define FIB_SHAPE_MIN_VARIANCE 400
+#define FIB_POSTER_MAX_WORKERS 64
+#define FIB_COLORED_CELL_BYTES 20U
+#define FIB_CURSOR_MOVE_BYTES 16U
+
+static const char k_shape_extra_glyphs[] = "|-/\\_";
 
 static const char k_palette_classic[] =
     "$@B%8&WM#*oahkbdpqwmZO0QLCJUYXzcvunxrjft()1{}[]?+~<>i!lI;:,\"^`'. ";
@@ -62,6 +81,82 @@ int fib_palette_from_string(const char *value, FibPalette *palette_out) {
     return 0;
 }
 
+const char *fib_quality_name(FibQuality quality) {
+    switch (quality) {
+        case FIB_QUALITY_FAST:
+            return "fast";
+        case FIB_QUALITY_BALANCED:
+            return "balanced";
+        case FIB_QUALITY_BEST:
+        default:
+            return "best";
+    }
+}
+
+int fib_quality_from_string(const char *value, FibQuality *quality_out) {
+    if (strcmp(value, "fast") == 0) {
+        *quality_out = FIB_QUALITY_FAST;
+        return 1;
+    }
+    if (strcmp(value, "balanced") == 0) {
+        *quality_out = FIB_QUALITY_BALANCED;
+        return 1;
+    }
+    if (strcmp(value, "best") == 0) {
+        *quality_out = FIB_QUALITY_BEST;
+        return 1;
+    }
+    return 0;
+}
+
+const char *fib_glyph_mode_name(FibGlyphMode glyph_mode) {
+    return glyph_mode == FIB_GLYPHS_SHAPE ? "shape" : "ramp";
+}
+
+int fib_glyph_mode_from_string(const char *value, FibGlyphMode *glyph_mode_out) {
+    if (strcmp(value, "ramp") == 0) {
+        *glyph_mode_out = FIB_GLYPHS_RAMP;
+        return 1;
+    }
+    if (strcmp(value, "shape") == 0) {
+        *glyph_mode_out = FIB_GLYPHS_SHAPE;
+        return 1;
+    }
+    return 0;
+}
+
+const char *fib_edge_mode_name(FibEdgeMode edge_mode) {
+    return edge_mode == FIB_EDGES_BOX ? "box" : "sobel";
+}
+
+int fib_edge_mode_from_string(const char *value, FibEdgeMode *edge_mode_out) {
+    if (strcmp(value, "sobel") == 0) {
+        *edge_mode_out = FIB_EDGES_SOBEL;
+        return 1;
+    }
+    if (strcmp(value, "box") == 0) {
+        *edge_mode_out = FIB_EDGES_BOX;
+        return 1;
+    }
+    return 0;
+}
+
+const char *fib_output_format_name(FibOutputFormat format) {
+    return format == FIB_FORMAT_GRID ? "grid" : "text";
+}
+
+int fib_output_format_from_string(const char *value, FibOutputFormat *format_out) {
+    if (strcmp(value, "text") == 0) {
+        *format_out = FIB_FORMAT_TEXT;
+        return 1;
+    }
+    if (strcmp(value, "grid") == 0) {
+        *format_out = FIB_FORMAT_GRID;
+        return 1;
+    }
+    return 0;
+}
+
 static unsigned char quantized_value_to_u8(int quantized_index, int quantized_count) {
     if (quantized_index < 0) {
         quantized_index = 0;
@@ -92,16 +187,9 @@ static unsigned char apply_palette_tone_curve(unsigned char value, FibPalette pa
     return (unsigned char)adjusted;
 }
 
-static void build_tone_lookup_table(const FibImage *image, FibPalette palette, unsigned char tone_lookup[256]) {
-    uint32_t histogram[256] = {0};
-    size_t pixel_count = (size_t)image->width * (size_t)image->height;
-
-    for (size_t i = 0; i < pixel_count; i++) {
-        histogram[image->pixels[i]]++;
-    }
-
-    uint64_t low_threshold = (uint64_t)pixel_count / 100U;
-    uint64_t high_threshold = ((uint64_t)pixel_count * 99U) / 100U;
+static void build_tone_lookup_table(const uint32_t histogram[256], uint64_t pixel_count, FibPalette palette, unsigned char tone_lookup[256]) {
+    uint64_t low_threshold = pixel_count / 100U;
+    uint64_t high_threshold = (pixel_count * 99U) / 100U;
     uint64_t accumulator = 0;
     int low = 0;
     int high = 255;
@@ -142,58 +230,6 @@ static void build_tone_lookup_table(const FibImage *image, FibPalette palette, u
     }
 }
 
-static int build_summed_area_tables(const FibImage *image, uint64_t **sum_area_out, uint64_t **sum_square_out, size_t *stride_out) {
-    size_t stride = (size_t)image->width + 1U;
-    size_t row_count = (size_t)image->height + 1U;
-    size_t cell_count = 0;
-    uint64_t *sum_area = NULL;
-    uint64_t *sum_square = NULL;
-
-    if (!safe_multiply_size(stride, row_count, &cell_count) || cell_count > SIZE_MAX / sizeof(uint64_t)) {
-        return 0;
-    }
-
-    sum_area = (uint64_t *)calloc(cell_count, sizeof(uint64_t));
-    sum_square = (uint64_t *)calloc(cell_count, sizeof(uint64_t));
-    if (!sum_area || !sum_square) {
-        free(sum_area);
-        free(sum_square);
-        return 0;
-    }
-
-    for (int y = 1; y <= image->height; y++) {
-        uint64_t row_sum = 0;
-        uint64_t row_square_sum = 0;
-        const unsigned char *source = image->pixels + (size_t)(y - 1) * (size_t)image->width;
-        uint64_t *current_sum = sum_area + (size_t)y * stride;
-        uint64_t *previous_sum = sum_area + (size_t)(y - 1) * stride;
-        uint64_t *current_square = sum_square + (size_t)y * stride;
-        uint64_t *previous_square = sum_square + (size_t)(y - 1) * stride;
-
-        for (int x = 1; x <= image->width; x++) {
-            uint64_t value = source[x - 1];
-            row_sum += value;
-            row_square_sum += value * value;
-            current_sum[x] = previous_sum[x] + row_sum;
-            current_square[x] = previous_square[x] + row_square_sum;
-        }
-    }
-
-    *sum_area_out = sum_area;
-    *sum_square_out = sum_square;
-    *stride_out = stride;
-    return 1;
-}
-
-static uint64_t summed_area_block(const uint64_t *table, size_t stride, int x0, int y0, int x1, int y1) {
-    size_t sx0 = (size_t)x0;
-    size_t sx1 = (size_t)x1;
-    size_t sy0 = (size_t)y0;
-    size_t sy1 = (size_t)y1;
-
-    return table[sy1 * stride + sx1] - table[sy0 * stride + sx1] - table[sy1 * stride + sx0] + table[sy0 * stride + sx0];
-}
-
 static unsigned char clamp_pixel(const FibImage *image, int x, int y) {
     if (x < 0) {
         x = 0;
@@ -210,6 +246,56 @@ static unsigned char clamp_pixel(const FibImage *image, int x, int y) {
     return image->pixels[(size_t)y * (size_t)image->width + (size_t)x];
 }
 
+static void sobel_gradient(const FibImage *image, int cx, int cy, int *gradient_x, int *gradient_y) {
+    *gradient_x = -(int)clamp_pixel(image, cx - 1, cy - 1) - 2 * (int)clamp_pixel(image, cx - 1, cy) -
+                  (int)clamp_pixel(image, cx - 1, cy + 1) + (int)clamp_pixel(image, cx + 1, cy - 1) +
+                  2 * (int)clamp_pixel(image, cx + 1, cy) + (int)clamp_pixel(image, cx + 1, cy + 1);
+    *gradient_y = -(int)clamp_pixel(image, cx - 1, cy - 1) - 2 * (int)clamp_pixel(image, cx, cy - 1) -
+                  (int)clamp_pixel(image, cx + 1, cy - 1) + (int)clamp_pixel(image, cx - 1, cy + 1) +
+                  2 * (int)clamp_pixel(image, cx, cy + 1) + (int)clamp_pixel(image, cx + 1, cy + 1);
+}
+
+/*
+ * Four times the difference of two box means. When the boxes split the cell exactly in
+ * half, the second sum is the cell sum minus the first and one division suffices.
+ */
+static int half_difference(const FibAnalysis *analysis, uint64_t cell_sum, int split, int bx0, int by0, int bx1, int by1,
+                           int ax0, int ay0, int ax1, int ay1) {
+    uint64_t before_count = (uint64_t)(bx1 - bx0) * (uint64_t)(by1 - by0);
+    uint64_t after_count = (uint64_t)(ax1 - ax0) * (uint64_t)(ay1 - ay0);
+    uint64_t before_sum = fib_analysis_block_sum(analysis, bx0, by0, bx1, by1);
+
+    if (split) {
+        return (int)(4 * ((int64_t)(cell_sum - before_sum) - (int64_t)before_sum) / (int64_t)before_count);
+    }
+    uint64_t after_sum = fib_analysis_block_sum(analysis, ax0, ay0, ax1, ay1);
+    return (int)((int64_t)(4U * after_sum / after_count) - (int64_t)(4U * before_sum / before_count));
+}
+
+/*
+ * Cell-scale gradient from the summed-area tables: right half minus left half and bottom
+ * half minus top half, scaled by 4 so a step through the center scores like the Sobel
+ * kernel. For cells of even size the halves share the cell's own corners, so the estimate
+ * costs one box sum per axis instead of eight scattered pixel reads. A half that falls off
+ * the image (one-pixel cells on the border) replicates the center.
+ */
+static void box_gradient(const FibAnalysis *analysis, const FibImage *image, int x0, int y0, int x1, int y1, uint64_t cell_sum,
+                         int *gradient_x, int *gradient_y) {
+    int cx = (x0 + x1) >> 1;
+    int cy = (y0 + y1) >> 1;
+    int half_x = (x1 - x0) / 2 > 0 ? (x1 - x0) / 2 : 1;
+    int half_y = (y1 - y0) / 2 > 0 ? (y1 - y0) / 2 : 1;
+    int left = cx - half_x > 0 ? cx - half_x : 0;
+    int right = cx + half_x < image->width ? cx + half_x : image->width;
+    int top = cy - half_y > 0 ? cy - half_y : 0;
+    int bottom = cy + half_y < image->height ? cy + half_y : image->height;
+    int left_end = cx > left ? cx : cx + 1;
+    int top_end = cy > top ? cy : cy + 1;
+
+    *gradient_x = half_difference(analysis, cell_sum, left == x0 && right == x1, left, y0, left_end, y1, cx, y0, right, y1);
+    *gradient_y = half_difference(analysis, cell_sum, top == y0 && bottom == y1, x0, top, x1, top_end, x0, cy, x1, bottom);
+}
+
 static char edge_character(int gradient_x, int gradient_y) {
     int abs_x = gradient_x < 0 ? -gradient_x : gradient_x;
     int abs_y = gradient_y < 0 ? -gradient_y : gradient_y;
@@ -223,261 +309,1216 @@ static char edge_character(int gradient_x, int gradient_y) {
     return (gradient_x ^ gradient_y) < 0 ? '/' : '\\';
 }
 
-static void write_line(FILE *output, const char *line_chars, const unsigned char *line_shades, int width, int enable_color) {
-    if (!enable_color) {
-        fwrite(line_chars, 1, (size_t)width, output);
-        fputc('\n', output);
-        return;
+/* Integer variance of the gray values in a cell, the shape-mode test for structure. */
+static uint64_t cell_variance(const FibAnalysis *analysis, int has_summed_area, const FibImage *image, int x0, int y0, int x1,
+                              int y1, uint64_t sample_sum, uint64_t sample_count) {
+    uint64_t square_sum = 0;
+
+    if (has_summed_area) {
+        square_sum = fib_analysis_block_square(analysis, x0, y0, x1, y1);
+    } else {
+        for (int yy = y0; yy < y1; yy++) {
+            const unsigned char *row = image->pixels + (size_t)yy * (size_t)image->width;
+            for (int xx = x0; xx < x1; xx++) {
+                square_sum += (uint64_t)row[xx] * row[xx];
+            }
+        }
+    }
+
+    uint64_t mean = sample_sum / sample_count;
+    uint64_t mean_square = square_sum / sample_count;
+    return mean_square > mean * mean ? mean_square - mean * mean : 0;
+}
+
+/*
+ * Shape signature of one cell (see fib_glyph.h): bit set where a 4x4 sub-block is darker
+ * than the cell mean, compared by cross-multiplying sums and pixel counts so no division
+ * is needed. The cell must be at least 4x4 pixels.
+ */
+static uint16_t cell_signature(const FibAnalysis *analysis, int has_summed_area, const FibImage *image, int x0, int y0, int x1,
+                               int y1, uint64_t cell_sum, uint64_t cell_count) {
+    int edges_x[FIB_GLYPH_GRID + 1];
+    int edges_y[FIB_GLYPH_GRID + 1];
+    uint16_t signature = 0;
+
+    for (int i = 0; i <= FIB_GLYPH_GRID; i++) {
+        edges_x[i] = x0 + ((x1 - x0) * i) / FIB_GLYPH_GRID;
+        edges_y[i] = y0 + ((y1 - y0) * i) / FIB_GLYPH_GRID;
+    }
+
+    for (int block_y = 0; block_y < FIB_GLYPH_GRID; block_y++) {
+        int sy0 = edges_y[block_y];
+        int sy1 = edges_y[block_y + 1];
+        for (int block_x = 0; block_x < FIB_GLYPH_GRID; block_x++) {
+            int sx0 = edges_x[block_x];
+            int sx1 = edges_x[block_x + 1];
+            uint64_t sum = 0;
+
+            if (has_summed_area) {
+                sum = fib_analysis_block_sum(analysis, sx0, sy0, sx1, sy1);
+            } else {
+                for (int yy = sy0; yy < sy1; yy++) {
+                    const unsigned char *row = image->pixels + (size_t)yy * (size_t)image->width;
+                    for (int xx = sx0; xx < sx1; xx++) {
+                        sum += row[xx];
+                    }
+                }
+            }
+
+            uint64_t count = (uint64_t)(sx1 - sx0) * (uint64_t)(sy1 - sy0);
+            signature = (uint16_t)((signature << 1) | (sum * cell_count < cell_sum * count));
+        }
+    }
+    return signature;
+}
+
+static char *put_decimal(char *out, unsigned int value) {
+    if (value >= 100U) {
+        *out++ = (char)('0' + value / 100U);
+    }
+    if (value >= 10U) {
+        *out++ = (char)('0' + value / 10U % 10U);
     }
+    *out++ = (char)('0' + value % 10U);
+    return out;
+}
+
+/* Formats one colored line ("\x1b[38;2;S;S;Sm" before each glyph) and returns its length. */
+static size_t format_colored_line(char *out, const char *line_chars, const unsigned char *line_shades, int width) {
+    char *start = out;
 
     for (int x = 0; x < width; x++) {
         unsigned int shade = (unsigned int)line_shades[x];
-        fprintf(output, "\x1b[38;2;%u;%u;%um%c", shade, shade, shade, line_chars[x]);
+        memcpy(out, "\x1b[38;2;", 7);
+        out = put_decimal(out + 7, shade);
+        *out++ = ';';
+        out = put_decimal(out, shade);
+        *out++ = ';';
+        out = put_decimal(out, shade);
+        *out++ = 'm';
+        *out++ = line_chars[x];
     }
-    fputs("\x1b[0m\n", output);
+    memcpy(out, "\x1b[0m\n", 5);
+    return (size_t)(out + 5 - start);
 }
 
-void fib_render_ascii(const FibImage *image, const FibRenderConfig *config, FILE *output) {
-    float scale_x = (float)image->width / (float)config->output_width;
-    float scale_y = (float)image->height / (float)config->output_height;
-    const char *glyph_palette = palette_chars(config->palette);
-    size_t glyph_count = strlen(glyph_palette);
+FibSatLayout fib_render_sat_layout(int image_width, int image_height, const FibRenderConfig *config) {
+    int compact_fits = fib_analysis_compact_fits(image_width, image_height, config->output_width, config->output_height);
+
+    /* a compact plan made for one output size can overflow after a resize */
+    if (config->sat_layout == FIB_SAT_COMPACT && !compact_fits) {
+        return FIB_SAT_WIDE;
+    }
+    if (config->sat_layout != FIB_SAT_AUTO) {
+        return config->sat_layout;
+    }
+    return compact_fits && !config->prefer_wide_sat ? FIB_SAT_COMPACT : FIB_SAT_WIDE;
+}
+
+/*
+ * Box-prefilter factor for the quality tier: the largest integer reduction that still
+ * leaves the tier's pixels per cell along both axes, or 1 when no reduction applies.
+ */
+int fib_render_quality_factor(int image_width, int image_height, const FibRenderConfig *config) {
+    int pixels_per_cell = 0;
+
+    if (config->quality == FIB_QUALITY_FAST) {
+        pixels_per_cell = FIB_QUALITY_FAST_PIXELS_PER_CELL;
+    } else if (config->quality == FIB_QUALITY_BALANCED) {
+        pixels_per_cell = FIB_QUALITY_BALANCED_PIXELS_PER_CELL;
+    } else {
+        return 1;
+    }
+
+    int factor_x = image_width / (config->output_width * pixels_per_cell);
+    int factor_y = image_height / (config->output_height * pixels_per_cell);
+    int factor = factor_x < factor_y ? factor_x : factor_y;
+    return factor < 2 ? 1 : factor;
+}
+
+void fib_render_context_init(FibRenderContext *context) {
+    memset(context, 0, sizeof(*context));
+}
+
+void fib_render_context_free(FibRenderContext *context) {
+    if (context->overlap_stream) {
+        fib_analysis_stream_finish(context->overlap_stream);
+    }
+    fib_analysis_free(&context->analysis);
+    fib_image_free(&context->reduced);
+    free(context->shape_table);
+    free(context->grid_frame);
+    free(context->line_chars);
+    free(context->line_shades);
+    free(context->error_line_current);
+    free(context->error_line_next);
+    fib_sink_free(&context->stream_sink);
+    free(context->history.pixels);
+    free(context->history.chars);
+    free(context->history.shades);
+    free(context->history.errors);
+    free(context->history.dirty_prefix);
+    free(context->history.row_changed);
+    fib_render_context_init(context);
+}
+
+void fib_render_context_invalidate(FibRenderContext *context) {
+    context->analysis_ready = 0;
+}
+
+int fib_render_context_overlap(FibRenderContext *context, int image_width, int image_height, const FibRenderConfig *config) {
+    FibSatLayout layout = fib_render_sat_layout(image_width, image_height, config);
+
+    context->overlap_width = 0;
+    context->overlap_height = 0;
+    if (fib_render_quality_factor(image_width, image_height, config) > 1 || layout == FIB_SAT_BANDED ||
+        fib_resolve_thread_count(config->thread_count) < 2) {
+        return 0;
+    }
+    context->overlap_layout = layout;
+    context->overlap_width = image_width;
+    context->overlap_height = image_height;
+    return 1;
+}
+
+/* FibImageRowsFn for an armed context; anything unexpected falls back to prepare_analysis. */
+void fib_render_context_rows_ready(void *user_data, const FibImage *image, int row_end) {
+    FibRenderContext *context = (FibRenderContext *)user_data;
+
+    if (row_end == 0) {
+        context->analysis_ready = 0;
+        if (context->overlap_width == image->width && context->overlap_height == image->height) {
+            context->overlap_stream = fib_analysis_stream_start(&context->analysis, image, context->overlap_layout);
+        }
+        return;
+    }
+    if (!context->overlap_stream) {
+        return;
+    }
+    if (row_end > 0) {
+        fib_analysis_stream_rows(context->overlap_stream, row_end);
+        return;
+    }
+
+    int complete = fib_analysis_stream_finish(context->overlap_stream);
+    context->overlap_stream = NULL;
+    context->overlap_width = 0;
+    context->overlap_height = 0;
+    if (complete) {
+        context->image_width = image->width;
+        context->image_height = image->height;
+        context->reduce_factor = 1;
+        context->history.ready = 0;
+        context->analysis_ready = 1;
+    }
+}
+
+static int reserve_line_buffers(FibRenderContext *context, int width) {
+    if (context->line_capacity >= width) {
+        return 1;
+    }
+
+    size_t error_count = (size_t)width + 2U;
+    size_t error_bytes = 0;
+    char *line_chars = (char *)realloc(context->line_chars, (size_t)width);
+    if (line_chars) {
+        context->line_chars = line_chars;
+    }
+    unsigned char *line_shades = (unsigned char *)realloc(context->line_shades, (size_t)width);
+    if (line_shades) {
+        context->line_shades = line_shades;
+    }
+    free(context->error_line_current);
+    free(context->error_line_next);
+    context->error_line_current = NULL;
+    context->error_line_next = NULL;
+    if (safe_multiply_size(error_count, sizeof(float), &error_bytes)) {
+        context->error_line_current = (float *)calloc(error_count, sizeof(float));
+        context->error_line_next = (float *)calloc(error_count, sizeof(float));
+    }
+
+    if (!line_chars || !line_shades) {
+        return 0;
+    }
+    context->line_capacity = width;
+    return 1;
+}
+
+/*
+ * Builds (or reuses) the analysis for this draw and returns the image the draw samples:
+ * the input itself, or the context's reduced grid for the faster quality tiers. Those
+ * tiers keep a histogram of full-resolution pixels (strided for fast) for the tone curve.
+ */
+static const FibImage *prepare_analysis(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config,
+                                        int *has_tables) {
+    int factor = fib_render_quality_factor(image->width, image->height, config);
+    const FibImage *source = factor > 1 ? &context->reduced : image;
+    FibSatLayout sat_layout = fib_render_sat_layout(source->width, source->height, config);
+
+    /* Tables do not depend on the output size, only the banded ring is consumed by a draw. */
+    if (context->analysis_ready && context->image_width == image->width && context->image_height == image->height &&
+        context->reduce_factor == factor && context->analysis.layout == sat_layout && sat_layout != FIB_SAT_BANDED) {
+        *has_tables = fib_analysis_has_tables(&context->analysis);
+        return source;
+    }
+
+    uint32_t histogram[256];
+    uint64_t sample_count = 0;
+    int histogram_stride = config->quality == FIB_QUALITY_FAST ? factor : 1;
+    if (factor > 1 && !fib_analysis_reduce(image, factor, histogram_stride, config->thread_count, &context->reduced, histogram,
+                                           &sample_count)) {
+        factor = 1;
+        source = image;
+    }
+    sat_layout = fib_render_sat_layout(source->width, source->height, config);
+
+    size_t band_rows = fib_analysis_band_rows(source->height, config->output_height);
+    *has_tables = fib_analysis_refresh(source, sat_layout, band_rows, config->thread_count, &context->analysis);
+    context->history.ready = 0;
+    if (factor > 1) {
+        memcpy(context->analysis.histogram, histogram, sizeof(histogram));
+        context->analysis.pixel_count = sample_count;
+    }
+    context->image_width = image->width;
+    context->image_height = image->height;
+    context->reduce_factor = factor;
+    context->analysis_ready = 1;
+    return source;
+}
+
+/* Builds the signature -> glyph table for the palette on first use in shape mode. */
+static const char *prepare_shape_table(FibRenderContext *context, const FibRenderConfig *config) {
+    char candidates[sizeof(k_palette_smooth) + sizeof(k_shape_extra_glyphs)];
+
+    if (config->glyph_mode != FIB_GLYPHS_SHAPE) {
+        return NULL;
+    }
+    if (context->shape_table && context->shape_palette == config->palette) {
+        return context->shape_table;
+    }
+    if (!context->shape_table) {
+        context->shape_table = (char *)malloc(FIB_GLYPH_SHAPE_COUNT);
+        if (!context->shape_table) {
+            return NULL;
+        }
+    }
+
+    snprintf(candidates, sizeof(candidates), "%s%s", palette_chars(config->palette), k_shape_extra_glyphs);
+    if (!fib_glyph_shape_table_build(candidates, context->shape_table)) {
+        free(context->shape_table);
+        context->shape_table = NULL;
+        return NULL;
+    }
+    context->shape_palette = config->palette;
+    return context->shape_table;
+}
+
+/* Sizes the grid frame for this draw and writes its header; NULL in text mode or on failure. */
+static unsigned char *prepare_grid_frame(FibRenderContext *context, const FibRenderConfig *config, size_t *frame_size_out) {
+    if (config->format != FIB_FORMAT_GRID) {
+        return NULL;
+    }
+
+    size_t frame_size = fib_grid_frame_size(config->output_width, config->output_height);
+    if (context->grid_capacity < frame_size) {
+        unsigned char *frame = (unsigned char *)realloc(context->grid_frame, frame_size);
+        if (!frame) {
+            fprintf(stderr, "error: out of memory for grid frame\n");
+            return NULL;
+        }
+        context->grid_frame = frame;
+        context->grid_capacity = frame_size;
+    }
+    fib_grid_write_header(context->grid_frame, config->output_width, config->output_height, (int)config->palette,
+                          (int)config->glyph_mode);
+    *frame_size_out = frame_size;
+    return context->grid_frame;
+}
+
+/*
+ * Everything a row of cells reads that stays fixed for one draw. Rows only read it, so
+ * poster bands share one plan across threads. A shard's image is a window of rows
+ * starting at source row row_offset of a source_height-row image; cells are placed on
+ * the whole image and then addressed inside the window.
+ */
+typedef struct {
+    const FibImage *image;
+    const FibAnalysis *analysis;
+    int row_offset;
+    int source_height;
+    int has_summed_area;
+    int box_edges;
+    int width;
+    float scale_x;
+    float scale_y;
+    const char *glyph_palette;
+    int quantized_count;
+    const char *shape_table;
     unsigned char tone_lookup[256];
-    uint64_t *sum_area = NULL;
-    uint64_t *sum_square = NULL;
-    size_t sat_stride = 0;
-    int has_summed_area = build_summed_area_tables(image, &sum_area, &sum_square, &sat_stride);
+} DrawPlan;
+
+static void fill_plan(FibRenderContext *context, const FibRenderConfig *config, const FibImage *image, int row_offset,
+                      int source_height, int has_summed_area, DrawPlan *plan) {
+    plan->image = image;
+    plan->analysis = &context->analysis;
+    plan->row_offset = row_offset;
+    plan->source_height = source_height;
+    plan->has_summed_area = has_summed_area;
+    plan->box_edges = has_summed_area && config->edge_mode == FIB_EDGES_BOX;
+    plan->width = config->output_width;
+    plan->scale_x = (float)image->width / (float)config->output_width;
+    plan->scale_y = (float)source_height / (float)config->output_height;
+    plan->glyph_palette = palette_chars(config->palette);
+    plan->quantized_count = (int)strlen(plan->glyph_palette);
+    if (plan->quantized_count < 2) {
+        plan->quantized_count = 2;
+    }
+    plan->shape_table = prepare_shape_table(context, config);
+    build_tone_lookup_table(context->analysis.histogram, context->analysis.pixel_count, config->palette, plan->tone_lookup);
+}
+
+static void prepare_draw(FibRenderContext *context, const FibImage *input, const FibRenderConfig *config, DrawPlan *plan) {
+    int has_summed_area = 0;
+    const FibImage *image = prepare_analysis(context, input, config, &has_summed_area);
 
-    char *line_chars = (char *)malloc((size_t)config->output_width);
-    unsigned char *line_shades = (unsigned char *)malloc((size_t)config->output_width);
-    size_t error_buffer_size = 0;
-    float *error_line_current = NULL;
-    float *error_line_next = NULL;
+    fill_plan(context, config, image, 0, image->height, has_summed_area, plan);
+}
 
-    build_tone_lookup_table(image, config->palette, tone_lookup);
+/* Rows [y0, y1) of the plan's image sampled by output row y. */
+static void cell_rows(const DrawPlan *plan, int y, int *y0, int *y1) {
+    *y0 = (int)(y * plan->scale_y);
+    *y1 = (int)((y + 1) * plan->scale_y);
 
-    if (safe_multiply_size((size_t)(config->output_width + 2), sizeof(float), &error_buffer_size)) {
-        error_line_current = (float *)calloc((size_t)(config->output_width + 2), sizeof(float));
-        error_line_next = (float *)calloc((size_t)(config->output_width + 2), sizeof(float));
+    if (*y0 < 0) {
+        *y0 = 0;
+    }
+    if (*y1 <= *y0) {
+        *y1 = *y0 + 1;
+    }
+    if (*y1 > plan->source_height) {
+        *y1 = plan->source_height;
+    }
+    if (*y0 >= plan->source_height) {
+        *y0 = plan->source_height - 1;
+        *y1 = plan->source_height;
     }
+    *y0 -= plan->row_offset;
+    *y1 -= plan->row_offset;
+}
+
+/* Pulls a banded table ring far enough down for output row y's cells and neighborhoods. */
+static void advance_tables(FibAnalysis *analysis, const DrawPlan *plan, int y) {
+    int y0 = 0;
+    int y1 = 0;
+
+    if (!plan->has_summed_area || analysis->layout != FIB_SAT_BANDED) {
+        return;
+    }
+    cell_rows(plan, y, &y0, &y1);
+    int row_radius = (y1 - y0) * 2;
+    fib_analysis_advance(analysis, plan->image, ((y0 + y1) >> 1) + (row_radius < 1 ? 1 : row_radius) + 1);
+}
 
+/*
+ * Renders output row y into line_chars/line_shades. error_line_current holds the error
+ * diffused into this row and error_line_next is cleared and filled for the next one;
+ * both are NULL when dithering is unavailable.
+ */
+static void draw_row(const DrawPlan *plan, int y, char *line_chars, unsigned char *line_shades, float *error_line_current,
+                     float *error_line_next) {
+    const FibImage *image = plan->image;
+    const FibAnalysis *analysis = plan->analysis;
+    int has_summed_area = plan->has_summed_area;
+    int box_edges = plan->box_edges;
+    float scale_x = plan->scale_x;
+    const char *glyph_palette = plan->glyph_palette;
+    const char *shape_table = plan->shape_table;
+    const unsigned char *tone_lookup = plan->tone_lookup;
+    int quantized_count = plan->quantized_count;
     int has_error_diffusion = (error_line_current != NULL && error_line_next != NULL);
-    int quantized_count = (int)glyph_count;
-    if (quantized_count < 2) {
-        quantized_count = 2;
+    int y0 = 0;
+    int y1 = 0;
+
+    cell_rows(plan, y, &y0, &y1);
+    if (has_error_diffusion) {
+        memset(error_line_next, 0, ((size_t)plan->width + 2U) * sizeof(float));
     }
 
-    for (int y = 0; y < config->output_height; y++) {
-        int y0 = (int)(y * scale_y);
-        int y1 = (int)((y + 1) * scale_y);
+    int left_to_right = ((y & 1) == 0);
+    int x_start = left_to_right ? 0 : plan->width - 1;
+    int x_end = left_to_right ? plan->width : -1;
+    int x_step = left_to_right ? 1 : -1;
+
+    for (int x = x_start; x != x_end; x += x_step) {
+        int x0 = (int)(x * scale_x);
+        int x1 = (int)((x + 1) * scale_x);
 
-        if (y0 < 0) {
-            y0 = 0;
+        if (x0 < 0) {
+            x0 = 0;
         }
-        if (y1 <= y0) {
-            y1 = y0 + 1;
+        if (x1 <= x0) {
+            x1 = x0 + 1;
         }
-        if (y1 > image->height) {
-            y1 = image->height;
+        if (x1 > image->width) {
+            x1 = image->width;
         }
-        if (y0 >= image->height) {
-            y0 = image->height - 1;
-            y1 = image->height;
+        if (x0 >= image->width) {
+            x0 = image->width - 1;
+            x1 = image->width;
         }
 
-        if (has_error_diffusion) {
-            memset(error_line_next, 0, error_buffer_size);
+        uint64_t sample_count = (uint64_t)(x1 - x0) * (uint64_t)(y1 - y0);
+        uint64_t sample_sum = 0;
+
+        if (has_summed_area) {
+            sample_sum = fib_analysis_block_sum(analysis, x0, y0, x1, y1);
+        } else {
+            for (int yy = y0; yy < y1; yy++) {
+                for (int xx = x0; xx < x1; xx++) {
+                    sample_sum += image->pixels[(size_t)yy * (size_t)image->width + (size_t)xx];
+                }
+            }
         }
 
-        int left_to_right = ((y & 1) == 0);
-        int x_start = left_to_right ? 0 : config->output_width - 1;
-        int x_end = left_to_right ? config->output_width : -1;
-        int x_step = left_to_right ? 1 : -1;
+        unsigned char average_value = sample_count ? (unsigned char)(sample_sum / sample_count) : 0;
+        int cx = (x0 + x1) >> 1;
+        int cy = (y0 + y1) >> 1;
 
-        for (int x = x_start; x != x_end; x += x_step) {
-            int x0 = (int)(x * scale_x);
-            int x1 = (int)((x + 1) * scale_x);
+        int gradient_x = 0;
+        int gradient_y = 0;
+        if (box_edges) {
+            box_gradient(analysis, image, x0, y0, x1, y1, sample_sum, &gradient_x, &gradient_y);
+        } else {
+            sobel_gradient(image, cx, cy, &gradient_x, &gradient_y);
+        }
+        int gradient_magnitude = (gradient_x < 0 ? -gradient_x : gradient_x) +
+                                 (gradient_y < 0 ? -gradient_y : gradient_y);
 
-            if (x0 < 0) {
-                x0 = 0;
-            }
-            if (x1 <= x0) {
-                x1 = x0 + 1;
-            }
-            if (x1 > image->width) {
-                x1 = image->width;
-            }
-            if (x0 >= image->width) {
-                x0 = image->width - 1;
-                x1 = image->width;
-            }
+        int radius_x = (x1 - x0) * 2;
+        int radius_y = (y1 - y0) * 2;
+        if (radius_x < 1) {
+            radius_x = 1;
+        }
+        if (radius_y < 1) {
+            radius_y = 1;
+        }
 
-            uint64_t sample_count = (uint64_t)(x1 - x0) * (uint64_t)(y1 - y0);
-            uint64_t sample_sum = 0;
+        int nx0 = cx - radius_x;
+        int nx1 = cx + radius_x + 1;
+        int ny0 = cy - radius_y;
+        int ny1 = cy + radius_y + 1;
 
-            if (has_summed_area) {
-                sample_sum = summed_area_block(sum_area, sat_stride, x0, y0, x1, y1);
-            } else {
-                for (int yy = y0; yy < y1; yy++) {
-                    for (int xx = x0; xx < x1; xx++) {
-                        sample_sum += image->pixels[(size_t)yy * (size_t)image->width + (size_t)xx];
-                    }
+        if (nx0 < 0) {
+            nx0 = 0;
+        }
+        if (ny0 < 0) {
+            ny0 = 0;
+        }
+        if (nx1 > image->width) {
+            nx1 = image->width;
+        }
+        if (ny1 > image->height) {
+            ny1 = image->height;
+        }
+
+        uint64_t neighborhood_count = (uint64_t)(nx1 - nx0) * (uint64_t)(ny1 - ny0);
+        uint64_t neighborhood_sum = 0;
+        uint64_t neighborhood_square_sum = 0;
+
+        if (has_summed_area && neighborhood_count > 0) {
+            neighborhood_sum = fib_analysis_block_sum(analysis, nx0, ny0, nx1, ny1);
+            neighborhood_square_sum = fib_analysis_block_square(analysis, nx0, ny0, nx1, ny1);
+        } else {
+            for (int yy = ny0; yy < ny1; yy++) {
+                for (int xx = nx0; xx < nx1; xx++) {
+                    uint64_t pixel_value = image->pixels[(size_t)yy * (size_t)image->width + (size_t)xx];
+                    neighborhood_sum += pixel_value;
+                    neighborhood_square_sum += pixel_value * pixel_value;
                 }
             }
+        }
 
-            unsigned char average_value = sample_count ? (unsigned char)(sample_sum / sample_count) : 0;
-            int cx = (x0 + x1) >> 1;
-            int cy = (y0 + y1) >> 1;
-
-            int gradient_x =
-                -(int)clamp_pixel(image, cx - 1, cy - 1) - 2 * (int)clamp_pixel(image, cx - 1, cy) -
-                (int)clamp_pixel(image, cx - 1, cy + 1) + (int)clamp_pixel(image, cx + 1, cy - 1) +
-                2 * (int)clamp_pixel(image, cx + 1, cy) + (int)clamp_pixel(image, cx + 1, cy + 1);
+        int neighborhood_average = average_value;
+        long double variance = 0.0L;
+        if (neighborhood_count > 0) {
+            long double mean = (long double)neighborhood_sum / (long double)neighborhood_count;
+            neighborhood_average = (int)(mean + 0.5L);
+            variance = (long double)neighborhood_square_sum / (long double)neighborhood_count - mean * mean;
+            if (variance < 0.0L) {
+                variance = 0.0L;
+            }
+        }
 
-            int gradient_y =
-                -(int)clamp_pixel(image, cx - 1, cy - 1) - 2 * (int)clamp_pixel(image, cx, cy - 1) -
-                (int)clamp_pixel(image, cx + 1, cy - 1) + (int)clamp_pixel(image, cx - 1, cy + 1) +
-                2 * (int)clamp_pixel(image, cx, cy + 1) + (int)clamp_pixel(image, cx + 1, cy + 1);
+        long double gain = 1.55L;
+        if (variance < 180.0L) {
+            gain = 2.35L;
+        } else if (variance < 800.0L) {
+            gain = 1.95L;
+        }
 
-            int gradient_magnitude = (gradient_x < 0 ? -gradient_x : gradient_x) +
-                                     (gradient_y < 0 ? -gradient_y : gradient_y);
+        int local_value = (int)((long double)average_value + gain * ((long double)average_value - (long double)neighborhood_average));
+        if (local_value < 0) {
+            local_value = 0;
+        }
+        if (local_value > 255) {
+            local_value = 255;
+        }
 
-            int radius_x = (x1 - x0) * 2;
-            int radius_y = (y1 - y0) * 2;
-            if (radius_x < 1) {
-                radius_x = 1;
+        int error_index = x + 1;
+        float tone_value = (float)tone_lookup[local_value];
+        if (has_error_diffusion) {
+            tone_value += error_line_current[error_index];
+            if (tone_value < 0.0f) {
+                tone_value = 0.0f;
             }
-            if (radius_y < 1) {
-                radius_y = 1;
+            if (tone_value > 255.0f) {
+                tone_value = 255.0f;
             }
+        }
+
+        int edge_threshold = (variance < 220.0L) ? 76 : 116;
+        char chosen_char;
+        char shape_char = 0;
+        unsigned char shade_value = (unsigned char)local_value;
 
-            int nx0 = cx - radius_x;
-            int nx1 = cx + radius_x + 1;
-            int ny0 = cy - radius_y;
-            int ny1 = cy + radius_y + 1;
+        if (shape_table && x1 - x0 >= FIB_GLYPH_GRID && y1 - y0 >= FIB_GLYPH_GRID &&
+            (gradient_magnitude > edge_threshold ||
+             cell_variance(analysis, has_summed_area, image, x0, y0, x1, y1, sample_sum, sample_count) >= FIB_SHAPE_MIN_VARIANCE)) {
+            shape_char = shape_table[cell_signature(analysis, has_summed_area, image, x0, y0, x1, y1, sample_sum, sample_count)];
+        }
 
-            if (nx0 < 0) {
-                nx0 = 0;
+        if (shape_char) {
+            chosen_char = shape_char;
+            if (has_error_diffusion) {
+                error_line_current[error_index] = 0.0f;
             }
-            if (ny0 < 0) {
-                ny0 = 0;
+        } else if (gradient_magnitude > edge_threshold) {
+            chosen_char = edge_character(gradient_x, gradient_y);
+            if (has_error_diffusion) {
+                error_line_current[error_index] = 0.0f;
             }
-            if (nx1 > image->width) {
-                nx1 = image->width;
+        } else {
+            int quantized_index = (int)((tone_value * (float)(quantized_count - 1)) / 255.0f + 0.5f);
+            if (quantized_index < 0) {
+                quantized_index = 0;
             }
-            if (ny1 > image->height) {
-                ny1 = image->height;
+            if (quantized_index >= quantized_count) {
+                quantized_index = quantized_count - 1;
             }
 
-            uint64_t neighborhood_count = (uint64_t)(nx1 - nx0) * (uint64_t)(ny1 - ny0);
-            uint64_t neighborhood_sum = 0;
-            uint64_t neighborhood_square_sum = 0;
+            chosen_char = glyph_palette[quantized_index];
+            shade_value = quantized_value_to_u8(quantized_index, quantized_count);
 
-            if (has_summed_area && neighborhood_count > 0) {
-                neighborhood_sum = summed_area_block(sum_area, sat_stride, nx0, ny0, nx1, ny1);
-                neighborhood_square_sum = summed_area_block(sum_square, sat_stride, nx0, ny0, nx1, ny1);
-            } else {
-                for (int yy = ny0; yy < ny1; yy++) {
-                    for (int xx = nx0; xx < nx1; xx++) {
-                        uint64_t pixel_value = image->pixels[(size_t)yy * (size_t)image->width + (size_t)xx];
-                        neighborhood_sum += pixel_value;
-                        neighborhood_square_sum += pixel_value * pixel_value;
-                    }
+            if (has_error_diffusion) {
+                float quantization_error = tone_value - (float)shade_value;
+                if (left_to_right) {
+                    error_line_current[error_index + 1] += quantization_error * (7.0f / 16.0f);
+                    error_line_next[error_index - 1] += quantization_error * (3.0f / 16.0f);
+                    error_line_next[error_index] += quantization_error * (5.0f / 16.0f);
+                    error_line_next[error_index + 1] += quantization_error * (1.0f / 16.0f);
+                } else {
+                    error_line_current[error_index - 1] += quantization_error * (7.0f / 16.0f);
+                    error_line_next[error_index + 1] += quantization_error * (3.0f / 16.0f);
+                    error_line_next[error_index] += quantization_error * (5.0f / 16.0f);
+                    error_line_next[error_index - 1] += quantization_error * (1.0f / 16.0f);
                 }
             }
+        }
 
-            int neighborhood_average = average_value;
-            long double variance = 0.0L;
-            if (neighborhood_count > 0) {
-                long double mean = (long double)neighborhood_sum / (long double)neighborhood_count;
-                neighborhood_average = (int)(mean + 0.5L);
-                variance = (long double)neighborhood_square_sum / (long double)neighborhood_count - mean * mean;
-                if (variance < 0.0L) {
-                    variance = 0.0L;
-                }
-            }
+        line_chars[x] = chosen_char;
+        line_shades[x] = shade_value;
+    }
+}
 
-            long double gain = 1.55L;
-            if (variance < 180.0L) {
-                gain = 2.35L;
-            } else if (variance < 800.0L) {
-                gain = 1.95L;
-            }
+void fib_render_ascii(const FibImage *image, const FibRenderConfig *config, FILE *output) {
+    FibRenderContext context;
 
-            int local_value = (int)((long double)average_value + gain * ((long double)average_value - (long double)neighborhood_average));
-            if (local_value < 0) {
-                local_value = 0;
-            }
-            if (local_value > 255) {
-                local_value = 255;
-            }
+    fib_render_context_init(&context);
+    fib_render_context_draw(&context, image, config, output);
+    fib_render_context_free(&context);
+}
 
-            int error_index = x + 1;
-            float tone_value = (float)tone_lookup[local_value];
-            if (has_error_diffusion) {
-                tone_value += error_line_current[error_index];
-                if (tone_value < 0.0f) {
-                    tone_value = 0.0f;
-                }
-                if (tone_value > 255.0f) {
-                    tone_value = 255.0f;
-                }
+/* Upper bound of one emitted frame, enough for a fixed buffer sink that never overflows. */
+size_t fib_render_frame_bytes(const FibRenderConfig *config) {
+    size_t rows = (size_t)config->output_height;
+
+    if (config->format == FIB_FORMAT_GRID) {
+        return fib_grid_frame_size(config->output_width, config->output_height);
+    }
+    if (config->enable_color) {
+        return rows * ((size_t)config->output_width * FIB_COLORED_CELL_BYTES + 5U);
+    }
+    return rows * ((size_t)config->output_width + 1U);
+}
+
+/*
+ * Renders one frame into a sink. Uncolored rows are drawn straight into the room the sink
+ * reserves; colored rows are drawn into the context line and formatted into that room.
+ * Returns 0 when the sink fails, the callback stops the draw or a buffer is too small.
+ */
+int fib_render_context_emit(FibRenderContext *context, const FibImage *input, const FibRenderConfig *config, FibSink *sink) {
+    DrawPlan plan;
+
+    fib_sink_begin(sink);
+    prepare_draw(context, input, config, &plan);
+    if (!reserve_line_buffers(context, config->output_width)) {
+        fprintf(stderr, "error: out of memory for render line\n");
+        return 0;
+    }
+
+    size_t grid_frame_size = 0;
+    unsigned char *grid_frame = prepare_grid_frame(context, config, &grid_frame_size);
+    size_t grid_cells = (size_t)config->output_width * (size_t)config->output_height;
+    size_t line_size = config->enable_color ? (size_t)config->output_width * FIB_COLORED_CELL_BYTES + 5U
+                                            : (size_t)config->output_width + 1U;
+    char *line_chars = context->line_chars;
+    unsigned char *line_shades = context->line_shades;
+    float *error_line_current = context->error_line_current;
+    float *error_line_next = context->error_line_next;
+    int complete = 1;
+
+    if (config->format == FIB_FORMAT_GRID && !grid_frame) {
+        return 0;
+    }
+    int has_error_diffusion = (error_line_current != NULL && error_line_next != NULL);
+    if (has_error_diffusion) {
+        memset(error_line_current, 0, ((size_t)config->output_width + 2U) * sizeof(float));
+    }
+
+    for (int y = 0; y < config->output_height && complete; y++) {
+        /* grid rows are rendered straight into the frame's glyph and shade arrays */
+        if (grid_frame) {
+            line_chars = (char *)grid_frame + FIB_GRID_HEADER_SIZE + (size_t)y * (size_t)config->output_width;
+            line_shades = grid_frame + FIB_GRID_HEADER_SIZE + grid_cells + (size_t)y * (size_t)config->output_width;
+        } else if (!config->enable_color) {
+            line_chars = fib_sink_reserve(sink, line_size);
+            if (!line_chars) {
+                complete = 0;
+                break;
             }
+        }
 
-            int edge_threshold = (variance < 220.0L) ? 76 : 116;
-            char chosen_char;
-            unsigned char shade_value = (unsigned char)local_value;
+        advance_tables(&context->analysis, &plan, y);
+        draw_row(&plan, y, line_chars, line_shades, error_line_current, error_line_next);
 
-            if (gradient_magnitude > edge_threshold) {
-                chosen_char = edge_character(gradient_x, gradient_y);
-                if (has_error_diffusion) {
-                    error_line_current[error_index] = 0.0f;
-                }
-            } else {
-                int quantized_index = (int)((tone_value * (float)(quantized_count - 1)) / 255.0f + 0.5f);
-                if (quantized_index < 0) {
-                    quantized_index = 0;
-                }
-                if (quantized_index >= quantized_count) {
-                    quantized_index = quantized_count - 1;
-                }
+        if (!grid_frame && config->enable_color) {
+            char *line = fib_sink_reserve(sink, line_size);
+            complete = line && fib_sink_commit(sink, line, format_colored_line(line, line_chars, line_shades, config->output_width));
+        } else if (!grid_frame) {
+            line_chars[config->output_width] = '\n';
+            complete = fib_sink_commit(sink, line_chars, line_size);
+        }
 
-                chosen_char = glyph_palette[quantized_index];
-                shade_value = quantized_value_to_u8(quantized_index, quantized_count);
-
-                if (has_error_diffusion) {
-                    float quantization_error = tone_value - (float)shade_value;
-                    if (left_to_right) {
-                        error_line_current[error_index + 1] += quantization_error * (7.0f / 16.0f);
-                        error_line_next[error_index - 1] += quantization_error * (3.0f / 16.0f);
-                        error_line_next[error_index] += quantization_error * (5.0f / 16.0f);
-                        error_line_next[error_index + 1] += quantization_error * (1.0f / 16.0f);
-                    } else {
-                        error_line_current[error_index - 1] += quantization_error * (7.0f / 16.0f);
-                        error_line_next[error_index + 1] += quantization_error * (3.0f / 16.0f);
-                        error_line_next[error_index] += quantization_error * (5.0f / 16.0f);
-                        error_line_next[error_index - 1] += quantization_error * (1.0f / 16.0f);
-                    }
+        if (has_error_diffusion) {
+            float *tmp = error_line_current;
+            error_line_current = error_line_next;
+            error_line_next = tmp;
+        }
+    }
+
+    context->error_line_current = error_line_current;
+    context->error_line_next = error_line_next;
+    if (grid_frame && complete) {
+        /* a stream keeps the one-write(2) frame path; other sinks take the frame as one row */
+        if (sink->kind == FIB_SINK_STREAM) {
+            complete = fib_grid_emit(sink->stream, grid_frame, grid_frame_size);
+            sink->length += grid_frame_size;
+        } else {
+            complete = fib_sink_commit(sink, (const char *)grid_frame, grid_frame_size);
+        }
+    }
+    return fib_sink_finish(sink) && complete;
+}
+
+FibSink *fib_render_context_stream_sink(FibRenderContext *context, FILE *output) {
+    fib_sink_set_stream(&context->stream_sink, output);
+    return &context->stream_sink;
+}
+
+void fib_render_context_draw(FibRenderContext *context, const FibImage *input, const FibRenderConfig *config, FILE *output) {
+    fib_render_context_emit(context, input, config, fib_render_context_stream_sink(context, output));
+}
+
+/* Whether the history was drawn from an image and settings this frame can build on. */
+static int history_matches(const FibRenderHistory *history, const FibImage *image, const FibRenderConfig *config) {
+    const FibRenderConfig *previous = &history->config;
+
+    return history->ready && history->image_width == image->width && history->image_height == image->height &&
+           previous->output_width == config->output_width && previous->output_height == config->output_height &&
+           previous->enable_color == config->enable_color && previous->palette == config->palette &&
+           previous->quality == config->quality && previous->glyph_mode == config->glyph_mode &&
+           previous->edge_mode == config->edge_mode && previous->sat_layout == config->sat_layout;
+}
+
+static int reserve_history(FibRenderHistory *history, const FibImage *image, const FibRenderConfig *config) {
+    size_t pixels = (size_t)image->width * (size_t)image->height;
+    size_t cells = (size_t)config->output_width * (size_t)config->output_height;
+    size_t errors = ((size_t)config->output_height + 1U) * ((size_t)config->output_width + 2U);
+
+    free(history->pixels);
+    free(history->chars);
+    free(history->shades);
+    free(history->errors);
+    free(history->dirty_prefix);
+    free(history->row_changed);
+    history->pixels = (unsigned char *)malloc(pixels);
+    history->chars = (char *)malloc(cells);
+    history->shades = (unsigned char *)malloc(cells);
+    history->errors = (float *)calloc(errors, sizeof(float));
+    history->dirty_prefix = (int *)calloc((size_t)image->height + 1U, sizeof(int));
+    history->row_changed = (unsigned char *)malloc((size_t)config->output_height);
+    if (!history->pixels || !history->chars || !history->shades || !history->errors || !history->dirty_prefix ||
+        !history->row_changed) {
+        fprintf(stderr, "error: out of memory for incremental render history\n");
+        history->ready = 0;
+        return 0;
+    }
+    memcpy(history->pixels, image->pixels, pixels);
+    return 1;
+}
+
+/*
+ * Compares the frame with the history copy inside the dirty rectangles, moves changed
+ * pixels between histogram bins, refreshes the copy and counts changed rows into
+ * dirty_prefix. Returns 0 when nothing changed; otherwise *min_x, *min_y is the corner
+ * of the table block that needs rebuilding.
+ */
+static int diff_frame(FibRenderHistory *history, uint32_t histogram[256], const FibImage *image, const FibRect *dirty,
+                      int dirty_count, int *min_x, int *min_y) {
+    FibRect whole = {0, 0, image->width, image->height};
+    int *prefix = history->dirty_prefix;
+    int changed = 0;
+
+    if (!dirty) {
+        dirty = &whole;
+        dirty_count = 1;
+    }
+    memset(prefix, 0, ((size_t)image->height + 1U) * sizeof(int));
+    *min_x = image->width;
+    *min_y = image->height;
+    for (int i = 0; i < dirty_count; i++) {
+        int x0 = dirty[i].x0 > 0 ? dirty[i].x0 : 0;
+        int y0 = dirty[i].y0 > 0 ? dirty[i].y0 : 0;
+        int x1 = dirty[i].x1 < image->width ? dirty[i].x1 : image->width;
+        int y1 = dirty[i].y1 < image->height ? dirty[i].y1 : image->height;
+
+        for (int y = y0; y < y1 && x0 < x1; y++) {
+            const unsigned char *source = image->pixels + (size_t)y * (size_t)image->width;
+            unsigned char *kept = history->pixels + (size_t)y * (size_t)image->width;
+            if (memcmp(source + x0, kept + x0, (size_t)(x1 - x0)) == 0) {
+                continue;
+            }
+            for (int x = x0; x < x1; x++) {
+                if (source[x] != kept[x]) {
+                    histogram[kept[x]]--;
+                    histogram[source[x]]++;
+                    kept[x] = source[x];
+                    *min_x = x < *min_x ? x : *min_x;
                 }
             }
-
-            line_chars[x] = chosen_char;
-            line_shades[x] = shade_value;
+            *min_y = y < *min_y ? y : *min_y;
+            prefix[y + 1] = 1;
+            changed = 1;
         }
+    }
+    for (int y = 0; y < image->height; y++) {
+        prefix[y + 1] += prefix[y];
+    }
+    return changed;
+}
 
-        write_line(output, line_chars, line_shades, config->output_width, config->enable_color);
+/* Whether any image row read by output row y (cell, Sobel taps, neighborhood) changed. */
+static int row_reads_dirty(const DrawPlan *plan, const int *dirty_prefix, int y) {
+    int y0 = 0;
+    int y1 = 0;
+
+    cell_rows(plan, y, &y0, &y1);
+    int radius = (y1 - y0) * 2 > 1 ? (y1 - y0) * 2 : 1;
+    int center = (y0 + y1) >> 1;
+    int first = center - radius > 0 ? center - radius : 0;
+    int end = center + radius + 1 < plan->source_height ? center + radius + 1 : plan->source_height;
+    return dirty_prefix[end] > dirty_prefix[first];
+}
+
+/*
+ * Redraws the history rows that can differ from the previous frame: every row when
+ * redraw_all, else rows reading a changed image row and rows below one whose outgoing
+ * dither error changed. Marks rows whose bytes changed.
+ */
+static void redraw_rows(FibRenderContext *context, const DrawPlan *plan, const FibRenderConfig *config, int fresh,
+                        int redraw_all) {
+    FibRenderHistory *history = &context->history;
+    int width = config->output_width;
+    size_t error_count = (size_t)width + 2U;
+    float *error_line_current = context->error_line_current;
+    float *error_line_next = context->error_line_next;
+    int has_error_diffusion = (error_line_current != NULL && error_line_next != NULL);
+    int carry = 0;
 
+    for (int y = 0; y < config->output_height; y++) {
+        char *row_chars = history->chars + (size_t)y * (size_t)width;
+        unsigned char *row_shades = history->shades + (size_t)y * (size_t)width;
+
+        if (!redraw_all && !carry && !row_reads_dirty(plan, history->dirty_prefix, y)) {
+            continue;
+        }
+
+        advance_tables(&context->analysis, plan, y);
         if (has_error_diffusion) {
+            memcpy(error_line_current, history->errors + (size_t)y * error_count, error_count * sizeof(float));
+        }
+        draw_row(plan, y, context->line_chars, context->line_shades, has_error_diffusion ? error_line_current : NULL,
+                 has_error_diffusion ? error_line_next : NULL);
+        history->rows_drawn++;
+
+        /* a row whose outgoing error is unchanged lets the rows below keep theirs */
+        float *kept_error = history->errors + (size_t)(y + 1) * error_count;
+        carry = has_error_diffusion && memcmp(error_line_next, kept_error, error_count * sizeof(float)) != 0;
+        if (carry) {
+            memcpy(kept_error, error_line_next, error_count * sizeof(float));
+        }
+        if (fresh || memcmp(row_chars, context->line_chars, (size_t)width) != 0 ||
+            (config->enable_color && memcmp(row_shades, context->line_shades, (size_t)width) != 0)) {
+            memcpy(row_chars, context->line_chars, (size_t)width);
+            memcpy(row_shades, context->line_shades, (size_t)width);
+            history->row_changed[y] = 1;
+        }
+    }
+}
+
+int fib_render_context_update(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config,
+                              const FibRect *dirty, int dirty_count, int changed_rows_only, FibSink *sink) {
+    FibRenderHistory *history = &context->history;
+    DrawPlan plan;
+    int width = config->output_width;
+    size_t line_size = (config->enable_color ? (size_t)width * FIB_COLORED_CELL_BYTES + 5U : (size_t)width + 1U) +
+                       (changed_rows_only ? FIB_CURSOR_MOVE_BYTES : 0U);
+    int min_x = 0;
+    int min_y = 0;
+    int complete = 1;
+
+    fib_sink_begin(sink);
+    if (config->format != FIB_FORMAT_TEXT) {
+        fprintf(stderr, "error: incremental rendering writes text only\n");
+        return 0;
+    }
+
+    int fresh = !history_matches(history, image, config);
+    if (fresh && !reserve_history(history, image, config)) {
+        return 0;
+    }
+    int changed = !fresh && diff_frame(history, context->analysis.histogram, image, dirty, dirty_count, &min_x, &min_y);
+
+    history->rows_drawn = 0;
+    history->rows_changed = 0;
+    memset(history->row_changed, fresh, (size_t)config->output_height);
+    if (fresh || changed) {
+        /*
+         * Tables are patched in place only at full resolution with whole tables; reduced
+         * grids and banded rings are rebuilt and then every row is redrawn.
+         */
+        int patchable = !fresh && context->reduce_factor == 1 && context->analysis.layout != FIB_SAT_BANDED;
+        if (patchable) {
+            fib_analysis_update(&context->analysis, image, min_x, min_y);
+            fill_plan(context, config, image, 0, image->height, fib_analysis_has_tables(&context->analysis), &plan);
+        } else {
+            context->analysis_ready = 0;
+            prepare_draw(context, image, config, &plan);
+        }
+        int redraw_all = !patchable;
+        if (memcmp(plan.tone_lookup, history->tone_lookup, sizeof(plan.tone_lookup)) != 0) {
+            memcpy(history->tone_lookup, plan.tone_lookup, sizeof(plan.tone_lookup));
+            redraw_all = 1;
+        }
+        if (!reserve_line_buffers(context, width)) {
+            fprintf(stderr, "error: out of memory for render line\n");
+            history->ready = 0;
+            return 0;
+        }
+        redraw_rows(context, &plan, config, fresh, redraw_all);
+    }
+
+    for (int y = 0; y < config->output_height && complete; y++) {
+        const char *row_chars = history->chars + (size_t)y * (size_t)width;
+        const unsigned char *row_shades = history->shades + (size_t)y * (size_t)width;
+        size_t length = 0;
+
+        history->rows_changed += history->row_changed[y];
+        if (changed_rows_only && !history->row_changed[y]) {
+            continue;
+        }
+        char *line = fib_sink_reserve(sink, line_size);
+        if (!line) {
+            complete = 0;
+            break;
+        }
+        if (changed_rows_only) {
+            length = (size_t)snprintf(line, FIB_CURSOR_MOVE_BYTES, "\x1b[%d;1H", y + 1);
+        }
+        if (config->enable_color) {
+            length += format_colored_line(line + length, row_chars, row_shades, width);
+        } else {
+            memcpy(line + length, row_chars, (size_t)width);
+            length += (size_t)width;
+            line[length++] = '\n';
+        }
+        complete = fib_sink_commit(sink, line, length);
+    }
+
+    history->config = *config;
+    history->image_width = image->width;
+    history->image_height = image->height;
+    history->ready = 1;
+    return fib_sink_finish(sink) && complete;
+}
+
+/*
+ * One poster thread: renders bands first_band, first_band + band_stride, ... below
+ * band_end into one buffer holding its two dither rows, a band of text lines and a row of
+ * unused shades. Rows land at their offset from row_base, the first row of the file.
+ */
+typedef struct {
+    const DrawPlan *plan;
+    FibAnalysis *banded_analysis;
+    int output_height;
+    int band_end;
+    int first_band;
+    int band_stride;
+    int row_base;
+    int fd;
+    char *lines;
+    unsigned char *shades;
+    float *errors;
+    int ok;
+} PosterWorker;
+
+size_t fib_render_poster_band_bytes(int output_width) {
+    size_t line_bytes = (size_t)output_width + 1U;
+    size_t error_bytes = ((size_t)output_width + 2U) * 2U * sizeof(float);
+    return line_bytes * FIB_POSTER_BAND_ROWS + (size_t)output_width + error_bytes;
+}
+
+static int write_at(int fd, const char *bytes, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            fprintf(stderr, "error: cannot write poster band at offset %lld: %s\n", (long long)offset,
+                    written < 0 ? strerror(errno) : "short write");
+            return 0;
+        }
+        bytes += written;
+        size -= (size_t)written;
+        offset += (off_t)written;
+    }
+    return 1;
+}
+
+/*
+ * Each band starts from zero diffused error and uses the global row parity for its
+ * serpentine direction, so a band's text depends only on its index, never on which
+ * thread renders it or in what order.
+ */
+static void *poster_worker(void *argument) {
+    PosterWorker *worker = (PosterWorker *)argument;
+    const DrawPlan *plan = worker->plan;
+    size_t line_bytes = (size_t)plan->width + 1U;
+    size_t error_count = (size_t)plan->width + 2U;
+
+    for (int band = worker->first_band; band < worker->band_end && worker->ok; band += worker->band_stride) {
+        int first_row = band * FIB_POSTER_BAND_ROWS;
+        int row_count = worker->output_height - first_row < FIB_POSTER_BAND_ROWS ? worker->output_height - first_row
+                                                                                 : FIB_POSTER_BAND_ROWS;
+        float *error_line_current = worker->errors;
+        float *error_line_next = worker->errors + error_count;
+
+        memset(error_line_current, 0, error_count * sizeof(float));
+        for (int row = 0; row < row_count; row++) {
+            char *line = worker->lines + (size_t)row * line_bytes;
+            if (worker->banded_analysis) {
+                advance_tables(worker->banded_analysis, plan, first_row + row);
+            }
+            draw_row(plan, first_row + row, line, worker->shades, error_line_current, error_line_next);
+            line[plan->width] = '\n';
+
             float *tmp = error_line_current;
             error_line_current = error_line_next;
             error_line_next = tmp;
         }
+        worker->ok = write_at(worker->fd, worker->lines, (size_t)row_count * line_bytes,
+                              (off_t)(first_row - worker->row_base) * (off_t)line_bytes);
+    }
+    return NULL;
+}
+
+/* Renders bands [band_begin, band_end) of the output into fd, which starts at band_begin. */
+static int render_bands(FibRenderContext *context, const DrawPlan *plan, const FibRenderConfig *config, int fd, int band_begin,
+                        int band_end) {
+    PosterWorker workers[FIB_POSTER_MAX_WORKERS];
+    pthread_t threads[FIB_POSTER_MAX_WORKERS];
+    int started[FIB_POSTER_MAX_WORKERS] = {0};
+    size_t line_bytes = (size_t)config->output_width + 1U;
+    size_t band_bytes = fib_render_poster_band_bytes(config->output_width);
+    int band_count = band_end - band_begin;
+    int row_base = band_begin * FIB_POSTER_BAND_ROWS;
+    int row_end = band_end * FIB_POSTER_BAND_ROWS < config->output_height ? band_end * FIB_POSTER_BAND_ROWS : config->output_height;
+    int ok = 1;
+
+    /* A banded table ring only moves down, so its bands are rendered in order on one thread. */
+    int banded = plan->has_summed_area && context->analysis.layout == FIB_SAT_BANDED;
+    int worker_count = banded ? 1 : fib_resolve_thread_count(config->thread_count);
+    if (worker_count > band_count) {
+        worker_count = band_count > 0 ? band_count : 0;
+    }
+    if (worker_count > FIB_POSTER_MAX_WORKERS) {
+        worker_count = FIB_POSTER_MAX_WORKERS;
     }
 
-    free(sum_area);
-    free(sum_square);
-    free(error_line_current);
-    free(error_line_next);
-    free(line_chars);
-    free(line_shades);
+    if (ftruncate(fd, (off_t)line_bytes * (off_t)(row_end > row_base ? row_end - row_base : 0)) != 0) {
+        fprintf(stderr, "error: cannot size poster output: %s\n", strerror(errno));
+        return 0;
+    }
+    if (config->verbose) {
+        fprintf(stderr, "fib: poster %dx%d, %d bands of %d rows, %d render threads, %zu bytes per band\n", config->output_width,
+                config->output_height, band_count, FIB_POSTER_BAND_ROWS, worker_count, band_bytes);
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        PosterWorker *worker = &workers[i];
+        char *buffer = (char *)malloc(band_bytes);
+
+        memset(worker, 0, sizeof(*worker));
+        if (!buffer) {
+            fprintf(stderr, "error: out of memory for poster band\n");
+            worker_count = i;
+            ok = 0;
+            break;
+        }
+        worker->plan = plan;
+        worker->banded_analysis = banded ? &context->analysis : NULL;
+        worker->output_height = config->output_height;
+        worker->band_end = band_end;
+        worker->first_band = band_begin + i;
+        worker->band_stride = worker_count;
+        worker->row_base = row_base;
+        worker->fd = fd;
+        worker->errors = (float *)(void *)buffer;
+        worker->lines = buffer + ((size_t)config->output_width + 2U) * 2U * sizeof(float);
+        worker->shades = (unsigned char *)worker->lines + line_bytes * FIB_POSTER_BAND_ROWS;
+        worker->ok = 1;
+    }
+
+    if (ok && worker_count > 0) {
+        for (int i = 1; i < worker_count; i++) {
+            started[i] = (pthread_create(&threads[i], NULL, poster_worker, &workers[i]) == 0);
+            if (!started[i]) {
+                poster_worker(&workers[i]);
+            }
+        }
+        poster_worker(&workers[0]);
+        for (int i = 1; i < worker_count; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        ok = ok && workers[i].ok;
+        free(workers[i].errors);
+    }
+    return ok;
+}
+
+int fib_render_poster(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config, int fd) {
+    DrawPlan plan;
+
+    prepare_draw(context, image, config, &plan);
+    return render_bands(context, &plan, config, fd, 0, (config->output_height + FIB_POSTER_BAND_ROWS - 1) / FIB_POSTER_BAND_ROWS);
+}
+
+/* Histogram sampling step of the analysis: the box factor for the fast tier, else every pixel. */
+int fib_render_tone_stride(int image_width, int image_height, const FibRenderConfig *config) {
+    int factor = fib_render_quality_factor(image_width, image_height, config);
+    return config->quality == FIB_QUALITY_FAST && factor > 1 ? factor : 1;
+}
+
+void fib_render_shard_rows(const FibRenderConfig *config, int *first_row, int *end_row) {
+    int band_count = (config->output_height + FIB_POSTER_BAND_ROWS - 1) / FIB_POSTER_BAND_ROWS;
+    int band_begin = (int)(((int64_t)band_count * config->shard_index) / config->shard_count);
+    int band_end = (int)(((int64_t)band_count * (config->shard_index + 1)) / config->shard_count);
+
+    *first_row = band_begin * FIB_POSTER_BAND_ROWS;
+    *end_row = band_end * FIB_POSTER_BAND_ROWS < config->output_height ? band_end * FIB_POSTER_BAND_ROWS : config->output_height;
+}
+
+/*
+ * Renders the shard's bands of the poster render from a window of the image: the
+ * analysis rows its cells, Sobel taps and neighborhoods reach, widened to whole quality
+ * boxes. Tables are built on the window only; the tone curve comes from the histogram of
+ * the whole image (fib_render_tone_stride sampling) computed once by the caller.
+ */
+int fib_render_shard(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config,
+                     const uint32_t histogram[256], uint64_t sample_count, int fd) {
+    DrawPlan plan;
+    int first_row = 0;
+    int end_row = 0;
+    int factor = fib_render_quality_factor(image->width, image->height, config);
+    int analysis_width = image->width / factor + (image->width % factor != 0);
+    int analysis_height = image->height / factor + (image->height % factor != 0);
+
+    memset(&plan, 0, sizeof(plan));
+    fib_render_shard_rows(config, &first_row, &end_row);
+    if (first_row >= end_row) {
+        return render_bands(context, &plan, config, fd, 0, 0);
+    }
+
+    /* rows reached by output rows [first_row, end_row), in analysis-grid coordinates */
+    plan.source_height = analysis_height;
+    plan.scale_y = (float)analysis_height / (float)config->output_height;
+    int window_begin = analysis_height;
+    int window_end = 0;
+    for (int y = first_row; y < end_row; y++) {
+        int y0 = 0;
+        int y1 = 0;
+        cell_rows(&plan, y, &y0, &y1);
+        int radius = (y1 - y0) * 2 > 1 ? (y1 - y0) * 2 : 1;
+        int center = (y0 + y1) >> 1;
+        window_begin = center - radius < window_begin ? center - radius : window_begin;
+        window_end = center + radius + 1 > window_end ? center + radius + 1 : window_end;
+    }
+    window_begin = window_begin > 0 ? window_begin : 0;
+    window_end = window_end < analysis_height ? window_end : analysis_height;
+
+    int source_end = window_end * factor < image->height ? window_end * factor : image->height;
+    FibImage window = {image->width, source_end - window_begin * factor,
+                       image->pixels + (size_t)window_begin * (size_t)factor * (size_t)image->width, NULL, 0};
+    const FibImage *source = &window;
+    if (factor > 1) {
+        uint32_t unused_histogram[256];
+        uint64_t unused_count = 0;
+        if (!fib_analysis_reduce(&window, factor, 0, config->thread_count, &context->reduced, unused_histogram, &unused_count)) {
+            fprintf(stderr, "error: out of memory for the reduced analysis grid\n");
+            return 0;
+        }
+        source = &context->reduced;
+    }
+
+    FibSatLayout sat_layout = fib_render_sat_layout(analysis_width, analysis_height, config);
+    size_t band_rows = fib_analysis_band_rows(analysis_height, config->output_height);
+    int has_tables = fib_analysis_refresh(source, sat_layout, band_rows, config->thread_count, &context->analysis);
+    memcpy(context->analysis.histogram, histogram, sizeof(context->analysis.histogram));
+    context->analysis.pixel_count = sample_count;
+    context->analysis_ready = 0;
+    context->history.ready = 0;
+
+    if (config->verbose) {
+        fprintf(stderr, "fib: shard %d/%d, output rows %d-%d, source rows %d-%d of %d\n", config->shard_index,
+                config->shard_count, first_row, end_row - 1, window_begin * factor, source_end - 1, image->height);
+    }
+    fill_plan(context, config, source, window_begin, analysis_height, has_tables, &plan);
+    return render_bands(context, &plan, config, fd, first_row / FIB_POSTER_BAND_ROWS,
+                        (end_row + FIB_POSTER_BAND_ROWS - 1) / FIB_POSTER_BAND_ROWS);
 }
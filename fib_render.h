@@ -3,10 +3,13 @@
 
 #include <stdio.h>
 
+#include "fib_analysis.h"
 #include "fib_image.h"
+#include "fib_sink.h"
 
 #define FIB_DEFAULT_OUTPUT_WIDTH 80
 #define FIB_DEFAULT_OUTPUT_HEIGHT 40
+#define FIB_POSTER_BAND_ROWS 32
 
 typedef enum {
     FIB_PALETTE_CLASSIC = 0,
@@ -20,15 +23,182 @@ typedef enum {
     FIB_COLOR_NEVER
 } FibColorMode;
 
+/* text writes lines (optionally ANSI-colored); grid writes one binary frame per draw (fib_grid.h). */
+typedef enum {
+    FIB_FORMAT_TEXT = 0,
+    FIB_FORMAT_GRID
+} FibOutputFormat;
+
+/* ramp picks glyphs by brightness; shape matches structured cells against glyph coverage signatures. */
+typedef enum {
+    FIB_GLYPHS_RAMP = 0,
+    FIB_GLYPHS_SHAPE
+} FibGlyphMode;
+
+/* sobel takes a 3x3 kernel at the cell center; box differences half-cell sums from the summed-area tables. */
+typedef enum {
+    FIB_EDGES_SOBEL = 0,
+    FIB_EDGES_BOX
+} FibEdgeMode;
+
+/* best analyzes every pixel; balanced and fast analyze a box-prefiltered reduced grid. */
+typedef enum {
+    FIB_QUALITY_BEST = 0,
+    FIB_QUALITY_BALANCED,
+    FIB_QUALITY_FAST
+} FibQuality;
+
 typedef struct {
     int output_width;
     int output_height;
     FibColorMode color_mode;
     int enable_color;
     FibPalette palette;
+    FibQuality quality;
+    FibGlyphMode glyph_mode;
+    FibEdgeMode edge_mode;
+    FibOutputFormat format;
+    int thread_count;
+    FibSatLayout sat_layout;
+    int prefer_wide_sat;
+    int huge_pages;
+    int use_profile;
+    size_t max_memory;
+    size_t frame_cache;
+    int verbose;
+    int watch;
+    int fit;
+    int preview;
+    int poster;
+    int incremental;
+    int shard_index;
+    int shard_count;
+    const char *tones_path;
+    const char *write_tones_path;
+    const char *shm_name;
+    int pipeline;
+    int in_flight;
 } FibRenderConfig;
 
+/* Pixel rectangle [x0, x1) x [y0, y1) of an image. */
+typedef struct {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+} FibRect;
+
+/*
+ * What the last fib_render_context_update drew, so the next one only redraws what
+ * changed: a copy of the gray frame, every row's glyphs and shades, the dither error
+ * entering every row (output_height + 1 rows of output_width + 2) and the tone table.
+ * dirty_prefix counts changed image rows for range queries; row_changed marks output
+ * rows whose bytes differ from the previous frame.
+ */
+typedef struct {
+    int ready;
+    FibRenderConfig config;
+    int image_width;
+    int image_height;
+    unsigned char *pixels;
+    char *chars;
+    unsigned char *shades;
+    float *errors;
+    int *dirty_prefix;
+    unsigned char *row_changed;
+    unsigned char tone_lookup[256];
+    int rows_drawn;
+    int rows_changed;
+} FibRenderHistory;
+
+/*
+ * Buffers that survive between draws: the analysis of the last image, line buffers,
+ * dither rows, the glyph shape table, the grid frame buffer and the sink behind the
+ * FILE* adapter. Reusing one context across frames avoids reallocating anything while
+ * the image and output sizes stay the same. Call fib_render_context_invalidate when the
+ * image pixels change in place.
+ */
+typedef struct {
+    FibAnalysis analysis;
+    FibImage reduced;
+    int reduce_factor;
+    int analysis_ready;
+    int image_width;
+    int image_height;
+    int line_capacity;
+    char *line_chars;
+    unsigned char *line_shades;
+    float *error_line_current;
+    float *error_line_next;
+    char *shape_table;
+    FibPalette shape_palette;
+    unsigned char *grid_frame;
+    size_t grid_capacity;
+    FibSink stream_sink;
+    FibRenderHistory history;
+    FibAnalysisStream *overlap_stream;
+    FibSatLayout overlap_layout;
+    int overlap_width;
+    int overlap_height;
+} FibRenderContext;
+
+void fib_render_context_init(FibRenderContext *context);
+void fib_render_context_free(FibRenderContext *context);
+void fib_render_context_invalidate(FibRenderContext *context);
+/*
+ * Decode overlap: arms the context to build the summed-area tables of an image_width x
+ * image_height decode on a worker thread while the decoder is still producing rows, when
+ * config draws from the full-resolution image with a wide or compact layout on at least
+ * two threads; returns 0 otherwise. Pass fib_render_context_rows_ready with the context
+ * as the load's rows_ready callback. A draw of the loaded image with the same config then
+ * reuses the finished tables, so only the tone curve and the output loop remain.
+ */
+int fib_render_context_overlap(FibRenderContext *context, int image_width, int image_height, const FibRenderConfig *config);
+void fib_render_context_rows_ready(void *user_data, const FibImage *image, int row_end);
+size_t fib_render_frame_bytes(const FibRenderConfig *config);
+int fib_render_context_emit(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config, FibSink *sink);
+void fib_render_context_draw(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config, FILE *output);
+/* The context's reusable stream sink, aimed at output; its scratch line lives as long as the context. */
+FibSink *fib_render_context_stream_sink(FibRenderContext *context, FILE *output);
+/*
+ * Incremental text draw for sequences of mostly static frames. The frame is compared with
+ * the previous one inside the dirty rectangles (the whole image when dirty is NULL);
+ * changed pixels update the histogram and the summed-area tables from the first changed
+ * row and column on, and only output rows whose cells, neighborhoods or incoming dither
+ * error changed are redrawn. The output is identical to fib_render_context_emit. With
+ * changed_rows_only, rows whose bytes did not change are skipped and every emitted row
+ * starts with a cursor move to its line. Other draws on the context start the history over.
+ */
+int fib_render_context_update(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config,
+                              const FibRect *dirty, int dirty_count, int changed_rows_only, FibSink *sink);
 void fib_render_ascii(const FibImage *image, const FibRenderConfig *config, FILE *output);
+/*
+ * Poster mode: renders FIB_POSTER_BAND_ROWS-row bands of uncolored text on up to
+ * config->thread_count threads and pwrites each band at its offset in fd. Every band
+ * restarts error diffusion, so the file does not depend on the thread count.
+ */
+int fib_render_poster(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config, int fd);
+size_t fib_render_poster_band_bytes(int output_width);
+/*
+ * Shard mode: renders only shard_index's share of the poster bands, from the image rows
+ * those bands reach, into fd. The tone curve comes from the caller's histogram of the
+ * whole image sampled every fib_render_tone_stride pixels, so the shard files of one
+ * shard_count concatenate to exactly the --poster output.
+ */
+int fib_render_shard(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config,
+                     const uint32_t histogram[256], uint64_t sample_count, int fd);
+void fib_render_shard_rows(const FibRenderConfig *config, int *first_row, int *end_row);
+int fib_render_tone_stride(int image_width, int image_height, const FibRenderConfig *config);
+FibSatLayout fib_render_sat_layout(int image_width, int image_height, const FibRenderConfig *config);
+int fib_render_quality_factor(int image_width, int image_height, const FibRenderConfig *config);
+const char *fib_quality_name(FibQuality quality);
+const char *fib_glyph_mode_name(FibGlyphMode glyph_mode);
+int fib_glyph_mode_from_string(const char *value, FibGlyphMode *glyph_mode_out);
+const char *fib_edge_mode_name(FibEdgeMode edge_mode);
+int fib_edge_mode_from_string(const char *value, FibEdgeMode *edge_mode_out);
+const char *fib_output_format_name(FibOutputFormat format);
+int fib_output_format_from_string(const char *value, FibOutputFormat *format_out);
+int fib_quality_from_string(const char *value, FibQuality *quality_out);
 const char *fib_palette_name(FibPalette palette);
 int fib_palette_from_string(const char *value, FibPalette *palette_out);
 
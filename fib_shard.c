@@ -0,0 +1,199 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fib_shard.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fib.h"
+
+#define FIB_TONES_MAGIC "fib-tones"
+#define FIB_TONES_VERSION 1
+#define FIB_MERGE_CHUNK_BYTES (1U << 20)
+
+void fib_shard_compute_tones(const FibImage *image, const FibRenderConfig *config, FibTones *tones) {
+    tones->image_width = image->width;
+    tones->image_height = image->height;
+    tones->stride = fib_render_tone_stride(image->width, image->height, config);
+    fib_analysis_histogram(image, tones->stride, tones->histogram, &tones->sample_count);
+}
+
+/*
+ * Text format, one field per line:
+ *
+ *   fib-tones 1
+ *   image <width> <height>
+ *   stride <n>
+ *   samples <count>
+ *   <256 bin counts, darkest first>
+ */
+int fib_shard_save_tones(const char *path, const FibTones *tones) {
+    FILE *file = fopen(path, "w");
+
+    if (!file) {
+        fprintf(stderr, "error: cannot create tones file %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    fprintf(file, "%s %d\nimage %d %d\nstride %d\nsamples %" PRIu64 "\n", FIB_TONES_MAGIC, FIB_TONES_VERSION,
+            tones->image_width, tones->image_height, tones->stride, tones->sample_count);
+    for (int value = 0; value < 256; value++) {
+        fprintf(file, "%" PRIu32 "\n", tones->histogram[value]);
+    }
+    int failed = ferror(file);
+    if (fclose(file) != 0 || failed) {
+        fprintf(stderr, "error: cannot write tones file %s\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+int fib_shard_load_tones(const char *path, FibTones *tones) {
+    FILE *file = fopen(path, "r");
+    char magic[16] = {0};
+    int version = 0;
+    uint64_t total = 0;
+    int ok = 0;
+
+    if (!file) {
+        fprintf(stderr, "error: cannot open tones file %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    if (fscanf(file, "%15s %d image %d %d stride %d samples %" SCNu64, magic, &version, &tones->image_width,
+               &tones->image_height, &tones->stride, &tones->sample_count) == 6 &&
+        strcmp(magic, FIB_TONES_MAGIC) == 0 && version == FIB_TONES_VERSION && tones->stride > 0) {
+        ok = 1;
+        for (int value = 0; value < 256 && ok; value++) {
+            ok = fscanf(file, "%" SCNu32, &tones->histogram[value]) == 1;
+            total += ok ? tones->histogram[value] : 0;
+        }
+        ok = ok && total == tones->sample_count;
+    }
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "error: %s is not a fib tones file\n", path);
+    }
+    return ok;
+}
+
+static int write_all(int fd, const char *bytes, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        bytes += written;
+        size -= (size_t)written;
+    }
+    return 1;
+}
+
+/* Concatenates the shard files in the order given. */
+int fib_shard_merge(const char *output_path, char *const shard_paths[], int shard_count) {
+    static char chunk[FIB_MERGE_CHUNK_BYTES];
+    int output = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    int ok = 1;
+
+    if (output < 0) {
+        fprintf(stderr, "error: cannot create output file %s: %s\n", output_path, strerror(errno));
+        return 0;
+    }
+    for (int i = 0; i < shard_count && ok; i++) {
+        int input = open(shard_paths[i], O_RDONLY);
+        if (input < 0) {
+            fprintf(stderr, "error: cannot open shard %s: %s\n", shard_paths[i], strerror(errno));
+            ok = 0;
+            break;
+        }
+        for (;;) {
+            ssize_t count = read(input, chunk, sizeof(chunk));
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count < 0) {
+                fprintf(stderr, "error: cannot read shard %s: %s\n", shard_paths[i], strerror(errno));
+                ok = 0;
+            } else if (count > 0 && !write_all(output, chunk, (size_t)count)) {
+                fprintf(stderr, "error: cannot write %s: %s\n", output_path, strerror(errno));
+                ok = 0;
+            }
+            if (count <= 0 || !ok) {
+                break;
+            }
+        }
+        close(input);
+    }
+    if (close(output) != 0 && ok) {
+        fprintf(stderr, "error: cannot finish writing %s: %s\n", output_path, strerror(errno));
+        ok = 0;
+    }
+    if (ok) {
+        printf("ascii art merged to: %s\n", output_path);
+    }
+    return ok;
+}
+
+static int render_shard(const FibImage *image, const FibRenderConfig *config, const FibTones *tones, const char *output_path) {
+    FibRenderContext context;
+    int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (fd < 0) {
+        fprintf(stderr, "error: cannot create output file %s: %s\n", output_path, strerror(errno));
+        return 0;
+    }
+    fib_render_context_init(&context);
+    int ok = fib_render_shard(&context, image, config, tones->histogram, tones->sample_count, fd);
+    fib_render_context_free(&context);
+    if (close(fd) != 0 && ok) {
+        fprintf(stderr, "error: cannot finish writing %s: %s\n", output_path, strerror(errno));
+        ok = 0;
+    }
+    if (ok) {
+        printf("ascii shard %d/%d saved to: %s\n", config->shard_index, config->shard_count, output_path);
+    }
+    return ok;
+}
+
+/*
+ * --write-tones runs the pre-pass and saves it; --shard renders one shard with the tones
+ * from --tones, or histograms the image itself when no tones file is given.
+ */
+int fib_shard_run(const char *input_path, const FibRenderConfig *config, const char *output_path) {
+    FibRenderConfig runtime_config = *config;
+    FibImage image = {0};
+    FibTones tones;
+    int ok = 0;
+
+    if (!fib_load_planned_image(input_path, config, &image, &runtime_config, NULL, NULL, NULL)) {
+        return 1;
+    }
+
+    if (config->write_tones_path) {
+        fib_shard_compute_tones(&image, &runtime_config, &tones);
+        ok = fib_shard_save_tones(config->write_tones_path, &tones);
+        if (ok) {
+            printf("tone histogram saved to: %s\n", config->write_tones_path);
+        }
+    } else if (config->tones_path) {
+        ok = fib_shard_load_tones(config->tones_path, &tones);
+        if (ok && (tones.image_width != image.width || tones.image_height != image.height ||
+                   tones.stride != fib_render_tone_stride(image.width, image.height, &runtime_config))) {
+            fprintf(stderr, "error: %s was computed for a %dx%d image with stride %d, not this input and quality\n",
+                    config->tones_path, tones.image_width, tones.image_height, tones.stride);
+            ok = 0;
+        }
+        ok = ok && render_shard(&image, &runtime_config, &tones, output_path);
+    } else {
+        fib_shard_compute_tones(&image, &runtime_config, &tones);
+        ok = render_shard(&image, &runtime_config, &tones, output_path);
+    }
+
+    fib_image_free(&image);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#ifndef FIB_SHARD_H
+#define FIB_SHARD_H
+
+#include <stdint.h>
+
+#include "fib_image.h"
+#include "fib_render.h"
+
+/*
+ * The global pre-pass handed to every shard: the histogram the analysis would build for
+ * the tone curve, and the image size and sampling stride it was taken with so a shard can
+ * refuse tones computed for a different image or quality tier.
+ */
+typedef struct {
+    int image_width;
+    int image_height;
+    int stride;
+    uint64_t sample_count;
+    uint32_t histogram[256];
+} FibTones;
+
+void fib_shard_compute_tones(const FibImage *image, const FibRenderConfig *config, FibTones *tones);
+int fib_shard_save_tones(const char *path, const FibTones *tones);
+int fib_shard_load_tones(const char *path, FibTones *tones);
+int fib_shard_merge(const char *output_path, char *const shard_paths[], int shard_count);
+int fib_shard_run(const char *input_path, const FibRenderConfig *config, const char *output_path);
+
+#endif
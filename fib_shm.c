@@ -0,0 +1,283 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fib_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FIB_SHM_ACQUIRE_ATTEMPTS 8
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1U) / alignment * alignment;
+}
+
+static FibShmSlot *slot_at(const FibShmRing *ring, uint32_t slot) {
+    return (FibShmSlot *)(ring->base + ring->header->slots_offset + (size_t)slot * ring->header->slot_stride);
+}
+
+static unsigned char *slot_pixels(const FibShmRing *ring, uint32_t slot) {
+    return (unsigned char *)slot_at(ring, slot) + FIB_SHM_ALIGNMENT;
+}
+
+static int ring_size(int width, int height, int slot_count, size_t *slot_stride_out, size_t *size_out) {
+    size_t frame_bytes = (size_t)width * (size_t)height;
+    size_t slot_stride = align_up(FIB_SHM_ALIGNMENT + frame_bytes, FIB_SHM_ALIGNMENT);
+    size_t slots_offset = align_up(sizeof(FibShmHeader), FIB_SHM_ALIGNMENT);
+
+    if (slot_stride > (SIZE_MAX - slots_offset) / (size_t)slot_count) {
+        return 0;
+    }
+    *slot_stride_out = slot_stride;
+    *size_out = slots_offset + slot_stride * (size_t)slot_count;
+    return 1;
+}
+
+int fib_shm_create(const char *name, int width, int height, int slot_count, FibShmRing *ring) {
+    size_t slot_stride = 0;
+    size_t size = 0;
+
+    memset(ring, 0, sizeof(*ring));
+    if (width <= 0 || height <= 0 || width > FIB_MAX_IMAGE_DIMENSION || height > FIB_MAX_IMAGE_DIMENSION ||
+        slot_count < FIB_SHM_MIN_SLOTS || slot_count > FIB_SHM_MAX_SLOTS || !ring_size(width, height, slot_count, &slot_stride, &size)) {
+        fprintf(stderr, "error: invalid shared-memory ring geometry %dx%d x %d slots\n", width, height, slot_count);
+        return 0;
+    }
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "error: cannot create shared memory %s: %s\n", name, strerror(errno));
+        return 0;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        fprintf(stderr, "error: cannot size shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return 0;
+    }
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "error: cannot map shared memory %s: %s\n", name, strerror(errno));
+        shm_unlink(name);
+        return 0;
+    }
+
+    ring->base = (unsigned char *)mapping;
+    ring->size = size;
+    ring->header = (FibShmHeader *)mapping;
+    ring->header->version = FIB_SHM_VERSION;
+    ring->header->width = (uint32_t)width;
+    ring->header->height = (uint32_t)height;
+    ring->header->slot_count = (uint32_t)slot_count;
+    ring->header->slot_stride = slot_stride;
+    ring->header->slots_offset = align_up(sizeof(FibShmHeader), FIB_SHM_ALIGNMENT);
+    atomic_init(&ring->header->head, 0);
+    atomic_init(&ring->header->tail, 0);
+    atomic_init(&ring->header->head_slot, FIB_SHM_NO_SLOT);
+    atomic_init(&ring->header->reader_slot, FIB_SHM_NO_SLOT);
+    atomic_init(&ring->header->consumer_waiting, 0);
+    ring->header->has_frame_ready = sem_init(&ring->header->frame_ready, 1, 0) == 0;
+    for (uint32_t slot = 0; slot < (uint32_t)slot_count; slot++) {
+        atomic_init(&slot_at(ring, slot)->sequence, 0);
+    }
+
+    /* Consumers check the magic first; it is written last. */
+    atomic_thread_fence(memory_order_release);
+    ring->header->magic = FIB_SHM_MAGIC;
+    ring->slot = 0;
+    return 1;
+}
+
+int fib_shm_attach(const char *name, FibShmRing *ring) {
+    struct stat segment_status;
+    size_t slot_stride = 0;
+    size_t size = 0;
+
+    memset(ring, 0, sizeof(*ring));
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        fprintf(stderr, "error: cannot open shared memory %s: %s\n", name, strerror(errno));
+        return 0;
+    }
+    if (fstat(fd, &segment_status) != 0 || (size_t)segment_status.st_size < sizeof(FibShmHeader)) {
+        fprintf(stderr, "error: shared memory %s is not a fib frame ring\n", name);
+        close(fd);
+        return 0;
+    }
+
+    void *mapping = mmap(NULL, (size_t)segment_status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "error: cannot map shared memory %s: %s\n", name, strerror(errno));
+        return 0;
+    }
+
+    const FibShmHeader *header = (const FibShmHeader *)mapping;
+    int valid = header->magic == FIB_SHM_MAGIC;
+    atomic_thread_fence(memory_order_acquire);
+    valid = valid && header->version == FIB_SHM_VERSION && header->width > 0 && header->height > 0 &&
+            header->width <= FIB_MAX_IMAGE_DIMENSION && header->height <= FIB_MAX_IMAGE_DIMENSION &&
+            header->slot_count >= FIB_SHM_MIN_SLOTS && header->slot_count <= FIB_SHM_MAX_SLOTS &&
+            ring_size((int)header->width, (int)header->height, (int)header->slot_count, &slot_stride, &size) &&
+            header->slot_stride == slot_stride && header->slots_offset == align_up(sizeof(FibShmHeader), FIB_SHM_ALIGNMENT) &&
+            size <= (size_t)segment_status.st_size;
+    if (!valid) {
+        fprintf(stderr, "error: shared memory %s has an incompatible frame ring header\n", name);
+        munmap(mapping, (size_t)segment_status.st_size);
+        return 0;
+    }
+
+    ring->base = (unsigned char *)mapping;
+    ring->size = (size_t)segment_status.st_size;
+    ring->header = (FibShmHeader *)mapping;
+    ring->slot = FIB_SHM_NO_SLOT;
+    return 1;
+}
+
+void fib_shm_detach(FibShmRing *ring) {
+    if (ring->base) {
+        munmap(ring->base, ring->size);
+    }
+    memset(ring, 0, sizeof(*ring));
+}
+
+/* Producer: claims a slot that is neither the newest frame nor pinned by the consumer. */
+unsigned char *fib_shm_begin_write(FibShmRing *ring) {
+    FibShmHeader *header = ring->header;
+    uint32_t slot_count = header->slot_count;
+    uint32_t head_slot = atomic_load_explicit(&header->head_slot, memory_order_relaxed);
+
+    for (uint32_t step = 1; step <= slot_count * 2U; step++) {
+        uint32_t slot = (ring->slot + step) % slot_count;
+        if (slot == head_slot) {
+            continue;
+        }
+
+        FibShmSlot *slot_header = slot_at(ring, slot);
+        uint64_t previous = atomic_load_explicit(&slot_header->sequence, memory_order_relaxed);
+        atomic_store(&slot_header->sequence, 0);
+        if (atomic_load(&header->reader_slot) == slot) {
+            atomic_store(&slot_header->sequence, previous);
+            continue;
+        }
+        ring->slot = slot;
+        return slot_pixels(ring, slot);
+    }
+    return NULL;
+}
+
+/* Producer: makes the slot claimed by fib_shm_begin_write the newest frame. */
+uint64_t fib_shm_publish(FibShmRing *ring) {
+    FibShmHeader *header = ring->header;
+    uint64_t sequence = ring->sequence + 1U;
+
+    atomic_store_explicit(&slot_at(ring, ring->slot)->sequence, sequence, memory_order_release);
+    atomic_store_explicit(&header->head_slot, ring->slot, memory_order_release);
+    atomic_store(&header->head, sequence);
+    if (header->has_frame_ready && atomic_exchange(&header->consumer_waiting, 0)) {
+        sem_post(&header->frame_ready);
+    }
+    ring->sequence = sequence;
+    return sequence;
+}
+
+/* Consumer: re-pins the frame on display after a failed switch; -1 when it was overrun. */
+static int repin_current(FibShmRing *ring) {
+    FibShmHeader *header = ring->header;
+
+    if (ring->slot == FIB_SHM_NO_SLOT) {
+        atomic_store(&header->reader_slot, FIB_SHM_NO_SLOT);
+        return 0;
+    }
+    atomic_store(&header->reader_slot, ring->slot);
+    if (atomic_load(&slot_at(ring, ring->slot)->sequence) != ring->sequence) {
+        atomic_store(&header->reader_slot, FIB_SHM_NO_SLOT);
+        ring->slot = FIB_SHM_NO_SLOT;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Consumer: pins the newest published frame when it is newer than the one on display and
+ * points view at it. Returns 1 for a new frame, 0 when there is nothing newer and -1 when
+ * the producer overran the frame on display while switching (view must be dropped).
+ */
+int fib_shm_acquire_latest(FibShmRing *ring, FibImage *view, uint64_t *skipped_out) {
+    FibShmHeader *header = ring->header;
+    int pin_moved = 0;
+
+    for (int attempt = 0; attempt < FIB_SHM_ACQUIRE_ATTEMPTS; attempt++) {
+        uint32_t slot = atomic_load_explicit(&header->head_slot, memory_order_acquire);
+        if (slot >= header->slot_count) {
+            return 0;
+        }
+
+        FibShmSlot *slot_header = slot_at(ring, slot);
+        uint64_t seen = atomic_load_explicit(&slot_header->sequence, memory_order_acquire);
+        if (seen == 0) {
+            continue;
+        }
+        if (seen <= ring->sequence) {
+            break;
+        }
+
+        pin_moved = 1;
+        atomic_store(&header->reader_slot, slot);
+        uint64_t sequence = atomic_load(&slot_header->sequence);
+        if (sequence == 0) {
+            continue;
+        }
+
+        if (skipped_out) {
+            *skipped_out = sequence - ring->sequence - 1U;
+        }
+        ring->slot = slot;
+        ring->sequence = sequence;
+        atomic_store_explicit(&header->tail, sequence, memory_order_release);
+
+        view->width = (int)header->width;
+        view->height = (int)header->height;
+        view->pixels = slot_pixels(ring, slot);
+        view->mapping = NULL;
+        view->mapping_size = 0;
+        return 1;
+    }
+    return pin_moved ? repin_current(ring) : 0;
+}
+
+int fib_shm_wait(FibShmRing *ring) {
+    FibShmHeader *header = ring->header;
+
+    if (!header->has_frame_ready) {
+        return 0;
+    }
+    atomic_store(&header->consumer_waiting, 1);
+    if (atomic_load(&header->head) > ring->sequence) {
+        atomic_store(&header->consumer_waiting, 0);
+        return 1;
+    }
+    /* EINTR is a wakeup too: the caller rechecks its stop and resize state. */
+    if (sem_wait(&header->frame_ready) != 0 && errno != EINTR) {
+        return 0;
+    }
+    return 1;
+}
+
+void fib_shm_interrupt(FibShmRing *ring) {
+    if (ring->header && ring->header->has_frame_ready) {
+        sem_post(&ring->header->frame_ready);
+    }
+}
+
+void fib_shm_release(FibShmRing *ring) {
+    if (ring->header) {
+        atomic_store(&ring->header->reader_slot, FIB_SHM_NO_SLOT);
+    }
+    ring->slot = FIB_SHM_NO_SLOT;
+}
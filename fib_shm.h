@@ -0,0 +1,88 @@
+#ifndef FIB_SHM_H
+#define FIB_SHM_H
+
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fib_image.h"
+
+#define FIB_SHM_MAGIC 0x52424946U /* "FIBR" little-endian */
+#define FIB_SHM_VERSION 2U
+#define FIB_SHM_MIN_SLOTS 3
+#define FIB_SHM_MAX_SLOTS 64
+#define FIB_SHM_NO_SLOT UINT32_MAX
+#define FIB_SHM_ALIGNMENT 64U
+
+/*
+ * Layout of a POSIX shared-memory frame ring: one FibShmHeader, then slot_count slots of
+ * slot_stride bytes each starting at slots_offset. Every slot begins with a FibShmSlot
+ * and holds one width x height 8-bit gray frame at FIB_SHM_ALIGNMENT bytes into the slot.
+ *
+ * One producer, one consumer. The producer never waits: it writes into any slot other than
+ * the newest frame (head_slot) and the frame the consumer has pinned (reader_slot), which
+ * is why a ring needs at least three slots. A slot's sequence is 0 while it is being
+ * written and the frame's publication number afterwards. head is the newest published
+ * sequence and tail the last one the consumer rendered; the gap is frames skipped as stale.
+ *
+ * Pinning is a Dekker handshake on sequentially consistent atomics. The producer clears the
+ * slot sequence and then reads reader_slot; the consumer stores reader_slot and then reads
+ * the slot sequence. At least one side sees the other, so a pinned frame is never torn.
+ *
+ * An idle consumer sleeps on frame_ready, a process-shared semaphore, with the same kind
+ * of handshake: it sets consumer_waiting and then reads head; the producer stores head and
+ * then clears consumer_waiting, posting only when it was set. A wakeup is never lost and
+ * the count stays at one or two however far the producer runs ahead. has_frame_ready is 0
+ * when the producer could not create the semaphore; consumers then poll.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t slot_count;
+    uint32_t reserved;
+    uint64_t slot_stride;
+    uint64_t slots_offset;
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    _Atomic uint32_t head_slot;
+    _Atomic uint32_t reader_slot;
+    _Atomic uint32_t consumer_waiting;
+    uint32_t has_frame_ready;
+    sem_t frame_ready;
+} FibShmHeader;
+
+typedef struct {
+    _Atomic uint64_t sequence;
+} FibShmSlot;
+
+typedef struct {
+    FibShmHeader *header;
+    unsigned char *base;
+    size_t size;
+    uint32_t slot;
+    uint64_t sequence;
+} FibShmRing;
+
+int fib_shm_create(const char *name, int width, int height, int slot_count, FibShmRing *ring);
+int fib_shm_attach(const char *name, FibShmRing *ring);
+void fib_shm_detach(FibShmRing *ring);
+
+unsigned char *fib_shm_begin_write(FibShmRing *ring);
+uint64_t fib_shm_publish(FibShmRing *ring);
+
+int fib_shm_acquire_latest(FibShmRing *ring, FibImage *view, uint64_t *skipped_out);
+void fib_shm_release(FibShmRing *ring);
+
+/*
+ * Consumer: blocks until a frame newer than the one on display is published or a signal
+ * arrives. Returns 0 without waiting when the ring has no frame_ready semaphore, in which
+ * case the caller polls. fib_shm_interrupt wakes a waiting consumer and is
+ * async-signal-safe, so signal handlers use it to end the wait.
+ */
+int fib_shm_wait(FibShmRing *ring);
+void fib_shm_interrupt(FibShmRing *ring);
+
+#endif
@@ -0,0 +1,183 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fib_sink.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void init_sink(FibSink *sink, FibSinkKind kind) {
+    memset(sink, 0, sizeof(*sink));
+    sink->kind = kind;
+    sink->fd = -1;
+}
+
+void fib_sink_init_stream(FibSink *sink, FILE *stream) {
+    init_sink(sink, FIB_SINK_STREAM);
+    sink->stream = stream;
+}
+
+void fib_sink_init_buffer(FibSink *sink, char *buffer, size_t capacity) {
+    init_sink(sink, FIB_SINK_BUFFER);
+    sink->buffer = buffer;
+    sink->capacity = buffer ? capacity : 0;
+}
+
+void fib_sink_init_callback(FibSink *sink, FibSinkRowFn row_fn, void *user_data) {
+    init_sink(sink, FIB_SINK_CALLBACK);
+    sink->row_fn = row_fn;
+    sink->user_data = user_data;
+}
+
+void fib_sink_init_writev(FibSink *sink, int fd) {
+    init_sink(sink, FIB_SINK_WRITEV);
+    sink->fd = fd;
+}
+
+void fib_sink_set_stream(FibSink *sink, FILE *stream) {
+    if (sink->kind != FIB_SINK_STREAM) {
+        fib_sink_free(sink);
+        fib_sink_init_stream(sink, stream);
+        return;
+    }
+    sink->stream = stream;
+}
+
+void fib_sink_free(FibSink *sink) {
+    free(sink->scratch);
+    for (int i = 0; i < FIB_SINK_BATCH_ROWS; i++) {
+        free(sink->slots[i]);
+    }
+    init_sink(sink, sink->kind);
+}
+
+void fib_sink_begin(FibSink *sink) {
+    sink->length = 0;
+    sink->failed = 0;
+    sink->reserved = NULL;
+    sink->batch_count = 0;
+}
+
+static char *grow(char **bytes, size_t *capacity, size_t size) {
+    if (*capacity < size) {
+        char *grown = (char *)realloc(*bytes, size);
+        if (!grown) {
+            return NULL;
+        }
+        *bytes = grown;
+        *capacity = size;
+    }
+    return *bytes;
+}
+
+/*
+ * Returns room for a row of up to size bytes. Buffer sinks hand out the caller's buffer
+ * directly; a row that would not fit is built in scratch and only counted.
+ */
+char *fib_sink_reserve(FibSink *sink, size_t size) {
+    char *row = NULL;
+
+    if (sink->failed) {
+        return NULL;
+    }
+    if (sink->kind == FIB_SINK_BUFFER && sink->length <= sink->capacity && sink->capacity - sink->length >= size) {
+        row = sink->buffer + sink->length;
+    } else if (sink->kind == FIB_SINK_WRITEV) {
+        int slot = sink->batch_count;
+        row = grow(&sink->slots[slot], &sink->slot_capacity[slot], size);
+    } else {
+        row = grow(&sink->scratch, &sink->scratch_capacity, size);
+    }
+
+    if (!row) {
+        fprintf(stderr, "error: out of memory for output row\n");
+        sink->failed = 1;
+    }
+    sink->reserved = row;
+    return row;
+}
+
+static int flush_batch(FibSink *sink) {
+    struct iovec *pending = sink->batch;
+    int count = sink->batch_count;
+
+    sink->batch_count = 0;
+    while (count > 0) {
+        ssize_t written = writev(sink->fd, pending, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "error: cannot write output: %s\n", strerror(errno));
+            return 0;
+        }
+        /* a pipe or socket may take part of the batch; resume from the first unsent byte */
+        while (count > 0 && (size_t)written >= pending->iov_len) {
+            written -= (ssize_t)pending->iov_len;
+            pending++;
+            count--;
+        }
+        if (count > 0) {
+            pending->iov_base = (char *)pending->iov_base + written;
+            pending->iov_len -= (size_t)written;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Takes a row built in fib_sink_reserve's room, or any bytes the caller keeps alive until
+ * this returns (writev sinks send those at once instead of batching them).
+ */
+int fib_sink_commit(FibSink *sink, const char *row, size_t size) {
+    int reserved = (row == sink->reserved);
+
+    sink->reserved = NULL;
+    if (sink->failed) {
+        return 0;
+    }
+
+    switch (sink->kind) {
+        case FIB_SINK_BUFFER:
+            if (sink->length <= sink->capacity && sink->capacity - sink->length >= size &&
+                row != sink->buffer + sink->length) {
+                memcpy(sink->buffer + sink->length, row, size);
+            }
+            break;
+        case FIB_SINK_CALLBACK:
+            if (!sink->row_fn(sink->user_data, row, size)) {
+                sink->failed = 1;
+            }
+            break;
+        case FIB_SINK_WRITEV:
+            sink->batch[sink->batch_count].iov_base = (void *)row;
+            sink->batch[sink->batch_count].iov_len = size;
+            sink->batch_count++;
+            if ((!reserved || sink->batch_count == FIB_SINK_BATCH_ROWS) && !flush_batch(sink)) {
+                sink->failed = 1;
+            }
+            break;
+        case FIB_SINK_STREAM:
+        default:
+            if (fwrite(row, 1, size, sink->stream) != size) {
+                fprintf(stderr, "error: cannot write output\n");
+                sink->failed = 1;
+            }
+            break;
+    }
+
+    sink->length += size;
+    return !sink->failed;
+}
+
+/* Sends a partial writev batch; for buffer sinks, fails when the draw did not fit. */
+int fib_sink_finish(FibSink *sink) {
+    if (!sink->failed && sink->kind == FIB_SINK_WRITEV && sink->batch_count > 0 && !flush_batch(sink)) {
+        sink->failed = 1;
+    }
+    if (sink->kind == FIB_SINK_BUFFER && sink->length > sink->capacity) {
+        return 0;
+    }
+    return !sink->failed;
+}
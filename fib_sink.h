@@ -0,0 +1,68 @@
+#ifndef FIB_SINK_H
+#define FIB_SINK_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+#define FIB_SINK_BATCH_ROWS 64
+
+typedef enum {
+    FIB_SINK_STREAM = 0,
+    FIB_SINK_BUFFER,
+    FIB_SINK_CALLBACK,
+    FIB_SINK_WRITEV
+} FibSinkKind;
+
+/*
+ * Row callback: gets each finished line (newline included) or a whole grid frame. It may
+ * block to apply backpressure; returning 0 stops the draw.
+ */
+typedef int (*FibSinkRowFn)(void *user_data, const char *row, size_t size);
+
+/*
+ * Where a draw sends its output. The renderer asks for room with fib_sink_reserve, builds
+ * the row there and hands it back with fib_sink_commit, so a row is formatted straight
+ * into its destination:
+ *
+ *   stream    rows go through fwrite on a FILE* (the fib_render_context_draw adapter)
+ *   buffer    rows land in a caller buffer; length counts every byte the draw produced,
+ *             so when it exceeds capacity the draw fails and length is the size needed
+ *   callback  rows are passed to row_fn from a reusable scratch line
+ *   writev    rows are kept in FIB_SINK_BATCH_ROWS slots and written with one writev(2)
+ *             per batch, e.g. to a socket or pipe
+ *
+ * length is the byte count of the current draw; fib_render_context_emit resets it.
+ */
+typedef struct {
+    FibSinkKind kind;
+    FILE *stream;
+    char *buffer;
+    size_t capacity;
+    FibSinkRowFn row_fn;
+    void *user_data;
+    int fd;
+    size_t length;
+    int failed;
+    char *reserved;
+    char *scratch;
+    size_t scratch_capacity;
+    char *slots[FIB_SINK_BATCH_ROWS];
+    size_t slot_capacity[FIB_SINK_BATCH_ROWS];
+    struct iovec batch[FIB_SINK_BATCH_ROWS];
+    int batch_count;
+} FibSink;
+
+void fib_sink_init_stream(FibSink *sink, FILE *stream);
+void fib_sink_init_buffer(FibSink *sink, char *buffer, size_t capacity);
+void fib_sink_init_callback(FibSink *sink, FibSinkRowFn row_fn, void *user_data);
+void fib_sink_init_writev(FibSink *sink, int fd);
+/* Aims a stream sink at another FILE*, keeping its scratch line; other sinks start over as a stream. */
+void fib_sink_set_stream(FibSink *sink, FILE *stream);
+void fib_sink_free(FibSink *sink);
+void fib_sink_begin(FibSink *sink);
+char *fib_sink_reserve(FibSink *sink, size_t size);
+int fib_sink_commit(FibSink *sink, const char *row, size_t size);
+int fib_sink_finish(FibSink *sink);
+
+#endif
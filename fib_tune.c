@@ -0,0 +1,363 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fib_tune.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fib_analysis.h"
+
+#define FIB_TUNE_MAGIC "fib-profile"
+#define FIB_TUNE_VERSION 1
+#define FIB_TUNE_RUNS 3
+#define FIB_TUNE_TOLERANCE 1.03
+#define FIB_TUNE_LARGE_WIDTH 2560
+#define FIB_TUNE_LARGE_HEIGHT 1440
+#define FIB_TUNE_SMALL_WIDTH 960
+#define FIB_TUNE_SMALL_HEIGHT 540
+#define FIB_TUNE_OUTPUT_WIDTH 200
+#define FIB_TUNE_OUTPUT_HEIGHT 60
+
+static const size_t k_strip_candidates[] = {16384U, 65536U, 262144U, 1048576U};
+
+/* $XDG_CACHE_HOME/fib/profile, or ~/.cache/fib/profile when XDG_CACHE_HOME is unset. */
+int fib_tune_profile_path(char *path, size_t size) {
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int length = 0;
+
+    if (cache && cache[0] == '/') {
+        length = snprintf(path, size, "%s/fib/profile", cache);
+    } else if (home && home[0] != '\0') {
+        length = snprintf(path, size, "%s/.cache/fib/profile", home);
+    } else {
+        return 0;
+    }
+    return length > 0 && (size_t)length < size;
+}
+
+static void read_cpu_model(char *model, size_t size) {
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    char line[512];
+
+    snprintf(model, size, "unknown");
+    if (!cpuinfo) {
+        return;
+    }
+    while (fgets(line, sizeof(line), cpuinfo)) {
+        char *colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon) {
+            colon += 1 + strspn(colon + 1, " \t");
+            colon[strcspn(colon, "\n")] = '\0';
+            snprintf(model, size, "%s", colon);
+            break;
+        }
+    }
+    fclose(cpuinfo);
+}
+
+/*
+ * Text format:
+ *
+ *   fib-profile 1
+ *   cpu <model name>
+ *   cpus <online cpus>
+ *   threads <n>
+ *   strip_pixels <n>
+ *   sat_layout compact|wide
+ */
+int fib_tune_save(const char *path, const FibTuneProfile *profile) {
+    char directory[FIB_TUNE_PATH_MAX];
+    char staged[FIB_TUNE_PATH_MAX + 8];
+
+    /* create the cache directories on the way; the leaf is the profile itself */
+    snprintf(directory, sizeof(directory), "%s", path);
+    for (char *slash = strchr(directory + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "error: cannot create %s: %s\n", directory, strerror(errno));
+            return 0;
+        }
+        *slash = '/';
+    }
+
+    snprintf(staged, sizeof(staged), "%s.tmp", path);
+    FILE *file = fopen(staged, "w");
+    if (!file) {
+        fprintf(stderr, "error: cannot create profile %s: %s\n", staged, strerror(errno));
+        return 0;
+    }
+    fprintf(file, "%s %d\ncpu %s\ncpus %d\nthreads %d\nstrip_pixels %zu\nsat_layout %s\n", FIB_TUNE_MAGIC, FIB_TUNE_VERSION,
+            profile->cpu_model, profile->online_cpus, profile->thread_count, profile->strip_pixels,
+            profile->prefer_wide_sat ? "wide" : "compact");
+    int failed = ferror(file);
+    if (fclose(file) != 0 || failed || rename(staged, path) != 0) {
+        fprintf(stderr, "error: cannot write profile %s\n", path);
+        unlink(staged);
+        return 0;
+    }
+    return 1;
+}
+
+int fib_tune_load(const char *path, FibTuneProfile *profile) {
+    FILE *file = fopen(path, "r");
+    char line[256];
+    char layout[16] = {0};
+    int version = 0;
+    int fields = 0;
+
+    if (!file) {
+        return 0;
+    }
+    memset(profile, 0, sizeof(*profile));
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, FIB_TUNE_MAGIC " %d", &version) == 1) {
+            fields |= 1;
+        } else if (strncmp(line, "cpu ", 4) == 0) {
+            snprintf(profile->cpu_model, sizeof(profile->cpu_model), "%.*s", (int)sizeof(profile->cpu_model) - 1, line + 4);
+            fields |= 2;
+        } else if (sscanf(line, "cpus %d", &profile->online_cpus) == 1) {
+            fields |= 4;
+        } else if (sscanf(line, "threads %d", &profile->thread_count) == 1) {
+            fields |= 8;
+        } else if (sscanf(line, "strip_pixels %zu", &profile->strip_pixels) == 1) {
+            fields |= 16;
+        } else if (sscanf(line, "sat_layout %15s", layout) == 1) {
+            profile->prefer_wide_sat = strcmp(layout, "wide") == 0;
+            fields |= (strcmp(layout, "wide") == 0 || strcmp(layout, "compact") == 0) ? 32 : 0;
+        }
+    }
+    fclose(file);
+    return fields == 63 && version == FIB_TUNE_VERSION && profile->thread_count >= 1 &&
+           profile->thread_count <= 64 && profile->strip_pixels > 0;
+}
+
+/* A profile measured on another CPU model or core count is stale. */
+int fib_tune_matches_machine(const FibTuneProfile *profile, char *reason, size_t reason_size) {
+    char model[sizeof(profile->cpu_model)];
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    read_cpu_model(model, sizeof(model));
+    if (strcmp(model, profile->cpu_model) != 0) {
+        snprintf(reason, reason_size, "measured on '%s', this machine is '%s'", profile->cpu_model, model);
+        return 0;
+    }
+    if (online != profile->online_cpus) {
+        snprintf(reason, reason_size, "measured with %d online CPUs, this machine has %ld", profile->online_cpus, online);
+        return 0;
+    }
+    return 1;
+}
+
+void fib_tune_print(const FibTuneProfile *profile, FILE *stream) {
+    fprintf(stream, "cpu          %s\n", profile->cpu_model);
+    fprintf(stream, "cpus         %d\n", profile->online_cpus);
+    fprintf(stream, "threads      %d\n", profile->thread_count);
+    fprintf(stream, "strip_pixels %zu\n", profile->strip_pixels);
+    fprintf(stream, "sat_layout   %s\n", profile->prefer_wide_sat ? "wide" : "compact");
+}
+
+/*
+ * Startup hook: a matching profile sets the default thread count (when --threads is not
+ * given), the analysis strip size and the table layout preference. A missing, unreadable
+ * or stale profile leaves the built-in defaults, as do --no-profile and a non-empty
+ * FIB_NO_PROFILE.
+ */
+void fib_tune_apply(FibRenderConfig *config) {
+    char path[FIB_TUNE_PATH_MAX];
+    char reason[320];
+    FibTuneProfile profile;
+    const char *skip = getenv("FIB_NO_PROFILE");
+
+    if (!config->use_profile || (skip && skip[0] != '\0')) {
+        if (config->verbose) {
+            fprintf(stderr, "fib: machine profile skipped\n");
+        }
+        return;
+    }
+    if (!fib_tune_profile_path(path, sizeof(path)) || !fib_tune_load(path, &profile)) {
+        return;
+    }
+    if (!fib_tune_matches_machine(&profile, reason, sizeof(reason))) {
+        if (config->verbose) {
+            fprintf(stderr, "fib: ignoring stale profile %s (%s); run fib --autotune\n", path, reason);
+        }
+        return;
+    }
+    if (config->thread_count == 0) {
+        config->thread_count = profile.thread_count;
+    }
+    config->prefer_wide_sat = profile.prefer_wide_sat;
+    fib_analysis_set_strip_pixels(profile.strip_pixels);
+    if (config->verbose) {
+        fprintf(stderr, "fib: profile %s: %d threads, %zu-pixel strips, %s tables\n", path, config->thread_count,
+                profile.strip_pixels, profile.prefer_wide_sat ? "wide" : "compact");
+    }
+}
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1000.0 + (double)(now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/* Photo-like synthetic frame: smooth gradients, texture and hard edges. */
+static int make_calibration_image(FibImage *image, int width, int height) {
+    if (!fib_image_allocate(image, width, height)) {
+        fprintf(stderr, "error: out of memory for calibration image\n");
+        return 0;
+    }
+    for (int y = 0; y < height; y++) {
+        unsigned char *row = image->pixels + (size_t)y * (size_t)width;
+        for (int x = 0; x < width; x++) {
+            int value = (x * 160) / width + (y * 64) / height + ((x * 7 + y * 13) & 31);
+            row[x] = (unsigned char)(((x / 97 + y / 61) & 1) ? value : 255 - value);
+        }
+    }
+    return 1;
+}
+
+/* Best of FIB_TUNE_RUNS fib_render_ascii calls to the null device, in milliseconds. */
+static double time_render(const FibImage *image, const FibRenderConfig *config, FILE *sink) {
+    double best = 0.0;
+
+    for (int run = 0; run < FIB_TUNE_RUNS; run++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        fib_render_ascii(image, config, sink);
+        double elapsed = elapsed_ms(&start);
+        if (run == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+/*
+ * Renders synthetic frames through fib_render_ascii with every candidate setting and
+ * keeps the fastest. Ties within FIB_TUNE_TOLERANCE go to fewer threads, the built-in
+ * strip size and compact tables, so noise does not move the profile off the defaults.
+ */
+int fib_tune_calibrate(FibTuneProfile *profile, FILE *progress) {
+    FibRenderConfig config;
+    FibImage large = {0};
+    FibImage small = {0};
+    FILE *sink = fopen("/dev/null", "w");
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (!sink) {
+        fprintf(stderr, "error: cannot open /dev/null: %s\n", strerror(errno));
+        return 0;
+    }
+    if (!make_calibration_image(&large, FIB_TUNE_LARGE_WIDTH, FIB_TUNE_LARGE_HEIGHT) ||
+        !make_calibration_image(&small, FIB_TUNE_SMALL_WIDTH, FIB_TUNE_SMALL_HEIGHT)) {
+        fib_image_free(&large);
+        fclose(sink);
+        return 0;
+    }
+
+    memset(profile, 0, sizeof(*profile));
+    read_cpu_model(profile->cpu_model, sizeof(profile->cpu_model));
+    profile->online_cpus = (int)online;
+    memset(&config, 0, sizeof(config));
+    config.output_width = FIB_TUNE_OUTPUT_WIDTH;
+    config.output_height = FIB_TUNE_OUTPUT_HEIGHT;
+
+    /* worker count: every power of two below the online CPUs, then the online count, e.g. 1 2 4 6 on six */
+    int max_threads = fib_resolve_thread_count(0);
+    double best = 0.0;
+    for (int threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        config.thread_count = threads;
+        double elapsed = time_render(&large, &config, sink);
+        fprintf(progress, "  threads %-3d %8.2f ms\n", threads, elapsed);
+        if (profile->thread_count == 0 || elapsed * FIB_TUNE_TOLERANCE < best) {
+            profile->thread_count = threads;
+            best = elapsed;
+        }
+        if (threads >= max_threads) {
+            break;
+        }
+    }
+    config.thread_count = profile->thread_count;
+
+    /* strip size, on a frame small enough for it to limit the strip count */
+    profile->strip_pixels = k_strip_candidates[1];
+    fib_analysis_set_strip_pixels(profile->strip_pixels);
+    best = time_render(&small, &config, sink);
+    fprintf(progress, "  strips %-8zu %8.2f ms\n", profile->strip_pixels, best);
+    for (size_t i = 0; i < sizeof(k_strip_candidates) / sizeof(k_strip_candidates[0]); i++) {
+        if (k_strip_candidates[i] == profile->strip_pixels) {
+            continue;
+        }
+        fib_analysis_set_strip_pixels(k_strip_candidates[i]);
+        double elapsed = time_render(&small, &config, sink);
+        fprintf(progress, "  strips %-8zu %8.2f ms\n", k_strip_candidates[i], elapsed);
+        if (elapsed * FIB_TUNE_TOLERANCE < best) {
+            profile->strip_pixels = k_strip_candidates[i];
+            best = elapsed;
+        }
+    }
+    fib_analysis_set_strip_pixels(profile->strip_pixels);
+
+    /* table layout, where compact tables are exact */
+    config.sat_layout = FIB_SAT_COMPACT;
+    double compact = time_render(&large, &config, sink);
+    config.sat_layout = FIB_SAT_WIDE;
+    double wide = time_render(&large, &config, sink);
+    fprintf(progress, "  tables compact %8.2f ms, wide %8.2f ms\n", compact, wide);
+    profile->prefer_wide_sat = wide * FIB_TUNE_TOLERANCE < compact;
+
+    fib_image_free(&large);
+    fib_image_free(&small);
+    fclose(sink);
+    return 1;
+}
+
+/* fib --autotune */
+int fib_tune_run(void) {
+    char path[FIB_TUNE_PATH_MAX];
+    FibTuneProfile profile;
+
+    if (!fib_tune_profile_path(path, sizeof(path))) {
+        fprintf(stderr, "error: neither XDG_CACHE_HOME nor HOME is set; nowhere to keep the profile\n");
+        return 0;
+    }
+    printf("calibrating on %dx%d and %dx%d synthetic frames at %dx%d cells\n", FIB_TUNE_LARGE_WIDTH, FIB_TUNE_LARGE_HEIGHT,
+           FIB_TUNE_SMALL_WIDTH, FIB_TUNE_SMALL_HEIGHT, FIB_TUNE_OUTPUT_WIDTH, FIB_TUNE_OUTPUT_HEIGHT);
+    fflush(stdout);
+    if (!fib_tune_calibrate(&profile, stdout) || !fib_tune_save(path, &profile)) {
+        return 0;
+    }
+    printf("profile saved to: %s\n", path);
+    fib_tune_print(&profile, stdout);
+    return 1;
+}
+
+/* fib --show-profile */
+int fib_tune_show(void) {
+    char path[FIB_TUNE_PATH_MAX];
+    char reason[320];
+    FibTuneProfile profile;
+
+    if (!fib_tune_profile_path(path, sizeof(path))) {
+        fprintf(stderr, "error: neither XDG_CACHE_HOME nor HOME is set\n");
+        return 0;
+    }
+    if (!fib_tune_load(path, &profile)) {
+        printf("no usable profile at %s; built-in defaults apply (run fib --autotune)\n", path);
+        return 1;
+    }
+    printf("profile: %s\n", path);
+    fib_tune_print(&profile, stdout);
+    if (fib_tune_matches_machine(&profile, reason, sizeof(reason))) {
+        printf("status       active\n");
+    } else {
+        printf("status       stale, ignored (%s)\n", reason);
+    }
+    return 1;
+}
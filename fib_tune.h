@@ -0,0 +1,35 @@
+#ifndef FIB_TUNE_H
+#define FIB_TUNE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "fib_render.h"
+
+#define FIB_TUNE_PATH_MAX 4096
+
+/*
+ * Machine profile written by `fib --autotune`. Every setting leaves the output unchanged;
+ * they only pick how the work is split: the default worker count, the smallest analysis
+ * strip worth its own thread and whether wide tables beat compact ones on this machine.
+ * cpu_model and online_cpus identify the machine it was measured on.
+ */
+typedef struct {
+    char cpu_model[128];
+    int online_cpus;
+    int thread_count;
+    size_t strip_pixels;
+    int prefer_wide_sat;
+} FibTuneProfile;
+
+int fib_tune_profile_path(char *path, size_t size);
+int fib_tune_load(const char *path, FibTuneProfile *profile);
+int fib_tune_save(const char *path, const FibTuneProfile *profile);
+int fib_tune_matches_machine(const FibTuneProfile *profile, char *reason, size_t reason_size);
+void fib_tune_print(const FibTuneProfile *profile, FILE *stream);
+void fib_tune_apply(FibRenderConfig *config);
+int fib_tune_calibrate(FibTuneProfile *profile, FILE *progress);
+int fib_tune_run(void);
+int fib_tune_show(void);
+
+#endif
@@ -1,12 +1,21 @@
 #include "fib.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "fib_anim.h"
+#include "fib_memory.h"
+#include "fib_pipeline.h"
 #include "fib_render.h"
+#include "fib_shard.h"
+#include "fib_tune.h"
 
 #define FIB_MAX_OUTPUT_DIMENSION 1000
+#define FIB_MAX_POSTER_DIMENSION 100000
+#define FIB_MAX_THREAD_COUNT 64
+#define FIB_MAX_SHARD_COUNT 4096
 
 typedef struct {
     int has_value;
@@ -21,13 +30,13 @@ static int is_version_arg(const char *arg) {
     return strcmp(arg, "-V") == 0 || strcmp(arg, "--version") == 0;
 }
 
-static int parse_positive_int(const char *value, ParsedInt *parsed) {
+static int parse_positive_int(const char *value, int limit, ParsedInt *parsed) {
     char *end_ptr = NULL;
     long parsed_value = strtol(value, &end_ptr, 10);
     if (value[0] == '\0' || end_ptr == value || *end_ptr != '\0') {
         return 0;
     }
-    if (parsed_value <= 0 || parsed_value > FIB_MAX_OUTPUT_DIMENSION) {
+    if (parsed_value <= 0 || parsed_value > limit) {
         return 0;
     }
     parsed->has_value = 1;
@@ -35,6 +44,52 @@ static int parse_positive_int(const char *value, ParsedInt *parsed) {
     return 1;
 }
 
+/* "i/N" with 0 <= i < N <= FIB_MAX_SHARD_COUNT. */
+static int parse_shard(const char *value, int *index_out, int *count_out) {
+    char *end_ptr = NULL;
+    long index = strtol(value, &end_ptr, 10);
+    if (value[0] < '0' || value[0] > '9' || *end_ptr != '/' || end_ptr[1] < '0' || end_ptr[1] > '9') {
+        return 0;
+    }
+    const char *count_text = end_ptr + 1;
+    long count = strtol(count_text, &end_ptr, 10);
+    if (*end_ptr != '\0' || count < 1 || count > FIB_MAX_SHARD_COUNT || index >= count) {
+        return 0;
+    }
+    *index_out = (int)index;
+    *count_out = (int)count;
+    return 1;
+}
+
+static int parse_byte_size(const char *value, size_t *bytes_out) {
+    char *end_ptr = NULL;
+    unsigned long long parsed_value = 0;
+    unsigned long long multiplier = 1;
+
+    if (value[0] < '0' || value[0] > '9') {
+        return 0;
+    }
+    parsed_value = strtoull(value, &end_ptr, 10);
+    if (end_ptr == value) {
+        return 0;
+    }
+    if (*end_ptr == 'K' || *end_ptr == 'k') {
+        multiplier = 1ULL << 10;
+        end_ptr++;
+    } else if (*end_ptr == 'M' || *end_ptr == 'm') {
+        multiplier = 1ULL << 20;
+        end_ptr++;
+    } else if (*end_ptr == 'G' || *end_ptr == 'g') {
+        multiplier = 1ULL << 30;
+        end_ptr++;
+    }
+    if (*end_ptr != '\0' || parsed_value == 0 || parsed_value > (unsigned long long)SIZE_MAX / multiplier) {
+        return 0;
+    }
+    *bytes_out = (size_t)(parsed_value * multiplier);
+    return 1;
+}
+
 static int parse_color_mode(const char *value, FibColorMode *mode_out) {
     if (strcmp(value, "auto") == 0) {
         *mode_out = FIB_COLOR_AUTO;
@@ -58,6 +113,7 @@ static int parse_cli_args(int argc,
                           const char **output_path) {
     int index = 1;
     int positional_count = 0;
+    const char *positional[4] = {0};
     ParsedInt width = {0};
     ParsedInt height = {0};
 
@@ -66,6 +122,30 @@ static int parse_cli_args(int argc,
     config->color_mode = FIB_COLOR_AUTO;
     config->enable_color = 0;
     config->palette = FIB_PALETTE_CLASSIC;
+    config->quality = FIB_QUALITY_BEST;
+    config->glyph_mode = FIB_GLYPHS_RAMP;
+    config->edge_mode = FIB_EDGES_SOBEL;
+    config->format = FIB_FORMAT_TEXT;
+    config->thread_count = 0;
+    config->sat_layout = FIB_SAT_AUTO;
+    config->prefer_wide_sat = 0;
+    config->max_memory = 0;
+    config->frame_cache = FIB_ANIM_DEFAULT_FRAME_CACHE;
+    config->verbose = 0;
+    config->watch = 0;
+    config->fit = 0;
+    config->preview = 0;
+    config->poster = 0;
+    config->incremental = 0;
+    config->huge_pages = 1;
+    config->use_profile = 1;
+    config->shard_index = 0;
+    config->shard_count = 0;
+    config->tones_path = NULL;
+    config->write_tones_path = NULL;
+    config->shm_name = NULL;
+    config->pipeline = 0;
+    config->in_flight = 0;
     *input_path = NULL;
     *output_path = NULL;
 
@@ -110,36 +190,268 @@ static int parse_cli_args(int argc,
             index += 2;
             continue;
         }
+        if (strcmp(arg, "--quality") == 0) {
+            if (index + 1 >= argc) {
+                fprintf(stderr, "error: --quality requires a value\n");
+                return 0;
+            }
+            if (!fib_quality_from_string(argv[index + 1], &config->quality)) {
+                fprintf(stderr, "error: invalid quality '%s' (use fast|balanced|best)\n", argv[index + 1]);
+                return 0;
+            }
+            index += 2;
+            continue;
+        }
+        if (strcmp(arg, "--glyphs") == 0) {
+            if (index + 1 >= argc) {
+                fprintf(stderr, "error: --glyphs requires a value\n");
+                return 0;
+            }
+            if (!fib_glyph_mode_from_string(argv[index + 1], &config->glyph_mode)) {
+                fprintf(stderr, "error: invalid glyph mode '%s' (use ramp|shape)\n", argv[index + 1]);
+                return 0;
+            }
+            index += 2;
+            continue;
+        }
+        if (strcmp(arg, "--edges") == 0) {
+            if (index + 1 >= argc) {
+                fprintf(stderr, "error: --edges requires a value\n");
+                return 0;
+            }
+            if (!fib_edge_mode_from_string(argv[index + 1], &config->edge_mode)) {
+                fprintf(stderr, "error: invalid edge mode '%s' (use sobel|box)\n", argv[index + 1]);
+                return 0;
+            }
+            index += 2;
+            continue;
+        }
+        if (strcmp(arg, "--format") == 0) {
+            if (index + 1 >= argc) {
+                fprintf(stderr, "error: --format requires a value\n");
+                return 0;
+            }
+            if (!fib_output_format_from_string(argv[index + 1], &config->format)) {
+                fprintf(stderr, "error: invalid format '%s' (use text|grid)\n", argv[index + 1]);
+                return 0;
+            }
+            index += 2;
+            continue;
+        }
+        if (strcmp(arg, "--threads") == 0) {
+            ParsedInt threads = {0};
+            if (index + 1 >= argc) {
+                fprintf(stderr, "error: --threads requires a value\n");
+                return 0;
+            }
+            if (!parse_positive_int(argv[index + 1], FIB_MAX_THREAD_COUNT, &threads)) {
+                fprintf(stderr, "error: invalid --threads value '%s' (1..%d)\n", argv[index + 1], FIB_MAX_THREAD_COUNT);
+                return 0;
+            }
+            config->thread_count = threads.value;
+            index += 2;
+            continue;
+        }
+        if (strcmp(arg, "--max-memory") == 0) {
+            if (index + 1 >= argc) {
+                fprintf(stderr, "error: --max-memory requires a value\n");
+                return 0;
+            }
+            if (!parse_byte_size(argv[index + 1], &config->max_memory)) {
+                fprintf(stderr, "error: invalid --max-memory value '%s' (bytes, optional K/M/G suffix)\n", argv[index + 1]);
+                return 0;
+            }
+            index += 2;
+            continue;
+        }
+        if (strcmp(arg, "--frame-cache") == 0) {
+            if (index + 1 >= argc) {
+                fprintf(stderr, "error: --frame-cache requires a value\n");
+                return 0;
+            }
+            if (strcmp(argv[index + 1], "0") == 0) {
+                config->frame_cache = 0;
+            } else if (!parse_byte_size(argv[index + 1], &config->frame_cache)) {
+                fprintf(stderr, "error: invalid --frame-cache value '%s' (bytes, optional K/M/G suffix)\n", argv[index + 1]);
+                return 0;
+            }
+            index += 2;
+            continue;
+        }
+        if (strcmp(arg, "--verbose") == 0) {
+            config->verbose = 1;
+            index++;
+            continue;
+        }
+        if (strcmp(arg, "--watch") == 0) {
+            config->watch = 1;
+            index++;
+            continue;
+        }
+        if (strcmp(arg, "--fit") == 0) {
+            config->fit = 1;
+            index++;
+            continue;
+        }
+        if (strcmp(arg, "--preview") == 0) {
+            config->preview = 1;
+            index++;
+            continue;
+        }
+        if (strcmp(arg, "--poster") == 0) {
+            config->poster = 1;
+            index++;
+            continue;
+        }
+        if (strcmp(arg, "--no-huge-pages") == 0) {
+            config->huge_pages = 0;
+            index++;
+            continue;
+        }
+        if (strcmp(arg, "--no-profile") == 0) {
+            config->use_profile = 0;
+            index++;
+            continue;
+        }
+        if (strcmp(arg, "--incremental") == 0) {
+            config->incremental = 1;
+            index++;
+            continue;
+        }
+        if (strcmp(arg, "--shard") == 0) {
+            if (index + 1 >= argc || !parse_shard(argv[index + 1], &config->shard_index, &config->shard_count)) {
+                fprintf(stderr, "error: --shard requires i/N with 0 <= i < N <= %d\n", FIB_MAX_SHARD_COUNT);
+                return 0;
+            }
+            index += 2;
+            continue;
+        }
+        if (strcmp(arg, "--tones") == 0 || strcmp(arg, "--write-tones") == 0) {
+            if (index + 1 >= argc) {
+                fprintf(stderr, "error: %s requires a file path\n", arg);
+                return 0;
+            }
+            if (arg[2] == 't') {
+                config->tones_path = argv[index + 1];
+            } else {
+                config->write_tones_path = argv[index + 1];
+            }
+            index += 2;
+            continue;
+        }
+        if (strcmp(arg, "--pipeline") == 0) {
+            config->pipeline = 1;
+            index++;
+            continue;
+        }
+        if (strcmp(arg, "--in-flight") == 0) {
+            ParsedInt in_flight = {0};
+            if (index + 1 >= argc || !parse_positive_int(argv[index + 1], FIB_PIPELINE_MAX_IN_FLIGHT, &in_flight)) {
+                fprintf(stderr, "error: --in-flight requires a count (1..%d)\n", FIB_PIPELINE_MAX_IN_FLIGHT);
+                return 0;
+            }
+            config->in_flight = in_flight.value;
+            index += 2;
+            continue;
+        }
+        if (strcmp(arg, "--shm") == 0) {
+            if (index + 1 >= argc || argv[index + 1][0] != '/') {
+                fprintf(stderr, "error: --shm requires a shared-memory name such as /fib-frames\n");
+                return 0;
+            }
+            config->shm_name = argv[index + 1];
+            index += 2;
+            continue;
+        }
 
         if (strncmp(arg, "--", 2) == 0) {
             fprintf(stderr, "error: unknown option %s\n", arg);
             return 0;
         }
 
-        if (positional_count == 0) {
-            *input_path = arg;
-        } else if (positional_count == 1) {
-            if (!parse_positive_int(arg, &width)) {
-                fprintf(stderr, "error: invalid output_width '%s' (1..%d)\n", arg, FIB_MAX_OUTPUT_DIMENSION);
-                return 0;
-            }
-        } else if (positional_count == 2) {
-            if (!parse_positive_int(arg, &height)) {
-                fprintf(stderr, "error: invalid output_height '%s' (1..%d)\n", arg, FIB_MAX_OUTPUT_DIMENSION);
-                return 0;
-            }
-        } else if (positional_count == 3) {
-            *output_path = arg;
-        } else {
+        if (positional_count == 4) {
             fprintf(stderr, "error: too many positional arguments\n");
             return 0;
         }
-
-        positional_count++;
+        positional[positional_count++] = arg;
         index++;
     }
 
-    if (!*input_path) {
+    /*
+     * With --shm the frame ring, and with --pipeline the paths on standard input, replace
+     * <input> and the remaining positionals shift left.
+     */
+    int slot = 0;
+    if (config->shm_name || config->pipeline) {
+        if (config->shm_name && config->watch) {
+            fprintf(stderr, "error: --shm cannot be combined with --watch\n");
+            return 0;
+        }
+        if (config->pipeline && (config->watch || config->fit || config->shm_name || config->incremental)) {
+            fprintf(stderr, "error: --pipeline cannot be combined with --watch, --fit, --shm or --incremental\n");
+            return 0;
+        }
+        if (positional_count == 4) {
+            fprintf(stderr, "error: too many positional arguments\n");
+            return 0;
+        }
+    } else {
+        if (positional_count == 0) {
+            return 0;
+        }
+        *input_path = positional[slot++];
+    }
+
+    int banded_output = config->poster || config->shard_count > 0 || config->write_tones_path;
+    int dimension_limit = banded_output ? FIB_MAX_POSTER_DIMENSION : FIB_MAX_OUTPUT_DIMENSION;
+    if (slot < positional_count && !parse_positive_int(positional[slot], dimension_limit, &width)) {
+        fprintf(stderr, "error: invalid output_width '%s' (1..%d)\n", positional[slot], dimension_limit);
+        return 0;
+    }
+    slot++;
+    if (slot < positional_count && !parse_positive_int(positional[slot], dimension_limit, &height)) {
+        fprintf(stderr, "error: invalid output_height '%s' (1..%d)\n", positional[slot], dimension_limit);
+        return 0;
+    }
+    slot++;
+    if (slot < positional_count) {
+        *output_path = positional[slot];
+    }
+
+    /* Bands land at fixed file offsets, which needs a seekable file and fixed-length lines. */
+    if (banded_output) {
+        const char *mode = config->write_tones_path ? "--write-tones" : (config->shard_count > 0 ? "--shard" : "--poster");
+        if (config->watch || config->fit || config->shm_name || config->pipeline) {
+            fprintf(stderr, "error: %s cannot be combined with --watch, --fit, --shm or --pipeline\n", mode);
+            return 0;
+        }
+        if ((config->poster && config->shard_count > 0) || (config->write_tones_path && (config->poster || config->shard_count > 0))) {
+            fprintf(stderr, "error: --poster, --shard and --write-tones are separate runs\n");
+            return 0;
+        }
+        if (config->write_tones_path && *output_path) {
+            fprintf(stderr, "error: --write-tones takes no output file\n");
+            return 0;
+        }
+        if (!config->write_tones_path && !*output_path) {
+            fprintf(stderr, "error: %s requires an output file\n", mode);
+            return 0;
+        }
+        if (config->format != FIB_FORMAT_TEXT || config->color_mode == FIB_COLOR_ALWAYS) {
+            fprintf(stderr, "error: %s writes uncolored text only\n", mode);
+            return 0;
+        }
+    }
+    if (config->incremental && ((!config->watch && !config->shm_name) || config->format != FIB_FORMAT_TEXT)) {
+        fprintf(stderr, "error: --incremental applies to text output of --watch or --shm\n");
+        return 0;
+    }
+    if (config->in_flight && !config->pipeline) {
+        fprintf(stderr, "error: --in-flight only applies to --pipeline\n");
+        return 0;
+    }
+    if (config->tones_path && config->shard_count == 0) {
+        fprintf(stderr, "error: --tones only applies to --shard\n");
         return 0;
     }
 
@@ -163,6 +475,24 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    /* fib --merge OUTPUT SHARD... concatenates --shard outputs in order. */
+    if (strcmp(argv[1], "--merge") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "error: --merge requires an output file and at least one shard\n");
+            return 1;
+        }
+        return fib_shard_merge(argv[2], argv + 3, argc - 3) ? 0 : 1;
+    }
+
+    /* fib --autotune measures this machine; fib --show-profile prints what it chose. */
+    if (strcmp(argv[1], "--autotune") == 0 || strcmp(argv[1], "--show-profile") == 0) {
+        if (argc != 2) {
+            fprintf(stderr, "error: %s takes no other arguments\n", argv[1]);
+            return 1;
+        }
+        return (strcmp(argv[1], "--autotune") == 0 ? fib_tune_run() : fib_tune_show()) ? 0 : 1;
+    }
+
     FibRenderConfig config;
     const char *input_path = NULL;
     const char *output_path = NULL;
@@ -172,5 +502,7 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    fib_tune_apply(&config);
+    fib_memory_set_huge_pages(config.huge_pages);
     return fib_run(input_path, &config, output_path);
 }
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Quality-vs-time report for the --quality tiers.
+
+Renders each input at a few output sizes with every tier, reports the median wall time
+over several runs and how close the cell grid stays to `best`: PSNR of the per-cell
+shade values and the share of cells that picked the same glyph.
+"""
+from __future__ import annotations
+
+import argparse
+import math
+import os
+from pathlib import Path
+import re
+import statistics
+import subprocess
+import sys
+import time
+
+TIERS = ("best", "balanced", "fast")
+SIZES = ((80, 40), (160, 48))
+CELL_PATTERN = re.compile(rb"\x1b\[38;2;(\d+);\d+;\d+m(.)")
+
+
+def parse_cells(output: bytes) -> list[tuple[int, int]]:
+    return [(int(shade), glyph[0]) for shade, glyph in CELL_PATTERN.findall(output)]
+
+
+def psnr(reference: list[tuple[int, int]], candidate: list[tuple[int, int]]) -> float:
+    error = sum((a[0] - b[0]) ** 2 for a, b in zip(reference, candidate)) / len(reference)
+    return math.inf if error == 0 else 10.0 * math.log10(255.0 * 255.0 / error)
+
+
+def glyph_agreement(reference: list[tuple[int, int]], candidate: list[tuple[int, int]]) -> float:
+    return sum(a[1] == b[1] for a, b in zip(reference, candidate)) / len(reference)
+
+
+def render(bin_path: Path, image: Path, tier: str, width: int, height: int, runs: int) -> tuple[float, bytes]:
+    command = [str(bin_path), "--color", "always", "--quality", tier, str(image), str(width), str(height)]
+    timings = []
+    output = b""
+    for _ in range(runs):
+        start = time.perf_counter()
+        output = subprocess.run(command, check=True, stdout=subprocess.PIPE).stdout
+        timings.append(time.perf_counter() - start)
+    return statistics.median(timings), output
+
+
+def large_input(root: Path, out_dir: Path) -> Path | None:
+    """Upscales a downloaded photo to an 8K PGM when Pillow is available."""
+    target = out_dir / "photo_7680x4320.pgm"
+    if target.exists():
+        return target
+    source = root / "tests" / "fixtures" / "downloaded" / "wallhaven-6klxjw_1920x1080.png"
+    try:
+        from PIL import Image
+    except ImportError:
+        return None
+    if not source.exists():
+        return None
+    Image.open(source).convert("L").resize((7680, 4320), Image.BICUBIC).save(target)
+    return target
+
+
+def main() -> int:
+    root = Path(__file__).resolve().parents[1]
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bin", default=os.environ.get("FIB_BIN", str(root / "fib")))
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("images", nargs="*", type=Path)
+    args = parser.parse_args()
+
+    out_dir = root / "tests" / "output" / "bench"
+    out_dir.mkdir(parents=True, exist_ok=True)
+    images = list(args.images)
+    if not images:
+        downloaded = root / "tests" / "fixtures" / "downloaded"
+        images = [path for path in sorted(downloaded.glob("wallhaven-*.png")) if path.is_file()]
+        large = large_input(root, out_dir)
+        if large:
+            images.append(large)
+    if not images:
+        print("no benchmark inputs (run `make fetch-images` or pass image paths)", file=sys.stderr)
+        return 1
+
+    print(f"{'input':<36} {'size':>7} {'tier':<9} {'median ms':>10} {'speedup':>8} {'psnr dB':>8} {'glyphs':>7}")
+    for image in images:
+        for width, height in SIZES:
+            baseline_time = 0.0
+            baseline_cells: list[tuple[int, int]] = []
+            for tier in TIERS:
+                elapsed, output = render(Path(args.bin), image, tier, width, height, args.runs)
+                cells = parse_cells(output)
+                if tier == "best":
+                    baseline_time, baseline_cells = elapsed, cells
+                if len(cells) != len(baseline_cells) or not cells:
+                    print(f"error: {image.name} {tier} produced {len(cells)} cells", file=sys.stderr)
+                    return 1
+                print(
+                    f"{image.name:<36} {width:>3}x{height:<3} {tier:<9} {elapsed * 1000.0:>10.1f} "
+                    f"{baseline_time / elapsed:>7.1f}x {psnr(baseline_cells, cells):>8.1f} "
+                    f"{glyph_agreement(baseline_cells, cells) * 100.0:>6.1f}%"
+                )
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Speed and agreement report for the --edges estimators.
+
+Renders each input with `--edges sobel` and `--edges box`, reports the median wall time
+over several runs, how many cells each marks as edges (`| - / \\`), the share of edge cells
+the two agree on (intersection over union) and the share of all cells with the same glyph.
+The inputs are the downloaded photos, an 8K upscale of one of them and the two synthetic
+images of tests/scripts/depth_edge_check.py.
+"""
+from __future__ import annotations
+
+import argparse
+import os
+from pathlib import Path
+import statistics
+import subprocess
+import sys
+import time
+
+from benchmark import large_input
+
+MODES = ("sobel", "box")
+EDGE_GLYPHS = set("|-/\\")
+SIZES = ((100, 50), (160, 48))
+
+
+def render(bin_path: Path, image: Path, mode: str, width: int, height: int, runs: int) -> tuple[float, list[str]]:
+    command = [str(bin_path), "--color", "never", "--edges", mode, str(image), str(width), str(height)]
+    timings = []
+    output = ""
+    for _ in range(runs):
+        start = time.perf_counter()
+        output = subprocess.run(command, check=True, stdout=subprocess.PIPE, text=True).stdout
+        timings.append(time.perf_counter() - start)
+    return statistics.median(timings), output.splitlines()
+
+
+def edge_cells(lines: list[str]) -> set[tuple[int, int]]:
+    return {(x, y) for y, line in enumerate(lines) for x, glyph in enumerate(line) if glyph in EDGE_GLYPHS}
+
+
+def synthetic_inputs(root: Path, out_dir: Path) -> list[Path]:
+    sys.path.insert(0, str(root / "tests" / "scripts"))
+    from depth_edge_check import mk_diag_edge, mk_low_contrast
+
+    paths = [out_dir / "diag_edge.png", out_dir / "low_contrast.png"]
+    mk_diag_edge(paths[0])
+    mk_low_contrast(paths[1])
+    return paths
+
+
+def main() -> int:
+    root = Path(__file__).resolve().parents[1]
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bin", default=os.environ.get("FIB_BIN", str(root / "fib")))
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("images", nargs="*", type=Path)
+    args = parser.parse_args()
+
+    out_dir = root / "tests" / "output" / "bench"
+    out_dir.mkdir(parents=True, exist_ok=True)
+    images = list(args.images)
+    if not images:
+        downloaded = root / "tests" / "fixtures" / "downloaded"
+        images = [path for path in sorted(downloaded.glob("wallhaven-*.png")) if path.is_file()]
+        large = large_input(root, out_dir)
+        if large:
+            images.append(large)
+        images += synthetic_inputs(root, out_dir)
+
+    print(f"{'input':<36} {'size':>7} {'sobel ms':>9} {'box ms':>8} {'edges s/b':>10} {'edge IoU':>9} {'glyphs':>7}")
+    for image in images:
+        for width, height in SIZES:
+            results = {mode: render(Path(args.bin), image, mode, width, height, args.runs) for mode in MODES}
+            sobel_lines, box_lines = results["sobel"][1], results["box"][1]
+            sobel_edges, box_edges = edge_cells(sobel_lines), edge_cells(box_lines)
+            union = sobel_edges | box_edges
+            iou = len(sobel_edges & box_edges) / len(union) if union else 1.0
+            cells = sum(len(line) for line in sobel_lines)
+            same = sum(a == b for sobel, box in zip(sobel_lines, box_lines) for a, b in zip(sobel, box))
+            print(
+                f"{image.name:<36} {width:>3}x{height:<3} {results['sobel'][0] * 1000.0:>9.1f} {results['box'][0] * 1000.0:>8.1f} "
+                f"{len(sobel_edges):>4}/{len(box_edges):<5} {iou * 100.0:>8.1f}% {same / cells * 100.0:>6.1f}%"
+            )
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Prints the 4x4 glyph coverage signatures used by fib_glyph.c.
+
+Each printable ASCII glyph is rasterized into one monospace terminal cell: the advance
+width by the rows between the highest and lowest ink of any printable ASCII glyph, which
+drops the line gap that no glyph draws in. The cell is box-averaged down to a 4x4 grid of
+sub-blocks, whose edges are symmetric even when the cell width is not a multiple of 4. A
+bit is set where ink covers at least COVERAGE_THRESHOLD of the sub-block, or half of the
+glyph's densest sub-block when that is lower, so small marks such as '.' and ':' still
+get a signature. The threshold is low because a thin stroke such as '/' only grazes the
+corner sub-blocks it runs into; a higher one leaves it a two-column bar that no diagonal
+image cell is near. Bits are row-major from the top-left in bit 15.
+
+The rasterizer places outlines on the pixel grid from the left edge, so a glyph and its
+mirror image rarely cover exactly mirrored pixels. Each pair in MIRROR_PAIRS is measured
+as the average of one glyph and the other one flipped, which gives the pair mirror-image
+bits. Requires Pillow with FreeType.
+"""
+from __future__ import annotations
+
+import argparse
+
+from PIL import Image, ImageDraw, ImageFont
+
+DEFAULT_FONT = "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf"
+COVERAGE_THRESHOLD = 0.06
+GRID = 4
+MIRROR_PAIRS = ("/\\", "()", "[]", "{}", "<>")
+
+
+def coverage(font: ImageFont.FreeTypeFont, glyph: str, width: int, top: int, bottom: int) -> list[float]:
+    image = Image.new("F", (width, bottom - top), 0.0)
+    ImageDraw.Draw(image).text((0, -top), glyph, fill=1.0, font=font)
+    blocks = image.resize((GRID, GRID), Image.Resampling.BOX)
+    return [blocks.getpixel((x, y)) for y in range(GRID) for x in range(GRID)]
+
+
+def mirrored(values: list[float]) -> list[float]:
+    return [values[y * GRID + GRID - 1 - x] for y in range(GRID) for x in range(GRID)]
+
+
+def signature(values: list[float]) -> int:
+    threshold = min(COVERAGE_THRESHOLD, max(values) / 2.0)
+    bits = 0
+    for value in values:
+        bits = (bits << 1) | int(value > 0.0 and value >= threshold)
+    return bits
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--font", default=DEFAULT_FONT)
+    parser.add_argument("--size", type=int, default=64)
+    args = parser.parse_args()
+
+    font = ImageFont.truetype(args.font, args.size)
+    width = int(font.getlength("M"))
+    boxes = [font.getbbox(chr(code)) for code in range(0x21, 0x7F)]
+    top = min(box[1] for box in boxes)
+    bottom = max(box[3] for box in boxes)
+
+    blocks = {chr(code): coverage(font, chr(code), width, top, bottom) for code in range(0x20, 0x7F)}
+    for left, right in MIRROR_PAIRS:
+        averaged = [(a + b) / 2.0 for a, b in zip(blocks[left], mirrored(blocks[right]))]
+        blocks[left], blocks[right] = averaged, mirrored(averaged)
+
+    for code in range(0x20, 0x7F):
+        glyph = chr(code)
+        comment = "'\\''" if glyph == "'" else "'\\\\'" if glyph == "\\" else f"'{glyph}'"
+        print(f"    0x{signature(blocks[glyph]):04X}, /* {comment} */")
+
+
+if __name__ == "__main__":
+    main()
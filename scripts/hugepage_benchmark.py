@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Wall time and dTLB misses with and without huge-page buffers.
+
+Renders each input with the default allocator (2 MiB transparent huge pages for images and
+summed-area tables) and with `--no-huge-pages`, and reports the median wall time over
+several runs and, when `perf` is installed and allowed to read hardware counters, the
+median `dTLB-load-misses`. Each size runs with `--threads 1` and with `--threads N` (all
+online CPUs unless --threads says otherwise), where the analysis strips first-touch the
+table pages from several threads. The default input is the 8K upscale from benchmark.py, a
+PGM that is mapped rather than copied, so the difference is mostly the summed-area tables.
+Huge pages only apply when /sys/kernel/mm/transparent_hugepage/enabled is `always` or
+`madvise`.
+"""
+from __future__ import annotations
+
+import argparse
+import os
+from pathlib import Path
+import shutil
+import statistics
+import subprocess
+import sys
+import time
+
+from benchmark import large_input
+
+MODES = (("huge", []), ("normal", ["--no-huge-pages"]))
+SIZES = ((200, 60), (1000, 400))
+THP_SETTING = Path("/sys/kernel/mm/transparent_hugepage/enabled")
+
+
+def tlb_misses(command: list[str]) -> int | None:
+    result = subprocess.run(
+        ["perf", "stat", "-x", ",", "-e", "dTLB-load-misses", "--"] + command,
+        stdout=subprocess.DEVNULL,
+        stderr=subprocess.PIPE,
+        text=True,
+    )
+    for line in result.stderr.splitlines():
+        fields = line.split(",")
+        if len(fields) > 2 and "dTLB-load-misses" in fields[2] and fields[0].isdigit():
+            return int(fields[0])
+    return None
+
+
+def measure(
+    bin_path: Path, image: Path, flags: list[str], threads: int, width: int, height: int, runs: int
+) -> tuple[float, int | None]:
+    command = [str(bin_path), "--color", "never", "--threads", str(threads)] + flags + [str(image), str(width), str(height)]
+    timings = []
+    for _ in range(runs):
+        start = time.perf_counter()
+        subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+        timings.append(time.perf_counter() - start)
+    misses = None
+    if shutil.which("perf"):
+        counts = [tlb_misses(command) for _ in range(runs)]
+        if all(count is not None for count in counts):
+            misses = int(statistics.median(counts))
+    return statistics.median(timings), misses
+
+
+def main() -> int:
+    root = Path(__file__).resolve().parents[1]
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bin", default=os.environ.get("FIB_BIN", str(root / "fib")))
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--threads", type=int, default=os.cpu_count() or 1, help="thread count of the parallel runs")
+    parser.add_argument("images", nargs="*", type=Path)
+    args = parser.parse_args()
+
+    out_dir = root / "tests" / "output" / "bench"
+    out_dir.mkdir(parents=True, exist_ok=True)
+    images = list(args.images)
+    if not images:
+        large = large_input(root, out_dir)
+        if not large:
+            print("skipping huge-page benchmark: no input (needs Pillow and the downloaded photos)")
+            return 0
+        images = [large]
+
+    setting = THP_SETTING.read_text().strip() if THP_SETTING.exists() else "unavailable"
+    print(f"transparent huge pages: {setting}")
+    thread_counts = sorted({1, max(args.threads, 1)})
+    print(
+        f"{'input':<28} {'size':>8} {'threads':>7} {'huge ms':>8} {'normal ms':>10} {'speedup':>8} "
+        f"{'huge dTLB':>12} {'normal dTLB':>12}"
+    )
+    for image in images:
+        for width, height in SIZES:
+            for threads in thread_counts:
+                results = {
+                    name: measure(Path(args.bin), image, flags, threads, width, height, args.runs) for name, flags in MODES
+                }
+                huge, normal = results["huge"], results["normal"]
+                misses = [f"{count:>12}" if count is not None else f"{'n/a':>12}" for count in (huge[1], normal[1])]
+                print(
+                    f"{image.name:<28} {width:>4}x{height:<3} {threads:>7} {huge[0] * 1000.0:>8.1f} "
+                    f"{normal[0] * 1000.0:>10.1f} {normal[0] / huge[0]:>7.2f}x {misses[0]} {misses[1]}"
+                )
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Wall time of a still render with and without the decode/analysis overlap.
+
+With two or more threads a full-resolution render builds its summed-area tables on a
+worker thread while the decoder is still inflating rows, so only the tone curve and the
+output loop follow the last scanline. This renders the 8K upscale from benchmark.py,
+re-encoded as PNG and JPEG (the PGM is mapped, not decoded), with `--threads 1` (decode,
+then the analysis) and `--threads 2` (the overlap), checks that both outputs match and
+reports the median wall times. The overlap needs a second core to pay off; on one CPU
+the two threads share it.
+"""
+from __future__ import annotations
+
+import argparse
+import os
+from pathlib import Path
+import statistics
+import subprocess
+import sys
+import time
+
+from benchmark import large_input
+
+SIZES = ((200, 60), (1000, 400))
+
+
+def encoded_inputs(source: Path, out_dir: Path) -> list[Path]:
+    from PIL import Image
+
+    targets = [out_dir / "photo_7680x4320.png", out_dir / "photo_7680x4320.jpg"]
+    for target in targets:
+        if not target.exists():
+            Image.open(source).convert("RGB").save(target)
+    return targets
+
+
+def measure(bin_path: Path, image: Path, threads: int, width: int, height: int, runs: int) -> tuple[float, bytes, str]:
+    command = [str(bin_path), "--color", "never", "--threads", str(threads), str(image), str(width), str(height)]
+    timings = []
+    output = b""
+    for _ in range(runs):
+        start = time.perf_counter()
+        output = subprocess.run(command, check=True, stdout=subprocess.PIPE).stdout
+        timings.append(time.perf_counter() - start)
+    verbose = subprocess.run(command[:1] + ["--verbose"] + command[1:], check=True, stdout=subprocess.DEVNULL,
+                             stderr=subprocess.PIPE, text=True).stderr
+    note = next((line.removeprefix("fib: ") for line in verbose.splitlines() if "during decode" in line), "-")
+    return statistics.median(timings), output, note
+
+
+def main() -> int:
+    root = Path(__file__).resolve().parents[1]
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bin", default=os.environ.get("FIB_BIN", str(root / "fib")))
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("images", nargs="*", type=Path)
+    args = parser.parse_args()
+
+    out_dir = root / "tests" / "output" / "bench"
+    out_dir.mkdir(parents=True, exist_ok=True)
+    images = list(args.images)
+    if not images:
+        large = large_input(root, out_dir)
+        if not large:
+            print("skipping overlap benchmark: no input (needs Pillow and the downloaded photos)")
+            return 0
+        images = encoded_inputs(large, out_dir)
+
+    print(f"online cpus: {os.cpu_count()}")
+    print(f"{'input':<24} {'size':>9} {'serial ms':>10} {'overlap ms':>11} {'speedup':>8}  overlap")
+    for image in images:
+        for width, height in SIZES:
+            serial = measure(Path(args.bin), image, 1, width, height, args.runs)
+            overlap = measure(Path(args.bin), image, 2, width, height, args.runs)
+            if serial[1] != overlap[1]:
+                print(f"error: {image.name} output differs between --threads 1 and --threads 2", file=sys.stderr)
+                return 1
+            print(
+                f"{image.name:<24} {width:>4}x{height:<4} {serial[0] * 1000.0:>10.1f} {overlap[0] * 1000.0:>11.1f} "
+                f"{serial[0] / overlap[0]:>7.2f}x  {overlap[2]}"
+            )
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Throughput of --pipeline against one fib process per image.
+
+Renders a manifest of the fixture and downloaded images, repeated to a few dozen entries,
+once by running `fib` per path and once through `fib --pipeline` with the paths on
+standard input, checks that both produce the same bytes and reports the median wall
+time and images per second of each. --verbose output of the pipeline run lists the busy
+time of every stage; the pipeline approaches the slowest stage's rate.
+"""
+from __future__ import annotations
+
+import argparse
+import os
+from pathlib import Path
+import statistics
+import subprocess
+import sys
+import time
+
+SIZE = ("120", "40")
+
+
+def sequential(bin_path: Path, paths: list[Path]) -> bytes:
+    return b"".join(
+        subprocess.run([str(bin_path), "--color", "never", str(path), *SIZE], check=True, stdout=subprocess.PIPE).stdout
+        for path in paths
+    )
+
+
+def pipelined(bin_path: Path, paths: list[Path], in_flight: int) -> bytes:
+    manifest = "".join(f"{path}\n" for path in paths).encode()
+    command = [str(bin_path), "--pipeline", "--in-flight", str(in_flight), "--color", "never", *SIZE]
+    return subprocess.run(command, check=True, input=manifest, stdout=subprocess.PIPE).stdout
+
+
+def timed(run, runs: int) -> tuple[float, bytes]:
+    timings = []
+    output = b""
+    for _ in range(runs):
+        start = time.perf_counter()
+        output = run()
+        timings.append(time.perf_counter() - start)
+    return statistics.median(timings), output
+
+
+def main() -> int:
+    root = Path(__file__).resolve().parents[1]
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bin", default=os.environ.get("FIB_BIN", str(root / "fib")))
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--count", type=int, default=48)
+    parser.add_argument("--in-flight", type=int, default=8)
+    args = parser.parse_args()
+
+    fixtures = root / "tests" / "fixtures"
+    images = [path for path in sorted(fixtures.glob("*.png")) + sorted(fixtures.glob("*.jpg")) if path.name != "animation.png"]
+    images += [path for path in sorted((fixtures / "downloaded").glob("wallhaven-*.png")) if path.is_file()]
+    if not images:
+        print("skipping pipeline benchmark: no fixtures (run make fixtures)")
+        return 0
+    paths = [images[i % len(images)] for i in range(args.count)]
+
+    bin_path = Path(args.bin)
+    per_process = timed(lambda: sequential(bin_path, paths), args.runs)
+    pipeline = timed(lambda: pipelined(bin_path, paths, args.in_flight), args.runs)
+    if per_process[1] != pipeline[1]:
+        print("error: --pipeline output differs from per-image runs", file=sys.stderr)
+        return 1
+
+    print(f"{'mode':<24} {'images':>7} {'wall ms':>9} {'images/s':>9}")
+    for name, (seconds, _) in (("fib per image", per_process), (f"--pipeline (in flight {args.in_flight})", pipeline)):
+        print(f"{name:<24} {len(paths):>7} {seconds * 1000.0:>9.1f} {len(paths) / seconds:>9.1f}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
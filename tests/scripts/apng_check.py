@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+from __future__ import annotations
+
+import os
+from pathlib import Path
+import pty
+import re
+import subprocess
+
+ESCAPE = re.compile(r"\x1b\[[0-9;]*[A-Za-z]")
+FRAMES = 4
+PLAYS = 2
+WIDTH, HEIGHT = "16", "8"
+
+
+def run(cmd: list[str]) -> subprocess.CompletedProcess:
+    return subprocess.run(cmd, check=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+
+
+def play_on_terminal(cmd: list[str]) -> tuple[list[str], str]:
+    """Runs an animation on a pseudo-terminal and returns the frames painted in place."""
+    master, slave = pty.openpty()
+    env = os.environ.copy()
+    env["NO_COLOR"] = "1"
+    process = subprocess.Popen(cmd, stdout=slave, stderr=subprocess.PIPE, env=env, text=True)
+    os.close(slave)
+    data = b""
+    while True:
+        try:
+            chunk = os.read(master, 65536)
+        except OSError:
+            break
+        if not chunk:
+            break
+        data += chunk
+    _, log = process.communicate(timeout=10)
+    os.close(master)
+    assert process.returncode == 0, "terminal playback failed"
+    frames = data.decode().split("\x1b[H")[1:]
+    return [ESCAPE.sub("", frame).replace("\r", "") for frame in frames], log
+
+
+def main() -> None:
+    root = Path(__file__).resolve().parents[1]
+    bin_path = str(Path(os.environ.get("FIB_BIN", str(root.parent / "fib"))))
+    fixtures = root / "fixtures"
+    out_dir = root / "output" / "apng"
+    out_dir.mkdir(parents=True, exist_ok=True)
+    animation = str(fixtures / "animation.png")
+
+    stills = [run([bin_path, str(fixtures / f"animation_frame{i}.png"), WIDTH, HEIGHT]).stdout for i in range(FRAMES)]
+
+    saved = out_dir / "frames.txt"
+    run([bin_path, "--threads", "4", animation, WIDTH, HEIGHT, str(saved)])
+    assert saved.read_text() == "".join(stills), "composited frames should match the reference stills"
+    single = run([bin_path, "--threads", "1", animation, WIDTH, HEIGHT]).stdout
+    assert single == "".join(stills), "frame output should not depend on the thread count"
+
+    grid = out_dir / "frames.grid"
+    grid.unlink(missing_ok=True)
+    run([bin_path, "--format", "grid", animation, WIDTH, HEIGHT, str(grid)])
+    assert grid.read_bytes().count(b"FIBG") == FRAMES, "grid output should append one frame per animation frame"
+
+    expected = stills * PLAYS
+    for cache, log_line in (("64M", "4 cached"), ("300", "2 cached"), ("0", "0 cached")):
+        frames, log = play_on_terminal([bin_path, "--verbose", "--threads", "4", "--frame-cache", cache, animation, WIDTH, HEIGHT])
+        assert frames == expected, f"playback with --frame-cache {cache} should loop through every frame"
+        assert log_line in log, f"--frame-cache {cache} should report '{log_line}'"
+
+    print("apng checks passed")
+
+
+if __name__ == "__main__":
+    main()
@@ -4,7 +4,7 @@ from __future__ import annotations
 import os
 from pathlib import Path
 import subprocess
-from PIL import Image
+from PIL import Image, ImageOps
 
 
 def mk_low_contrast(path: Path) -> None:
@@ -28,11 +28,54 @@ def mk_diag_edge(path: Path) -> None:
     img.save(path)
 
 
-def run_fib(bin_path: Path, in_path: Path, out_path: Path, w: int, h: int) -> str:
-    subprocess.run([str(bin_path), str(in_path), str(w), str(h), str(out_path)], check=True, stdout=subprocess.DEVNULL)
+def mk_diag_strokes(path: Path, mirrored_path: Path) -> None:
+    # 16x32-pixel cells at 20x6, strokes along cell diagonals plus one off the cell corners.
+    w, h = 320, 192
+    img = Image.new('L', (w, h), 255)
+    p = img.load()
+    for start in (0, 64, 128, 150):
+        for y in range(h):
+            for t in range(3):
+                x = start + y // 2 + t
+                if x < w:
+                    p[x, y] = 0
+    img.save(path)
+    ImageOps.mirror(img).save(mirrored_path)
+
+
+EDGE_MODES = ('sobel', 'box')
+
+
+def run_fib(bin_path: Path, in_path: Path, out_path: Path, w: int, h: int, edges: str = 'sobel') -> str:
+    subprocess.run([str(bin_path), '--edges', edges, str(in_path), str(w), str(h), str(out_path)], check=True,
+                   stdout=subprocess.DEVNULL)
     return out_path.read_text()
 
 
+def check_mirrored_slashes(bin_path: Path, out_dir: Path) -> None:
+    img = out_dir / 'diag_strokes.png'
+    mirrored_img = out_dir / 'diag_strokes_mirrored.png'
+    mk_diag_strokes(img, mirrored_img)
+    rows = []
+    for path in (img, mirrored_img):
+        out_path = out_dir / f'{path.stem}_shape.txt'
+        subprocess.run([str(bin_path), '--glyphs', 'shape', str(path), '20', '6', str(out_path)], check=True,
+                       stdout=subprocess.DEVNULL)
+        rows.append(out_path.read_text().splitlines())
+    swap = {'/': '\\', '\\': '/'}
+    slashes = 0
+    for y, (row, mirrored_row) in enumerate(zip(*rows)):
+        for x, glyph in enumerate(row):
+            if glyph in swap:
+                slashes += 1
+                mirrored_glyph = mirrored_row[len(row) - 1 - x]
+                assert mirrored_glyph == swap[glyph], \
+                    f'{glyph!r} at row {y} column {x} mirrors to {mirrored_glyph!r}, expected {swap[glyph]!r}'
+        assert row.count('/') == mirrored_row.count('\\') and row.count('\\') == mirrored_row.count('/'), \
+            f'row {y}: {row!r} and {mirrored_row!r} pick different slash counts'
+    assert slashes >= 10, f'expected diagonal strokes to pick slashes, got {slashes}: {rows[0]}'
+
+
 def main() -> None:
     root = Path(__file__).resolve().parents[1]
     bin_path = Path(os.environ.get('FIB_BIN', str(root.parent / 'fib')))
@@ -40,18 +83,20 @@ def main() -> None:
     out_dir.mkdir(parents=True, exist_ok=True)
 
     lc_img = out_dir / 'low_contrast.png'
-    lc_out = out_dir / 'low_contrast.txt'
-    mk_low_contrast(lc_img)
-    lc_txt = run_fib(bin_path, lc_img, lc_out, 160, 48)
-    lc_unique = len(set(lc_txt) - {'\n'})
-    assert lc_unique >= 24, f'expected >=24 unique chars for low-contrast image, got {lc_unique}'
-
     eg_img = out_dir / 'diag_edge.png'
-    eg_out = out_dir / 'diag_edge.txt'
+    mk_low_contrast(lc_img)
     mk_diag_edge(eg_img)
-    eg_txt = run_fib(bin_path, eg_img, eg_out, 100, 50)
-    eg_count = sum(eg_txt.count(c) for c in '/\\|-_')
-    assert eg_count >= 25, f'expected visible edge glyphs, got {eg_count}'
+
+    for edges in EDGE_MODES:
+        lc_txt = run_fib(bin_path, lc_img, out_dir / f'low_contrast_{edges}.txt', 160, 48, edges)
+        lc_unique = len(set(lc_txt) - {'\n'})
+        assert lc_unique >= 24, f'expected >=24 unique chars for low-contrast image with {edges} edges, got {lc_unique}'
+
+        eg_txt = run_fib(bin_path, eg_img, out_dir / f'diag_edge_{edges}.txt', 100, 50, edges)
+        eg_count = sum(eg_txt.count(c) for c in '/\\|-_')
+        assert eg_count >= 25, f'expected visible edge glyphs with {edges} edges, got {eg_count}'
+
+    check_mirrored_slashes(bin_path, out_dir)
 
     print('depth-edge checks passed')
 
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+from __future__ import annotations
+
+import fcntl
+import os
+from pathlib import Path
+import pty
+import re
+import select
+import signal
+import struct
+import subprocess
+import termios
+import time
+
+ESCAPE = re.compile(r"\x1b\[[0-9;]*[A-Za-z]")
+
+
+def set_size(fd: int, columns: int, rows: int) -> None:
+    fcntl.ioctl(fd, termios.TIOCSWINSZ, struct.pack("HHHH", rows, columns, 0, 0))
+
+
+def read_frame(master: int, rows: int, timeout: float = 5.0) -> list[str]:
+    """Collects output until a full frame of `rows` lines has arrived."""
+    data = b""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        ready, _, _ = select.select([master], [], [], 0.05)
+        if ready:
+            data += os.read(master, 65536)
+            continue
+        frames = data.decode(errors="replace").split("\x1b[H")
+        lines = [line for line in ESCAPE.sub("", frames[-1]).replace("\r", "").split("\n") if line]
+        if len(lines) >= rows:
+            return lines
+    raise AssertionError(f"no complete {rows}-row frame within {timeout}s")
+
+
+def check_planned_for_terminal(bin_path: Path, photo: Path, env: dict[str, str]) -> None:
+    """--fit --max-memory plans for the terminal, and plans again once a resize outgrows it."""
+    log_path = photo.parents[2] / "output" / "fit_plan_log.txt"
+    master, slave = pty.openpty()
+    set_size(slave, 30, 11)
+    with open(log_path, "w") as log:
+        process = subprocess.Popen([str(bin_path), "--fit", "--verbose", "--max-memory", "4M", str(photo)], stdout=slave,
+                                   stderr=log, env=env)
+    os.close(slave)
+    try:
+        read_frame(master, 10)
+        # 30x10 cells fit a 3x box downscale; the parse-time 80x40 would have picked 2x banded
+        assert "tables compact, downscale 3" in log_path.read_text(), "first plan should be made for the 30x10 terminal"
+
+        # 400 columns leave a 3x downscale under 2 pixels per cell
+        set_size(master, 400, 100)
+        process.send_signal(signal.SIGWINCH)
+        lines = read_frame(master, 99)
+        assert all(len(line) == 400 for line in lines[:99]), "frame should follow the resized terminal"
+        log = log_path.read_text()
+        assert "plan does not hold at 400x99" in log, "a resize past the plan should plan again"
+        assert "tables banded, downscale 2" in log, "the new plan should be made for 400x99"
+
+        set_size(master, 300, 90)
+        process.send_signal(signal.SIGWINCH)
+        read_frame(master, 89)
+        assert log_path.read_text().count("plan does not hold") == 1, "shrinking within the plan should keep the image"
+    finally:
+        process.send_signal(signal.SIGINT)
+        assert process.wait(timeout=5) == 0, "--fit should exit cleanly on SIGINT"
+        os.close(master)
+
+
+def check_watch_truncation(bin_path: Path, fixture: Path, out_dir: Path, env: dict[str, str]) -> None:
+    """--watch --fit repaints a PGM after another process truncated it in place, without SIGBUS."""
+    watched = out_dir / "fit_truncated.pgm"
+    watched.write_bytes(fixture.read_bytes())
+    master, slave = pty.openpty()
+    set_size(slave, 30, 11)
+    process = subprocess.Popen([str(bin_path), "--watch", "--fit", str(watched)], stdout=slave, stderr=subprocess.DEVNULL, env=env)
+    os.close(slave)
+    try:
+        read_frame(master, 10)
+        # truncate(2) raises no IN_CLOSE_WRITE, so the next repaint still draws the cached image
+        os.truncate(watched, 0)
+        set_size(master, 40, 9)
+        process.send_signal(signal.SIGWINCH)
+        lines = read_frame(master, 8)
+        assert all(len(line) == 40 for line in lines[:8]), "frame should follow the resized terminal"
+        assert process.poll() is None, "a truncated input must not take the live session down"
+    finally:
+        process.send_signal(signal.SIGINT)
+        assert process.wait(timeout=5) == 0, "--watch --fit should exit cleanly on SIGINT"
+        os.close(master)
+
+
+def main() -> None:
+    root = Path(__file__).resolve().parents[1]
+    bin_path = Path(os.environ.get("FIB_BIN", str(root.parent / "fib")))
+    fixture = root / "fixtures" / "radial.png"
+
+    master, slave = pty.openpty()
+    set_size(slave, 30, 11)
+    env = os.environ.copy()
+    env["NO_COLOR"] = "1"
+    process = subprocess.Popen([str(bin_path), "--fit", str(fixture)], stdout=slave, stderr=subprocess.DEVNULL, env=env)
+    os.close(slave)
+    try:
+        lines = read_frame(master, 10)
+        assert all(len(line) == 30 for line in lines[:10]), "initial frame should match the 30-column terminal"
+
+        set_size(master, 44, 9)
+        process.send_signal(signal.SIGWINCH)
+        lines = read_frame(master, 8)
+        assert all(len(line) == 44 for line in lines[:8]), "frame should follow the resized terminal"
+    finally:
+        process.send_signal(signal.SIGINT)
+        assert process.wait(timeout=5) == 0, "--fit should exit cleanly on SIGINT"
+        os.close(master)
+
+    check_planned_for_terminal(bin_path, root / "fixtures" / "downloaded" / "wallhaven-6klxjw_1920x1080.png", env)
+    check_watch_truncation(bin_path, root / "fixtures" / "radial.pgm", root / "output", env)
+    print("fit checks passed")
+
+
+if __name__ == "__main__":
+    main()
@@ -33,6 +33,93 @@ def write_png_gray(path: pathlib.Path, pixels: list[list[int]]) -> None:
     payload += png_chunk(b"IEND", b"")
     path.write_bytes(payload)
 
+def write_png_rgba(path: pathlib.Path, pixels: list[list[tuple[int, int, int, int]]]) -> None:
+    height = len(pixels)
+    width = len(pixels[0]) if height else 0
+    payload = b"\x89PNG\r\n\x1a\n"
+    payload += png_chunk(b"IHDR", struct.pack("!IIBBBBB", width, height, 8, 6, 0, 0, 0))
+    payload += png_chunk(b"IDAT", zlib.compress(rgba_scanlines(pixels), level=9))
+    payload += png_chunk(b"IEND", b"")
+    path.write_bytes(payload)
+
+
+def rgba_scanlines(pixels: list[list[tuple[int, int, int, int]]]) -> bytes:
+    raw = bytearray()
+    for row in pixels:
+        raw.append(0)
+        for pixel in row:
+            raw.extend(pixel)
+    return bytes(raw)
+
+
+def write_apng(path: pathlib.Path, width: int, height: int, frames: list[dict], num_plays: int) -> None:
+    """frames: x, y, pixels (RGBA rows), dispose (0 none, 1 background, 2 previous), blend (0 source, 1 over)."""
+    payload = b"\x89PNG\r\n\x1a\n"
+    payload += png_chunk(b"IHDR", struct.pack("!IIBBBBB", width, height, 8, 6, 0, 0, 0))
+    payload += png_chunk(b"acTL", struct.pack("!II", len(frames), num_plays))
+    sequence = 0
+    for index, frame in enumerate(frames):
+        pixels = frame["pixels"]
+        control = struct.pack("!IIIIIHHBB", sequence, len(pixels[0]), len(pixels), frame["x"], frame["y"], 1, 100,
+                              frame["dispose"], frame["blend"])
+        payload += png_chunk(b"fcTL", control)
+        sequence += 1
+        data = zlib.compress(rgba_scanlines(pixels), level=9)
+        if index == 0:
+            payload += png_chunk(b"IDAT", data)
+        else:
+            payload += png_chunk(b"fdAT", struct.pack("!I", sequence) + data)
+            sequence += 1
+    payload += png_chunk(b"IEND", b"")
+    path.write_bytes(payload)
+
+
+def composite_apng(width: int, height: int, frames: list[dict]) -> list[list[list[tuple[int, int, int, int]]]]:
+    """Reference canvases after each frame; sources are fully opaque or fully clear, so "over" is exact."""
+    canvas = [[(0, 0, 0, 0)] * width for _ in range(height)]
+    canvases = []
+    for frame in frames:
+        rows, columns = len(frame["pixels"]), len(frame["pixels"][0])
+        saved = [row[:] for row in canvas]
+        for y in range(rows):
+            for x in range(columns):
+                pixel = frame["pixels"][y][x]
+                if frame["blend"] == 0 or pixel[3] == 255:
+                    canvas[frame["y"] + y][frame["x"] + x] = pixel
+        canvases.append([row[:] for row in canvas])
+        for y in range(rows):
+            for x in range(columns):
+                if frame["dispose"] == 1:
+                    canvas[frame["y"] + y][frame["x"] + x] = (0, 0, 0, 0)
+                elif frame["dispose"] == 2:
+                    canvas[frame["y"] + y][frame["x"] + x] = saved[frame["y"] + y][frame["x"] + x]
+    return canvases
+
+
+ADAM7_PASSES = [(0, 0, 8, 8), (4, 0, 8, 8), (0, 4, 4, 8), (2, 0, 4, 4), (0, 2, 2, 4), (1, 0, 2, 2), (0, 1, 1, 2)]
+
+
+def write_png_gray_adam7(path: pathlib.Path, pixels: list[list[int]]) -> None:
+    height = len(pixels)
+    width = len(pixels[0]) if height else 0
+
+    raw = bytearray()
+    for start_x, start_y, step_x, step_y in ADAM7_PASSES:
+        columns = range(start_x, width, step_x)
+        if not columns:
+            continue
+        for y in range(start_y, height, step_y):
+            raw.append(0)
+            raw.extend(max(0, min(255, pixels[y][x])) for x in columns)
+
+    ihdr = struct.pack("!IIBBBBB", width, height, 8, 0, 0, 0, 1)
+    payload = b"\x89PNG\r\n\x1a\n"
+    payload += png_chunk(b"IHDR", ihdr)
+    payload += png_chunk(b"IDAT", zlib.compress(bytes(raw), level=9))
+    payload += png_chunk(b"IEND", b"")
+    path.write_bytes(payload)
+
+
 def write_jpeg_gray(path: pathlib.Path, pixels: list[list[int]]) -> None:
     height = len(pixels)
     width = len(pixels[0]) if height else 0
@@ -41,6 +128,30 @@ def write_jpeg_gray(path: pathlib.Path, pixels: list[list[int]]) -> None:
     image.save(path, format="JPEG", quality=100, subsampling=0)
 
 
+def write_pgm(path: pathlib.Path, pixels: list[list[int]]) -> None:
+    height = len(pixels)
+    width = len(pixels[0]) if height else 0
+    header = f"P5\n# fib fixture\n{width} {height}\n255\n".encode("ascii")
+    path.write_bytes(header + bytes(max(0, min(255, v)) for row in pixels for v in row))
+
+
+def write_ppm_gray(path: pathlib.Path, pixels: list[list[int]]) -> None:
+    height = len(pixels)
+    width = len(pixels[0]) if height else 0
+    header = f"P6 {width} {height} 255\n".encode("ascii")
+    path.write_bytes(header + bytes(max(0, min(255, v)) for row in pixels for v in row for _ in range(3)))
+
+
+def write_pam_gray16(path: pathlib.Path, pixels: list[list[int]]) -> None:
+    height = len(pixels)
+    width = len(pixels[0]) if height else 0
+    header = (
+        f"P7\nWIDTH {width}\nHEIGHT {height}\nDEPTH 2\nMAXVAL 65535\nTUPLTYPE GRAYSCALE_ALPHA\nENDHDR\n"
+    ).encode("ascii")
+    raster = b"".join(struct.pack("!HH", max(0, min(255, v)) * 257, 65535) for row in pixels for v in row)
+    path.write_bytes(header + raster)
+
+
 def main() -> None:
     FIXTURES.mkdir(parents=True, exist_ok=True)
 
@@ -65,6 +176,36 @@ def main() -> None:
     write_png_gray(FIXTURES / "checker.png", checker)
     write_png_gray(FIXTURES / "radial.png", radial)
     write_jpeg_gray(FIXTURES / "white.jpg", white)
+    waves = [[int(127 + 120 * math.sin(x / 9.0) * math.cos(y / 7.0)) for x in range(256)] for y in range(192)]
+    write_png_gray(FIXTURES / "waves.png", waves)
+    write_png_gray_adam7(FIXTURES / "waves_adam7.png", waves)
+    write_png_gray(FIXTURES / "waves_pass1.png", [row[::8] for row in waves[::8]])
+    write_pgm(FIXTURES / "white.pgm", white)
+    write_pgm(FIXTURES / "radial.pgm", radial)
+    # 16x32 cells on white: a falling diagonal, a rising diagonal and a bottom bar
+    shapes = [[255] * 48 for _ in range(32)]
+    for y in range(32):
+        for t in range(-2, 3):
+            shapes[y][min(15, max(0, y // 2 + t))] = 0
+            shapes[y][16 + min(15, max(0, 15 - y // 2 + t))] = 0
+    for y in range(26, 32):
+        shapes[y][32:48] = [0] * 16
+    write_pgm(FIXTURES / "shapes.pgm", shapes)
+    write_ppm_gray(FIXTURES / "radial.ppm", radial)
+    write_pam_gray16(FIXTURES / "radial.pam", radial)
+    # 32x16, four frames covering each dispose op and both blend ops; plays twice
+    animation = [
+        {"x": 0, "y": 0, "dispose": 0, "blend": 0,
+         "pixels": [[(x * 8, x * 8, x * 8, 255) for x in range(32)] for _ in range(16)]},
+        {"x": 8, "y": 4, "dispose": 2, "blend": 1,
+         "pixels": [[(255, 255, 255, 255 if (x // 4 + y // 4) % 2 == 0 else 0) for x in range(16)] for y in range(8)]},
+        {"x": 0, "y": 0, "dispose": 1, "blend": 0, "pixels": [[(0, 0, 0, 255)] * 16 for _ in range(8)]},
+        {"x": 16, "y": 8, "dispose": 0, "blend": 1,
+         "pixels": [[(128, 128, 128, 255 if (x // 2) % 2 == 0 else 0) for x in range(16)] for _ in range(8)]},
+    ]
+    write_apng(FIXTURES / "animation.png", 32, 16, animation, 2)
+    for index, canvas in enumerate(composite_apng(32, 16, animation)):
+        write_png_rgba(FIXTURES / f"animation_frame{index}.png", canvas)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+from __future__ import annotations
+
+import os
+from pathlib import Path
+import re
+import struct
+import subprocess
+
+HEADER = struct.Struct("<4sHHIIIBBH")
+CELL_PATTERN = re.compile(rb"\x1b\[38;2;(\d+);\d+;\d+m(.)")
+
+
+def read_frames(data: bytes) -> list[tuple[tuple, bytes, bytes]]:
+    frames = []
+    offset = 0
+    while offset < len(data):
+        header = HEADER.unpack_from(data, offset)
+        magic, version, header_size, width, height, frame_size = header[:6]
+        assert magic == b"FIBG" and version == 1 and header_size == HEADER.size, "bad grid header"
+        assert frame_size % 8 == 0 and offset + frame_size <= len(data), "bad grid frame size"
+        cells = width * height
+        glyphs = data[offset + header_size : offset + header_size + cells]
+        shades = data[offset + header_size + cells : offset + header_size + 2 * cells]
+        assert not any(data[offset + header_size + 2 * cells : offset + frame_size]), "padding should be zero"
+        frames.append((header, glyphs, shades))
+        offset += frame_size
+    return frames
+
+
+def main() -> None:
+    root = Path(__file__).resolve().parents[1]
+    bin_path = Path(os.environ.get("FIB_BIN", str(root.parent / "fib")))
+    fixture = root / "fixtures" / "radial.png"
+    out_dir = root / "output"
+    out_dir.mkdir(parents=True, exist_ok=True)
+    grid_path = out_dir / "radial.grid"
+    grid_path.unlink(missing_ok=True)
+
+    text = subprocess.run(
+        [str(bin_path), "--color", "always", "--palette", "smooth", str(fixture), "18", "11"], check=True, stdout=subprocess.PIPE
+    ).stdout
+    cells = CELL_PATTERN.findall(text)
+    expected_glyphs = b"".join(glyph for _, glyph in cells)
+    expected_shades = bytes(int(shade) for shade, _ in cells)
+
+    streamed = subprocess.run(
+        [str(bin_path), "--format", "grid", "--palette", "smooth", str(fixture), "18", "11"], check=True, stdout=subprocess.PIPE
+    ).stdout
+    frames = read_frames(streamed)
+    assert len(frames) == 1, "stdout should carry exactly one frame"
+    header, glyphs, shades = frames[0]
+    assert header[3:5] == (18, 11) and header[5] == len(streamed) == 424, "unexpected frame geometry"
+    assert header[6] == 1 and header[7] == 0, "palette and glyph mode should be recorded"
+    assert glyphs == expected_glyphs and shades == expected_shades, "grid cells should match the text render"
+
+    for extra in ([], ["--glyphs", "shape"]):
+        subprocess.run(
+            [str(bin_path), "--format", "grid", *extra, str(fixture), "18", "11", str(grid_path)],
+            check=True,
+            stdout=subprocess.DEVNULL,
+        )
+    appended = read_frames(grid_path.read_bytes())
+    assert len(appended) == 2, "grid frames should append to the output file"
+    assert appended[0][0][7] == 0 and appended[1][0][7] == 1, "frames should keep their own glyph mode"
+
+    print("grid checks passed")
+
+
+if __name__ == "__main__":
+    main()
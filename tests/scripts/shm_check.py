@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+from __future__ import annotations
+
+import os
+from pathlib import Path
+import pty
+import shutil
+import signal
+import subprocess
+import sys
+import time
+
+from fit_check import read_frame, set_size
+
+
+def wait_for(predicate, timeout: float = 5.0) -> bool:
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        if predicate():
+            return True
+        time.sleep(0.02)
+    return False
+
+
+def voluntary_switches(pid: int) -> int:
+    for line in Path(f"/proc/{pid}/status").read_text().splitlines():
+        if line.startswith("voluntary_ctxt_switches:"):
+            return int(line.split()[1])
+    raise AssertionError(f"no context switch count for {pid}")
+
+
+def check_idle_wakeups(bin_path: Path, producer_path: Path, out_dir: Path) -> None:
+    """An idle consumer sleeps on the ring's semaphore instead of waking to poll, yet follows a resize and stops on SIGINT."""
+    name = f"/fib-check-idle-{os.getpid()}"
+    dump = out_dir / "idle_last.pgm"
+    rendered = out_dir / "idle.txt"
+
+    producer = subprocess.Popen([str(producer_path), "--dump", str(dump), name, "64", "32", "3", "30"])
+    consumer = None
+    try:
+        assert wait_for(dump.exists), "producer did not publish its frames"
+        consumer = subprocess.Popen(
+            [str(bin_path), "--shm", name, "16", "8", str(rendered)], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True
+        )
+        expected = subprocess.run(
+            [str(bin_path), str(dump), "16", "8"], check=True, stdout=subprocess.PIPE, text=True
+        ).stdout
+        assert wait_for(lambda: rendered.exists() and rendered.read_text() == expected), "idle ring frame not rendered"
+
+        before = voluntary_switches(consumer.pid)
+        time.sleep(0.5)
+        wakeups = voluntary_switches(consumer.pid) - before
+        assert wakeups < 10, f"idle shm consumer woke {wakeups} times in 0.5 s"
+
+        consumer.send_signal(signal.SIGINT)
+        consumer.communicate(timeout=5)
+        assert consumer.returncode == 0, "a waiting shm consumer should exit cleanly on SIGINT"
+
+        # --fit --shm: a resize has to wake a consumer that is asleep on the ring
+        master, slave = pty.openpty()
+        set_size(slave, 30, 11)
+        env = os.environ.copy()
+        env["NO_COLOR"] = "1"
+        consumer = subprocess.Popen([str(bin_path), "--fit", "--shm", name], stdout=slave, stderr=subprocess.DEVNULL, env=env)
+        os.close(slave)
+        try:
+            read_frame(master, 10)
+            time.sleep(0.1)
+            set_size(master, 44, 9)
+            consumer.send_signal(signal.SIGWINCH)
+            lines = read_frame(master, 8)
+            assert all(len(line) == 44 for line in lines[:8]), "an idle --fit --shm consumer should follow a resize"
+            consumer.send_signal(signal.SIGINT)
+            assert consumer.wait(timeout=5) == 0, "--fit --shm should exit cleanly on SIGINT"
+        finally:
+            os.close(master)
+    finally:
+        if consumer and consumer.poll() is None:
+            consumer.kill()
+        producer.send_signal(signal.SIGINT)
+        assert producer.wait(timeout=5) == 0, "producer should exit cleanly"
+
+
+def check_incremental(bin_path: Path, producer_path: Path, out_dir: Path) -> None:
+    """--shm --incremental follows a moving frame, carrying dither rows between frames, and ends on a full render."""
+    name = f"/fib-check-incremental-{os.getpid()}"
+    dump = out_dir / "incremental_last.pgm"
+    rendered = out_dir / "incremental.txt"
+
+    producer = subprocess.Popen([str(producer_path), "--dump", str(dump), name, "320", "180", "30", "30"])
+    consumer = None
+    try:
+        assert wait_for(lambda: Path("/dev/shm" + name).exists()), "producer did not create its ring"
+        consumer = subprocess.Popen(
+            [str(bin_path), "--verbose", "--incremental", "--shm", name, "48", "16", str(rendered)],
+            stdout=subprocess.DEVNULL,
+            stderr=subprocess.PIPE,
+            text=True,
+        )
+        assert wait_for(dump.exists), "producer did not publish its frames"
+        expected = subprocess.run(
+            [str(bin_path), str(dump), "48", "16"], check=True, stdout=subprocess.PIPE, text=True
+        ).stdout
+        assert wait_for(lambda: rendered.exists() and rendered.read_text() == expected), "incremental shm render differs"
+
+        consumer.send_signal(signal.SIGINT)
+        _, log = consumer.communicate(timeout=5)
+        assert consumer.returncode == 0, "incremental shm mode should exit cleanly on SIGINT"
+        drawn = [int(line.split(", ")[1].split()[0]) for line in log.splitlines() if "rows redrawn" in line]
+        assert len(drawn) > 1 and drawn[0] == 16, f"incremental frames should follow the ring: {drawn}"
+        assert any(count < 16 for count in drawn[1:]), f"the moving square should leave rows untouched: {drawn}"
+    finally:
+        if consumer and consumer.poll() is None:
+            consumer.kill()
+        producer.send_signal(signal.SIGINT)
+        assert producer.wait(timeout=5) == 0, "producer should exit cleanly"
+
+
+def main() -> None:
+    if not sys.platform.startswith("linux"):
+        print("shm checks skipped (POSIX shared memory path not checked on this platform)")
+        return
+
+    root = Path(__file__).resolve().parents[1]
+    bin_path = Path(os.environ.get("FIB_BIN", str(root.parent / "fib")))
+    producer_path = Path(os.environ.get("FIB_SHM_PRODUCER", str(root.parent / "fib_shm_producer")))
+    out_dir = root / "output" / "shm"
+    shutil.rmtree(out_dir, ignore_errors=True)
+    out_dir.mkdir(parents=True)
+
+    name = f"/fib-check-{os.getpid()}"
+    dump = out_dir / "last.pgm"
+    rendered = out_dir / "render.txt"
+
+    missing = subprocess.run([str(bin_path), "--shm", name, "24", "8"], stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    assert missing.returncode != 0 and "cannot open shared memory" in missing.stderr, "missing ring should fail"
+
+    producer = subprocess.Popen([str(producer_path), "--dump", str(dump), name, "320", "180", "40", "400"])
+    consumer = None
+    try:
+        assert wait_for(dump.exists), "producer did not publish its frames"
+        time.sleep(0.05)
+
+        consumer = subprocess.Popen(
+            [str(bin_path), "--verbose", "--shm", name, "48", "16", str(rendered)],
+            stdout=subprocess.DEVNULL,
+            stderr=subprocess.PIPE,
+            text=True,
+        )
+        expected = subprocess.run(
+            [str(bin_path), str(dump), "48", "16"], check=True, stdout=subprocess.PIPE, text=True
+        ).stdout
+        assert wait_for(lambda: rendered.exists() and rendered.read_text() == expected), "newest frame not rendered"
+
+        consumer.send_signal(signal.SIGINT)
+        _, log = consumer.communicate(timeout=5)
+        assert consumer.returncode == 0, "shm mode should exit cleanly on SIGINT"
+        assert "shm frame 40 (320x180), 39 stale skipped" in log, "stale frames should be skipped"
+        assert log.count("rendered in") == 1, "only the newest frame should be rendered"
+    finally:
+        if consumer and consumer.poll() is None:
+            consumer.kill()
+        producer.send_signal(signal.SIGINT)
+        assert producer.wait(timeout=5) == 0, "producer should exit cleanly"
+
+    check_incremental(bin_path, producer_path, out_dir)
+    check_idle_wakeups(bin_path, producer_path, out_dir)
+    print("shm checks passed")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+from __future__ import annotations
+
+import os
+from pathlib import Path
+import pty
+import re
+import select
+import shutil
+import signal
+import subprocess
+import sys
+import time
+
+CURSOR_MOVE = re.compile(rb"\x1b\[(\d+);1H")
+
+
+def wait_for_text(path: Path, expected: str, timeout: float = 5.0) -> bool:
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        if path.exists() and path.read_text() == expected:
+            return True
+        time.sleep(0.02)
+    return False
+
+
+def render_once(bin_path: Path, image: Path, width: int = 24, height: int = 8) -> str:
+    result = subprocess.run(
+        [str(bin_path), str(image), str(width), str(height)], check=True, stdout=subprocess.PIPE, text=True
+    )
+    return result.stdout
+
+
+def write_pgm(path: Path, width: int, height: int, patch: tuple[int, int, int, int] | None = None) -> None:
+    pixels = bytearray((x * 160 // width + y * 64 // height) for y in range(height) for x in range(width))
+    if patch:
+        x0, y0, x1, y1 = patch
+        for y in range(y0, y1):
+            for x in range(x0, x1):
+                pixels[y * width + x] = 255 - pixels[y * width + x]
+    staged = path.with_suffix(".tmp")
+    staged.write_bytes(b"P5\n%d %d\n255\n" % (width, height) + bytes(pixels))
+    os.replace(staged, path)
+
+
+def check_incremental(bin_path: Path, out_dir: Path) -> None:
+    """--incremental must match a full render while redrawing only rows near a small change."""
+    watched = out_dir / "screen.pgm"
+    reference = out_dir / "screen_reference.pgm"
+    rendered = out_dir / "incremental.txt"
+    write_pgm(watched, 320, 240)
+
+    process = subprocess.Popen(
+        [str(bin_path), "--watch", "--incremental", "--verbose", str(watched), "40", "30", str(rendered)],
+        stdout=subprocess.DEVNULL,
+        stderr=subprocess.PIPE,
+        text=True,
+    )
+    try:
+        write_pgm(reference, 320, 240)
+        assert wait_for_text(rendered, render_once(bin_path, reference, 40, 30)), "initial incremental render missing"
+        for patch in ((280, 200, 300, 216), (8, 8, 40, 24)):
+            write_pgm(reference, 320, 240, patch)
+            write_pgm(watched, 320, 240, patch)
+            assert wait_for_text(rendered, render_once(bin_path, reference, 40, 30)), f"incremental render of {patch} differs"
+    finally:
+        process.send_signal(signal.SIGINT)
+        _, stderr = process.communicate(timeout=5)
+    assert process.returncode == 0, "incremental watch should exit cleanly on SIGINT"
+
+    drawn = [int(line.split(", ")[1].split()[0]) for line in stderr.splitlines() if "rows redrawn" in line]
+    assert drawn and drawn[0] == 30, f"first incremental frame should draw every row: {drawn}"
+    assert any(count < 30 for count in drawn[1:]), f"a small bottom-right change should redraw few rows: {drawn}"
+
+
+def read_until_quiet(master: int, quiet: float = 0.3, timeout: float = 5.0) -> bytes:
+    """Collects pty output until nothing has arrived for `quiet` seconds."""
+    data = b""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        ready, _, _ = select.select([master], [], [], quiet)
+        if not ready:
+            if data:
+                return data
+            continue
+        data += os.read(master, 65536)
+    raise AssertionError(f"no terminal output within {timeout}s")
+
+
+def apply_frame(screen: list[str], data: bytes) -> list[int]:
+    """Applies an incremental frame of cursor-moved rows to screen; returns the rows it rewrote."""
+    rewritten = []
+    text = data.replace(b"\r", b"")
+    moves = list(CURSOR_MOVE.finditer(text))
+    for move, following in zip(moves, moves[1:] + [None]):
+        row = int(move.group(1)) - 1
+        body = text[move.end():following.start() if following else len(text)]
+        if row < len(screen) and body:
+            screen[row] = body.rstrip(b"\n").decode()
+            rewritten.append(row)
+    return rewritten
+
+
+def check_incremental_terminal(bin_path: Path, out_dir: Path) -> None:
+    """On a terminal, --incremental rewrites only the changed rows, each after a cursor move."""
+    watched = out_dir / "terminal.pgm"
+    reference = out_dir / "terminal_reference.pgm"
+    write_pgm(watched, 320, 240)
+    env = os.environ.copy()
+    env["NO_COLOR"] = "1"
+
+    master, slave = pty.openpty()
+    process = subprocess.Popen(
+        [str(bin_path), "--watch", "--incremental", str(watched), "40", "30"], stdout=slave, stderr=subprocess.DEVNULL, env=env
+    )
+    os.close(slave)
+    try:
+        first = read_until_quiet(master).replace(b"\r", b"")
+        assert first.startswith(b"\x1b[2J\x1b[H"), "first frame should clear the terminal"
+        screen = first[len(b"\x1b[2J\x1b[H"):].split(b"\x1b[J")[0].decode().splitlines()
+        assert screen == render_once(bin_path, watched, 40, 30).splitlines(), "first terminal frame differs"
+
+        patch = (280, 200, 300, 216)
+        write_pgm(reference, 320, 240, patch)
+        write_pgm(watched, 320, 240, patch)
+        update = read_until_quiet(master)
+        assert b"\x1b[H" not in update and b"\x1b[2J" not in update, "an incremental frame should not repaint the screen"
+        assert update.replace(b"\r", b"").endswith(b"\x1b[31;1H"), "the cursor should park below the frame"
+        rewritten = apply_frame(screen, update[: update.rfind(b"\x1b[31;1H")])
+        assert 0 < len(rewritten) < 30, f"a small change should rewrite few rows: {rewritten}"
+        assert screen == render_once(bin_path, reference, 40, 30).splitlines(), "terminal after the update differs"
+    finally:
+        process.send_signal(signal.SIGINT)
+        assert process.wait(timeout=5) == 0, "incremental watch should exit cleanly on SIGINT"
+        os.close(master)
+
+
+def main() -> None:
+    if not sys.platform.startswith("linux"):
+        print("watch checks skipped (inotify unavailable)")
+        return
+
+    root = Path(__file__).resolve().parents[1]
+    bin_path = Path(os.environ.get("FIB_BIN", str(root.parent / "fib")))
+    fixtures = root / "fixtures"
+    out_dir = root / "output" / "watch"
+    shutil.rmtree(out_dir, ignore_errors=True)
+    out_dir.mkdir(parents=True)
+
+    watched = out_dir / "input.png"
+    rendered = out_dir / "render.txt"
+    shutil.copy(fixtures / "checker.png", watched)
+
+    process = subprocess.Popen(
+        [str(bin_path), "--watch", str(watched), "24", "8", str(rendered)],
+        stdout=subprocess.DEVNULL,
+    )
+    try:
+        assert wait_for_text(rendered, render_once(bin_path, fixtures / "checker.png")), "initial watch render missing"
+
+        staged = out_dir / "staged.png"
+        shutil.copy(fixtures / "radial.png", staged)
+        os.replace(staged, watched)
+        assert wait_for_text(rendered, render_once(bin_path, fixtures / "radial.png")), "atomic replace not re-rendered"
+
+        shutil.copy(fixtures / "gradient.png", watched)
+        assert wait_for_text(rendered, render_once(bin_path, fixtures / "gradient.png")), "in-place write not re-rendered"
+    finally:
+        process.send_signal(signal.SIGINT)
+        assert process.wait(timeout=5) == 0, "watch mode should exit cleanly on SIGINT"
+
+    check_incremental(bin_path, out_dir)
+    check_incremental_terminal(bin_path, out_dir)
+
+    print("watch checks passed")
+
+
+if __name__ == "__main__":
+    main()
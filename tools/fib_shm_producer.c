@@ -0,0 +1,133 @@
+/*
+ * Reference producer for `fib --shm`: creates a frame ring, publishes a moving synthetic
+ * gray pattern at a fixed rate and keeps the segment alive until SIGINT/SIGTERM.
+ *
+ *   fib_shm_producer [--slots N] [--dump frame.pgm] /name width height [frames] [fps]
+ *
+ * frames 0 (the default) publishes forever. --dump writes the last published frame as a
+ * binary PGM so tests can compare the shared-memory render against a file render.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "fib_shm.h"
+
+static volatile sig_atomic_t g_stop_requested = 0;
+
+static void request_stop(int signal_number) {
+    (void)signal_number;
+    g_stop_requested = 1;
+}
+
+static int parse_count(const char *value, long minimum, long maximum, long *out) {
+    char *end_ptr = NULL;
+    long parsed = strtol(value, &end_ptr, 10);
+    if (value[0] == '\0' || *end_ptr != '\0' || parsed < minimum || parsed > maximum) {
+        return 0;
+    }
+    *out = parsed;
+    return 1;
+}
+
+static void draw_frame(unsigned char *pixels, int width, int height, long frame) {
+    int square = (width < height ? width : height) / 3;
+    int square_x = (int)((frame * 3) % (width - square + 1));
+    int square_y = (height - square) / 2;
+
+    for (int y = 0; y < height; y++) {
+        unsigned char *row = pixels + (size_t)y * (size_t)width;
+        for (int x = 0; x < width; x++) {
+            int inside = x >= square_x && x < square_x + square && y >= square_y && y < square_y + square;
+            row[x] = inside ? 255 : (unsigned char)((x * 160) / width + (y * 64) / height);
+        }
+    }
+}
+
+static int dump_pgm(const char *path, const unsigned char *pixels, int width, int height) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "error: cannot create %s\n", path);
+        return 0;
+    }
+    fprintf(file, "P5\n%d %d\n255\n", width, height);
+    size_t written = fwrite(pixels, 1, (size_t)width * (size_t)height, file);
+    return fclose(file) == 0 && written == (size_t)width * (size_t)height;
+}
+
+static void usage(const char *program_name) {
+    fprintf(stderr, "usage: %s [--slots N] [--dump frame.pgm] /name width height [frames] [fps]\n", program_name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *dump_path = NULL;
+    const char *positional[5] = {0};
+    int positional_count = 0;
+    long slots = 4;
+    long width = 0;
+    long height = 0;
+    long frames = 0;
+    long fps = 60;
+
+    for (int index = 1; index < argc; index++) {
+        if (strcmp(argv[index], "--slots") == 0 && index + 1 < argc) {
+            if (!parse_count(argv[++index], FIB_SHM_MIN_SLOTS, FIB_SHM_MAX_SLOTS, &slots)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[index], "--dump") == 0 && index + 1 < argc) {
+            dump_path = argv[++index];
+        } else if (positional_count < 5) {
+            positional[positional_count++] = argv[index];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (positional_count < 3 || !parse_count(positional[1], 1, FIB_MAX_IMAGE_DIMENSION, &width) ||
+        !parse_count(positional[2], 1, FIB_MAX_IMAGE_DIMENSION, &height) ||
+        (positional_count > 3 && !parse_count(positional[3], 0, 1000000000L, &frames)) ||
+        (positional_count > 4 && !parse_count(positional[4], 1, 1000, &fps))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FibShmRing ring;
+    if (!fib_shm_create(positional[0], (int)width, (int)height, (int)slots, &ring)) {
+        return 1;
+    }
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+
+    struct timespec period = {(time_t)(1 / fps), (1000000000L / fps) % 1000000000L};
+    unsigned char *last = NULL;
+    int status = 0;
+    for (long frame = 0; !g_stop_requested && (frames == 0 || frame < frames); frame++) {
+        unsigned char *pixels = fib_shm_begin_write(&ring);
+        if (!pixels) {
+            fprintf(stderr, "error: no free slot in frame ring\n");
+            status = 1;
+            break;
+        }
+        draw_frame(pixels, (int)width, (int)height, frame);
+        fib_shm_publish(&ring);
+        last = pixels;
+        nanosleep(&period, NULL);
+    }
+
+    if (status == 0 && dump_path && last && !dump_pgm(dump_path, last, (int)width, (int)height)) {
+        status = 1;
+    }
+    while (!g_stop_requested && status == 0) {
+        nanosleep(&period, NULL);
+    }
+
+    shm_unlink(positional[0]);
+    fib_shm_detach(&ring);
+    return status;
+}
@@ -0,0 +1,288 @@
+/*
+ * Checks the output sinks of the render API against the FILE* adapter:
+ *
+ *   fib_sink_check <input> [output_width] [output_height]
+ *
+ * Renders the input as text, colored text and a grid frame, first through
+ * fib_render_context_draw into a temporary file and then through a buffer, callback and
+ * writev sink, and compares the bytes. Also checks that a buffer one byte too small
+ * fails and reports the size needed, that a callback returning 0 stops the draw, and
+ * that a writev sink into a pipe whose writes come back short resumes where each one
+ * stopped (the tool is linked with -Wl,--wrap=writev for that).
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "fib_render.h"
+
+#define STOP_AFTER_ROWS 3
+#define SHORT_WRITE_STEPS 3
+
+typedef struct {
+    char *bytes;
+    size_t size;
+    int rows;
+    int stop_after;
+} Collected;
+
+static int collect_row(void *user_data, const char *row, size_t size) {
+    Collected *collected = (Collected *)user_data;
+    char *bytes = (char *)realloc(collected->bytes, collected->size + size);
+
+    if (!bytes) {
+        return 0;
+    }
+    memcpy(bytes + collected->size, row, size);
+    collected->bytes = bytes;
+    collected->size += size;
+    collected->rows++;
+    return collected->stop_after == 0 || collected->rows < collected->stop_after;
+}
+
+typedef struct {
+    int fd;
+    Collected collected;
+} PipeReader;
+
+static int g_short_writes = 0;
+static int g_writev_calls = 0;
+static int g_short_write_count = 0;
+
+ssize_t __real_writev(int fd, const struct iovec *iov, int count);
+
+/*
+ * While g_short_writes is set, each call sends at most 1, 7 or 4093 bytes in turn, as a
+ * full pipe or socket may, so the sink has to resume mid-row and mid-batch.
+ */
+ssize_t __wrap_writev(int fd, const struct iovec *iov, int count) {
+    static const size_t limits[SHORT_WRITE_STEPS] = {1, 7, 4093};
+    struct iovec clipped[FIB_SINK_BATCH_ROWS] = {{NULL, 0}};
+    int clipped_count = 0;
+    size_t requested = 0;
+
+    if (!g_short_writes || count > FIB_SINK_BATCH_ROWS) {
+        return __real_writev(fd, iov, count);
+    }
+    size_t budget = limits[g_writev_calls++ % SHORT_WRITE_STEPS];
+    for (int i = 0; i < count; i++) {
+        requested += iov[i].iov_len;
+        if (budget > 0) {
+            clipped[clipped_count] = iov[i];
+            if (clipped[clipped_count].iov_len > budget) {
+                clipped[clipped_count].iov_len = budget;
+            }
+            budget -= clipped[clipped_count].iov_len;
+            clipped_count++;
+        }
+    }
+
+    ssize_t written = __real_writev(fd, clipped, clipped_count);
+    if (written >= 0 && (size_t)written < requested) {
+        g_short_write_count++;
+    }
+    return written;
+}
+
+static void *drain_pipe(void *user_data) {
+    PipeReader *reader = (PipeReader *)user_data;
+    char chunk[4096];
+    ssize_t length = 0;
+
+    while ((length = read(reader->fd, chunk, sizeof(chunk))) > 0) {
+        if (!collect_row(&reader->collected, chunk, (size_t)length)) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static char *read_all(FILE *file, size_t *size_out) {
+    long size = 0;
+    char *bytes = NULL;
+
+    if (fflush(file) != 0 || fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        return NULL;
+    }
+    bytes = (char *)malloc((size_t)size + 1U);
+    if (!bytes || fread(bytes, 1, (size_t)size, file) != (size_t)size) {
+        free(bytes);
+        return NULL;
+    }
+    *size_out = (size_t)size;
+    return bytes;
+}
+
+static int same_bytes(const char *label, const char *expected, size_t expected_size, const char *actual, size_t actual_size) {
+    if (expected_size != actual_size || memcmp(expected, actual, expected_size) != 0) {
+        fprintf(stderr, "error: %s output differs from the FILE* render (%zu vs %zu bytes)\n", label, actual_size, expected_size);
+        return 0;
+    }
+    return 1;
+}
+
+/* The writev sink into a pipe drained by a second thread, with every write cut short. */
+static int check_short_writes(FibRenderContext *context, const FibImage *image, const FibRenderConfig *config,
+                              const char *label, const char *expected, size_t expected_size) {
+    PipeReader reader = {-1, {0}};
+    pthread_t thread;
+    FibSink sink;
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        fprintf(stderr, "error: cannot create pipe\n");
+        return 0;
+    }
+    reader.fd = fds[0];
+    if (pthread_create(&thread, NULL, drain_pipe, &reader) != 0) {
+        fprintf(stderr, "error: cannot start pipe reader\n");
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+
+    int short_writes = g_short_write_count;
+    g_short_writes = 1;
+    fib_sink_init_writev(&sink, fds[1]);
+    int ok = fib_render_context_emit(context, image, config, &sink);
+    fib_sink_free(&sink);
+    g_short_writes = 0;
+    close(fds[1]);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+
+    ok = ok && same_bytes(label, expected, expected_size, reader.collected.bytes, reader.collected.size);
+    if (ok && g_short_write_count == short_writes) {
+        fprintf(stderr, "error: %s writev sink never saw a short write\n", label);
+        ok = 0;
+    }
+    free(reader.collected.bytes);
+    return ok;
+}
+
+static int check_config(const FibImage *image, const FibRenderConfig *config, const char *label) {
+    FibRenderContext context;
+    FibSink sink;
+    Collected collected = {0};
+    size_t expected_size = 0;
+    size_t written_size = 0;
+    char *expected = NULL;
+    char *written = NULL;
+    char *buffer = NULL;
+    int ok = 0;
+    FILE *reference = tmpfile();
+    FILE *descriptor = tmpfile();
+
+    fib_render_context_init(&context);
+    if (!reference || !descriptor) {
+        fprintf(stderr, "error: cannot create temporary files\n");
+        goto done;
+    }
+    fib_render_context_draw(&context, image, config, reference);
+    expected = read_all(reference, &expected_size);
+    if (!expected || expected_size == 0 || expected_size > fib_render_frame_bytes(config)) {
+        fprintf(stderr, "error: %s reference render is empty or exceeds fib_render_frame_bytes\n", label);
+        goto done;
+    }
+
+    buffer = (char *)malloc(expected_size);
+    fib_sink_init_buffer(&sink, buffer, expected_size);
+    ok = buffer && fib_render_context_emit(&context, image, config, &sink) && sink.length == expected_size &&
+         same_bytes(label, expected, expected_size, buffer, sink.length);
+    fib_sink_free(&sink);
+    if (!ok) {
+        goto done;
+    }
+
+    fib_sink_init_buffer(&sink, buffer, expected_size - 1U);
+    ok = !fib_render_context_emit(&context, image, config, &sink) && sink.length == expected_size;
+    fib_sink_free(&sink);
+    if (!ok) {
+        fprintf(stderr, "error: %s buffer one byte short should fail and ask for %zu bytes\n", label, expected_size);
+        goto done;
+    }
+
+    fib_sink_init_callback(&sink, collect_row, &collected);
+    ok = fib_render_context_emit(&context, image, config, &sink) &&
+         same_bytes(label, expected, expected_size, collected.bytes, collected.size);
+    fib_sink_free(&sink);
+    if (!ok) {
+        goto done;
+    }
+
+    if (config->format == FIB_FORMAT_TEXT) {
+        collected.size = 0;
+        collected.rows = 0;
+        collected.stop_after = STOP_AFTER_ROWS;
+        fib_sink_init_callback(&sink, collect_row, &collected);
+        ok = !fib_render_context_emit(&context, image, config, &sink) && collected.rows == STOP_AFTER_ROWS;
+        fib_sink_free(&sink);
+        if (!ok) {
+            fprintf(stderr, "error: %s callback returning 0 should stop the draw after %d rows\n", label, STOP_AFTER_ROWS);
+            goto done;
+        }
+    }
+
+    fib_sink_init_writev(&sink, fileno(descriptor));
+    ok = fib_render_context_emit(&context, image, config, &sink);
+    fib_sink_free(&sink);
+    written = ok ? read_all(descriptor, &written_size) : NULL;
+    ok = written && same_bytes(label, expected, expected_size, written, written_size) &&
+         check_short_writes(&context, image, config, label, expected, expected_size);
+
+done:
+    free(written);
+    free(buffer);
+    free(expected);
+    free(collected.bytes);
+    if (reference) {
+        fclose(reference);
+    }
+    if (descriptor) {
+        fclose(descriptor);
+    }
+    fib_render_context_free(&context);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    FibRenderConfig config;
+    FibImage image = {0};
+
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "usage: %s <input> [output_width] [output_height]\n", argv[0]);
+        return 1;
+    }
+    if (!fib_image_load(argv[1], &image)) {
+        return 1;
+    }
+
+    memset(&config, 0, sizeof(config));
+    config.output_width = argc > 2 ? atoi(argv[2]) : FIB_DEFAULT_OUTPUT_WIDTH;
+    config.output_height = argc > 3 ? atoi(argv[3]) : FIB_DEFAULT_OUTPUT_HEIGHT;
+    config.thread_count = 1;
+    if (config.output_width <= 0 || config.output_height <= STOP_AFTER_ROWS) {
+        fprintf(stderr, "error: output must be at least 1x%d\n", STOP_AFTER_ROWS + 1);
+        fib_image_free(&image);
+        return 1;
+    }
+
+    int ok = check_config(&image, &config, "text");
+    config.enable_color = 1;
+    ok = ok && check_config(&image, &config, "colored");
+    config.enable_color = 0;
+    config.format = FIB_FORMAT_GRID;
+    ok = ok && check_config(&image, &config, "grid");
+
+    fib_image_free(&image);
+    if (!ok) {
+        return 1;
+    }
+    puts("sink checks passed");
+    return 0;
+}